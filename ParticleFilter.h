@@ -3,11 +3,22 @@
 
 #include <vector>
 #include <type_traits>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <utility>
+#include <memory>
+#include <functional>
+#include <tuple>
+#include <stdexcept>
 
 #define GCC_VERSION (__GNUC__ * 10000 \
 					+ __GNUC_MINOR__ * 100 \
 					+ __GNUC_PATCHLEVEL__)
 
+#include "policy.h"
+#include "storage.h"
+#include "thread_pool.h"
 #include "resampling.h"
 #include "weight.h"
 #include "noise.h"
@@ -15,6 +26,9 @@
 #include "prediction.h"
 #include "winner.h"
 #include "state2obs.h"
+#include "observation_model.h"
+#include "instrumentation.h"
+#include "snapshot.h"
 
 namespace policy_pf {
 
@@ -68,89 +82,1233 @@ template<
 	// ResamplingPolicy defines the method resampling that performs a resampling
 	// step on the state and weight vectors
 	template<class, class> class ResamplingPolicy
-		= resampling_policies::SystematicResampling>
+		= resampling_policies::SystematicResampling,
+
+	// InstrumentationPolicy is notified about the stages and steps of the
+	// particle filter, the default policy does not record anything
+	template<class> class InstrumentationPolicy
+		= instrumentation_policies::None>
 
 class ParticleFilter :
 	public PredictionPolicy<StateType>,
-	public WeightPolicy<WeightType, ObservationType>,
+	public ObservationModel<StateType, ObservationType, WeightType, State2Obs, WeightPolicy>,
 	public ResamplingPolicy<StateType, WeightType>,
 	public NoisePolicy<StateType>,
 	public InitPolicy<StateType>,
 	public WinnerPolicy<StateType, WeightType>,
-	public State2Obs<StateType, ObservationType>
+	public InstrumentationPolicy<WeightType>
 {
+	typedef InstrumentationPolicy<WeightType> Instrumentation;
+
+	// exposes the protected winner method to determine its result type
+	struct WinnerAccess : WinnerPolicy<StateType, WeightType> {
+		using WinnerPolicy<StateType, WeightType>::winner;
+	};
+
 public:
+	// containers holding the particle set and the hypothetical observations
+	// (std::vector, SoAVector for SoA states or FlatVector for Flat states)
+	// and the type of a single observation
+	typedef typename ParticleStorage<StateType>::type Particles;
+	typedef typename ParticleStorage<ObservationType>::type Observations;
+	typedef typename ParticleStorage<ObservationType>::value_type Observation;
+
+	// type returned by run
+	typedef decltype(std::declval<WinnerAccess&>().winner(std::declval<const Particles&>(),
+		std::declval<const std::vector<WeightType>&>())) Winner;
+
+private:
+	// type of the partial results of the range form of winner, which are
+	// combined and completed by finish_winner; Winner if there is no range form
+	template<typename W>
+	static auto partial_winner(W& w, int) -> decltype(w.winner(std::declval<const Particles&>(),
+		std::declval<const std::vector<WeightType>&>(), size_t(), size_t()));
+	template<typename W>
+	static Winner partial_winner(W&, long);
+	typedef decltype(partial_winner(std::declval<WinnerAccess&>(), 0)) PartialWinner;
+
+public:
+
 	ParticleFilter(unsigned int num_particles) :
 		PredictionPolicy<StateType>(),
-		WeightPolicy<WeightType, ObservationType>(),
+		ObservationModel<StateType, ObservationType, WeightType, State2Obs, WeightPolicy>(),
 		ResamplingPolicy<StateType, WeightType>(),
 		NoisePolicy<StateType>(),
 		InitPolicy<StateType>(),
 		WinnerPolicy<StateType, WeightType>(),
-		State2Obs<StateType, ObservationType>(),
-		num_particles(num_particles), initialized(false) {}
+		InstrumentationPolicy<WeightType>(),
+		num_particles(num_particles), initialized(false),
+		resampling_threshold(1), ess(0), weight_sum(0), log_likelihood(0), zero_weights(false), carry_weights(false),
+		ancestor_resampling(false), fanout_pending(false), fused(false), fixed_lag(0), step_count(0),
+		auxiliary(false), first_stage(false), lookahead_exponent(1) {}
 
 	~ParticleFilter() {}
 
 #if GCC_VERSION < 40700
 	typedef ParticleFilter<StateType, ObservationType, WeightType, PredictionPolicy,
-		State2Obs, WeightPolicy, WinnerPolicy, InitPolicy, NoisePolicy, ResamplingPolicy> PF_t;
+		State2Obs, WeightPolicy, WinnerPolicy, InitPolicy, NoisePolicy, ResamplingPolicy,
+		InstrumentationPolicy> PF_t;
 	static PF_t *getPFInstance();
 #define THIS getPFInstance()
 #else
 #define THIS this
 #endif
 
-    auto run(const ObservationType& observation)
+    auto run(const Observation& observation)
 			-> decltype(THIS->WinnerPolicy<StateType, WeightType>::winner(
-				std::vector<StateType>(), std::vector<WeightType>())) {
+				Particles(), std::vector<WeightType>())) {
+		begin_step();
+		if(auxiliary)
+			run_auxiliary(observation);
+		else if(!fused || !apply_fused(observation, Rank<1>()))
+			run_stages(observation);
+		return finish_step();
+	}
+
+	// Runs a step with the readings of several sensors, made by
+	// Sensor::reading (see sensor.h). The particles are predicted once, the
+	// likelihoods of all readings are multiplied (their log-likelihoods added
+	// for a log-likelihood weight policy of the filter, which is otherwise
+	// not used) and the particles are resampled once. Readings without an
+	// observation are skipped. The fused execution does not apply.
+	template<typename... Readings>
+	Winner update(const Readings&... readings) {
+		begin_step();
+		const SensorReadings<Readings...> input = {std::tuple<const Readings&...>(readings...)};
+		if(auxiliary)
+			run_auxiliary(input);
+		else
+			run_stages(input);
+		return finish_step();
+	}
+
+	// Runs the filter on the observations [first, last) and writes the winner
+	// of every step to out. Returns the end of the output.
+	template<typename InputIterator, typename OutputIterator>
+	OutputIterator run_batch(InputIterator first, InputIterator last, OutputIterator out) {
+		for(; first != last; ++first)
+			*out++ = run(*first);
+		return out;
+	}
+
+	// Also writes one smoothed estimate per observation to smoothed_out. The
+	// estimate of an observation is written after the step fixed lag
+	// observations later; the estimates of the last observations of the
+	// range are made with the particles of the last step.
+	template<typename InputIterator, typename OutputIterator, typename SmoothedIterator>
+	std::pair<OutputIterator, SmoothedIterator> run_batch(InputIterator first, InputIterator last,
+			OutputIterator out, SmoothedIterator smoothed_out) {
+		size_t k = 0;
+		for(; first != last; ++first, ++k) {
+			*out++ = run(*first);
+			if(k >= fixed_lag)
+				*smoothed_out++ = smoothed(fixed_lag);
+		}
+		for(size_t l = std::min<size_t>(k, fixed_lag); l > 0; --l)
+			*smoothed_out++ = smoothed(l - 1);
+		return std::make_pair(out, smoothed_out);
+	}
+
+	void reset() {
+		initialized = false;
+		fanout_pending = false;
+	}
+
+	// Saves the particle set, the weights, the state and the settings of the
+	// filter and the parameters and random number generators of the policies
+	// implementing save_state and load_state (see snapshot.h), so a filter of
+	// the same type continues where this one stopped after loadSnapshot. The
+	// number of threads and the smoothing history are not saved, the history
+	// of the fixed lag starts again after loading.
+	void saveSnapshot(const std::string& filename) const {
+		snapshot::Writer w;
+		writeSnapshot(w);
+		w.save(filename);
+	}
+
+	// maps the snapshot file into memory and copies the filter out of it; if
+	// this throws, the filter has to be reset or restored again
+	void loadSnapshot(const std::string& filename) {
+		snapshot::MappedFile file(filename);
+		snapshot::Reader r(file.data(), file.size());
+		readSnapshot(r);
+	}
+
+	void writeSnapshot(snapshot::Writer& w) const {
+		w.begin_section(snapshot::FilterSection);
+		w.write(uint64_t(num_particles));
+		w.write(initialized);
+		w.write(carry_weights);
+		w.write(zero_weights);
+		w.write(fanout_pending);
+		w.write(ancestor_resampling);
+		w.write(resampling_threshold);
+		w.write(ess);
+		w.write(weight_sum);
+		w.write(log_likelihood);
+		w.write(auxiliary);
+		w.write(fused);
+		w.write(lookahead_exponent);
+		w.write(uint32_t(fixed_lag));
+		w.end_section();
+
+		if(initialized) {
+			w.begin_section(snapshot::ParticlesSection);
+			snapshot::write_particles(w, particles);
+			w.end_section();
+			w.begin_section(snapshot::WeightsSection);
+			w.write_numbers(particle_weights.data(), particle_weights.size());
+			w.end_section();
+		}
+		if(initialized && carry_weights) {
+			w.begin_section(snapshot::CarriedWeightsSection);
+			w.write_numbers(carried_weights.data(), carried_weights.size());
+			w.end_section();
+		}
+		if(initialized && fanout_pending) {
+			w.begin_section(snapshot::AncestorsSection);
+			w.write_numbers(ancestor_index.data(), ancestor_index.size());
+			w.end_section();
+		}
+
+		save_policy<PredictionPolicy<StateType> >(w, snapshot::PredictionSection, Rank<1>());
+		save_policy<State2Obs<StateType, ObservationType> >(w, snapshot::State2ObsSection, Rank<1>());
+		save_policy<WeightPolicy<WeightType, ObservationType> >(w, snapshot::WeightPolicySection, Rank<1>());
+		save_policy<WinnerPolicy<StateType, WeightType> >(w, snapshot::WinnerSection, Rank<1>());
+		save_policy<InitPolicy<StateType> >(w, snapshot::InitSection, Rank<1>());
+		save_policy<NoisePolicy<StateType> >(w, snapshot::NoiseSection, Rank<1>());
+		save_policy<ResamplingPolicy<StateType, WeightType> >(w, snapshot::ResamplingSection, Rank<1>());
+		save_policy<Instrumentation>(w, snapshot::InstrumentationSection, Rank<1>());
+	}
+
+	void readSnapshot(snapshot::Reader& r) {
+		if(!r.find_section(snapshot::FilterSection))
+			throw std::runtime_error("snapshot: no particle filter state");
+		uint64_t n;
+		uint32_t lag;
+		r.read(n);
+		r.read(initialized);
+		r.read(carry_weights);
+		r.read(zero_weights);
+		r.read(fanout_pending);
+		r.read(ancestor_resampling);
+		r.read(resampling_threshold);
+		r.read(ess);
+		r.read(weight_sum);
+		r.read(log_likelihood);
+		r.read(auxiliary);
+		r.read(fused);
+		r.read(lookahead_exponent);
+		r.read(lag);
+		num_particles = n;
+		setFixedLag(lag);
+
+		if(initialized) {
+			if(!r.find_section(snapshot::ParticlesSection))
+				throw std::runtime_error("snapshot: no particles");
+			snapshot::read_particles(r, particles);
+			if(!r.find_section(snapshot::WeightsSection))
+				throw std::runtime_error("snapshot: no weights");
+			r.read_numbers(particle_weights);
+			if(particle_weights.size() != particles.size())
+				throw std::runtime_error("snapshot: the number of weights does not match the particles");
+		}
+		if(initialized && carry_weights) {
+			if(!r.find_section(snapshot::CarriedWeightsSection))
+				throw std::runtime_error("snapshot: no carried weights");
+			r.read_numbers(carried_weights);
+			if(carried_weights.size() != particles.size())
+				throw std::runtime_error("snapshot: the number of carried weights does not match the particles");
+		}
+		if(initialized && fanout_pending) {
+			if(!r.find_section(snapshot::AncestorsSection))
+				throw std::runtime_error("snapshot: no ancestors");
+			r.read_numbers(ancestor_index);
+			for(auto a : ancestor_index)
+				if(a >= particles.size())
+					throw std::runtime_error("snapshot: an ancestor is not in the particle set");
+		}
+
+		load_policy<PredictionPolicy<StateType> >(r, snapshot::PredictionSection, Rank<1>());
+		load_policy<State2Obs<StateType, ObservationType> >(r, snapshot::State2ObsSection, Rank<1>());
+		load_policy<WeightPolicy<WeightType, ObservationType> >(r, snapshot::WeightPolicySection, Rank<1>());
+		load_policy<WinnerPolicy<StateType, WeightType> >(r, snapshot::WinnerSection, Rank<1>());
+		load_policy<InitPolicy<StateType> >(r, snapshot::InitSection, Rank<1>());
+		load_policy<NoisePolicy<StateType> >(r, snapshot::NoiseSection, Rank<1>());
+		load_policy<ResamplingPolicy<StateType, WeightType> >(r, snapshot::ResamplingSection, Rank<1>());
+		load_policy<Instrumentation>(r, snapshot::InstrumentationSection, Rank<1>());
+
+		apply_streams(Rank<1>());
+		step_count = 0;
+		next_parents.clear();
+	}
+
+	// Keeps the weighted particle sets of the last lag+1 steps and the indices
+	// of the ancestors of their particles, so smoothed can estimate the states
+	// of the last lag steps given all observations up to now. This takes
+	// memory for N*(lag+1) particles and needs a resampling policy implementing
+	// select_ancestors. A lag of 0 (the default) disables smoothing.
+	void setFixedLag(unsigned int lag) {
+		if(lag > 0 && !selects_ancestors(Rank<1>()))
+			throw std::invalid_argument("ParticleFilter::setFixedLag: the resampling policy does not implement select_ancestors");
+		fixed_lag = lag;
+		history.resize(lag > 0 ? lag + 1 : 0);
+		parents.resize(history.size());
+		step_count = 0;
+		next_parents.clear();
+	}
+
+	// Winner of the particles of the step lag steps before the last one,
+	// traced forward along their descendants and weighted with the weights of
+	// the last step before resampling. smoothed(0) is the winner of the
+	// weighted particle set of the last step.
+	Winner smoothed(unsigned int lag) {
+		if(lag >= history.size() || lag >= step_count)
+			throw std::out_of_range("ParticleFilter::smoothed: lag exceeds the fixed lag or the number of steps");
+
+		const size_t t = step_count - 1;
+		lineage.resize(history_weights.size());
+		for(size_t i = 0; i < lineage.size(); ++i)
+			lineage[i] = i;
+		for(size_t s = t; s > t - lag; --s) {
+			const std::vector<size_t>& p = parents[s % history.size()];
+			if(!p.empty()) // empty if the step did not resample
+				for(auto& a : lineage)
+					a = p[a];
+		}
+		gather(history[(t - lag) % history.size()], lineage, smooth_buffer);
+		return WinnerPolicy<StateType, WeightType>::winner(smooth_buffer, history_weights);
+	}
+
+	// Resamples only if the effective sample size of the last step drops below
+	// fraction * number of particles. A fraction of 1 (the default) resamples
+	// on every step.
+	void setResamplingThreshold(double fraction) {
+		resampling_threshold = fraction;
+	}
+
+	// Resampling policies implementing select_ancestors may leave only the
+	// unique ancestors in the particle set, weighted by their multiplicity.
+	// The next prediction is then computed once per unique ancestor and the
+	// copies are made when the noise is applied. This saves model evaluations
+	// if the prediction is expensive and deterministic.
+	void setAncestorResampling(bool enable) {
+		ancestor_resampling = enable;
+	}
+
+	// Runs prediction, noise, state2obs and weighting on blocks of
+	// FusedBlockSize particles, so every block is still in the cache when it
+	// is weighted and no observation is stored for the whole particle set.
+	// This needs the range interfaces of the prediction, noise and weight
+	// policies and a state2obs policy implementing observe; otherwise the
+	// stages are run one after another. The results are the same, except
+	// for SoA states, whose noise is drawn column by column in every block.
+	void setFusedExecution(bool enable) {
+		fused = enable;
+	}
+
+	static const size_t FusedBlockSize = 256;
+
+	// Auxiliary particle filter (Pitt, Shephard): every step first weights the
+	// particles by the likelihood of their prediction without noise (the
+	// look-ahead), resamples according to these weights and then adds the
+	// noise, so mostly particles which are likely to explain the observation
+	// are propagated. The weights are then divided by the look-ahead of their
+	// ancestors. The resampling policy has to implement select_ancestors;
+	// the resampling threshold, ancestor resampling and fused execution do
+	// not apply in this mode.
+	void setAuxiliary(bool enable) {
+		if(enable && !selects_ancestors(Rank<1>()))
+			throw std::invalid_argument("ParticleFilter::setAuxiliary: the resampling policy does not implement select_ancestors");
+		// the auxiliary mode resamples the whole particle set
+		if(enable && fanout_pending)
+			expand_ancestors();
+		auxiliary = enable;
+	}
+
+	// The look-ahead likelihood is raised to the power exponent (default 1).
+	// An exponent below 1 flattens it, as the prediction without noise is more
+	// certain than the particles after adding the noise.
+	void setLookaheadExponent(double exponent) {
+		lookahead_exponent = exponent;
+	}
+
+	// current size of the particle set, which may be changed by the resampling policy
+	size_t particleCount() const {
+		if(!initialized)
+			return num_particles;
+		return fanout_pending ? ancestor_index.size() : particles.size();
+	}
+
+	// effective sample size 1/sum(w^2) of the normalized weights of the last step
+	double effectiveSampleSize() const {
+		return ess;
+	}
+
+	// Logarithm of the mean weight of the last step, taking the weights carried
+	// forward into account. With likelihoods as weights this estimates the log
+	// likelihood of the last observation given the previous ones, except in
+	// the auxiliary mode. -inf if all weights were zero.
+	double logLikelihood() const {
+		return log_likelihood;
+	}
+
+	// particle set and normalized weights after the last step; while the
+	// unique ancestors of ancestor resampling are pending, only they are stored
+	const Particles& getParticles() const {
+		return particles;
+	}
+
+	const std::vector<WeightType>& getWeights() const {
+		return particle_weights;
+	}
+
+	// Replaces the particles idx[k] by src[k] (e.g. particles received from
+	// another filter), their weights are kept. Not possible while the unique
+	// ancestors of ancestor resampling are pending.
+	void replaceParticles(const Particles& src, const std::vector<size_t>& idx) {
+		if(fanout_pending)
+			throw std::logic_error("ParticleFilter::replaceParticles: the ancestors of the last resampling are pending");
+		scatter(src, idx, particles);
+	}
+
+	// Runs the per-particle stages on num_threads threads, each working on a
+	// contiguous range of particles with its own random number stream. The
+	// results only depend on the seeds and the number of threads. Policies
+	// without a range interface are still called on the whole particle set.
+	void setThreads(unsigned int num_threads) {
+		pool.reset(num_threads > 1 ? new ThreadPool(num_threads) : nullptr);
+		partial_sums.resize(threads());
+		partial_winners.resize(threads());
+		apply_streams(Rank<1>());
+	}
+
+	unsigned int threads() const {
+		return pool ? pool->size() : 1;
+	}
+
+private:
+	// expression of the type ParticleFilter depending on T, used to detect
+	// which interface a policy implements
+	template<typename T>
+	static typename Dependent<T, ParticleFilter>::type& self();
+
+	typedef std::integral_constant<bool,
+		weight_policies::isLogLikelihood<WeightPolicy<WeightType, ObservationType> >::value> LogWeights;
+	typedef std::integral_constant<bool,
+		winner_policies::isBeforeResampling<WinnerPolicy<StateType, WeightType> >::value> WinnerBeforeResampling;
+
+	// type of the sums over the weights, double for float weights
+	typedef typename Accumulator<WeightType>::type Sum;
+
+	// the readings passed to update
+	template<typename... Readings>
+	struct SensorReadings {
+		std::tuple<const Readings&...> readings;
+	};
+
+	// initializes the state vector on the first step
+	void begin_step() {
 		static_assert(std::is_floating_point<WeightType>::value,
 			"WeightType must be a floating point type!");
-	
-		// initialize the state vector
+
 		if(!initialized) {
 			particles = InitPolicy<StateType>::init(num_particles);
 			initialized = true;
+			carry_weights = false;
+			fanout_pending = false;
+			step_count = 0;
+			next_parents.clear();
+		}
+	}
+
+	// resamples the normalized particle set and chooses the winner
+	Winner finish_step() {
+		namespace stage = instrumentation_policies;
+
+		if(fixed_lag > 0)
+			record_history();
+
+		// resampling, unless the effective sample size is still large enough;
+		// the weights are then carried forward to the next step
+		const size_t weighted_particles = particle_weights.size();
+		log_likelihood = log_weight_sum(LogWeights())
+			- (carry_weights ? 0 : std::log(double(weighted_particles)));
+		const bool resample = !auxiliary &&
+			(resampling_threshold >= 1 || ess < resampling_threshold * weighted_particles);
+		if(resample) {
+			Instrumentation::begin_stage(stage::Resampling);
+			apply_resampling(Rank<3>());
+			carry_weights = false;
+			Instrumentation::end_stage(stage::Resampling);
+		} else {
+			carried_weights.resize(particle_weights.size());
+			for_each_range([this](size_t begin, size_t end, unsigned int) {
+				std::copy(particle_weights.begin() + begin, particle_weights.begin() + end,
+					carried_weights.begin() + begin);
+			});
+			carry_weights = true;
+			next_parents.clear();
 		}
 
+		// choose winner
+		Instrumentation::begin_stage(stage::Winner);
+		auto win = apply_winner(Rank<2>());
+		Instrumentation::end_stage(stage::Winner);
+
+		Instrumentation::end_step(weighted_particles, ess, weight_sum, zero_weights, resample || auxiliary);
+		return win;
+	}
+
+	// runs the stages up to the normalization one after another, the input
+	// is an observation or the readings of update
+	template<typename Input>
+	void run_stages(const Input& observation) {
+		namespace stage = instrumentation_policies;
+
 		// update particles and add system noise
-		PredictionPolicy<StateType>::predict(particles);
-		NoisePolicy<StateType>::noise(particles);
+		Instrumentation::begin_stage(stage::Predict);
+		apply_predict(Rank<1>());
+		Instrumentation::end_stage(stage::Predict);
+
+		Instrumentation::begin_stage(stage::Noise);
+		apply_noise(Rank<1>());
+		Instrumentation::end_stage(stage::Noise);
 
 		// calculate weights/probabilities
-		auto hyp_obs = State2Obs<StateType, ObservationType>::state2obs(particles);
-		auto particle_weights = WeightPolicy<WeightType, ObservationType>::weight(hyp_obs, observation);
+		Instrumentation::begin_stage(stage::State2Obs);
+		map_observations(observation);
+		Instrumentation::end_stage(stage::State2Obs);
+
+		Instrumentation::begin_stage(stage::Weight);
+		weigh_observations(observation);
+		if(carry_weights)
+			combine_weights(LogWeights());
+		Instrumentation::end_stage(stage::Weight);
 
 		// normalize weights
-		WeightType wsum = 0;
-		for(auto w : particle_weights) {
-			wsum += w;
-		}
-        if(wsum == 0) { // if all weights are zero
-            for(auto& p : particle_weights) {
-                p = 1.0 / num_particles;
-            }
-        } else {
-            for(size_t i = 0; i < num_particles; ++i) {
-                particle_weights[i] /= wsum;
-            }
-        }
-
-		// resampling
+		Instrumentation::begin_stage(stage::Normalize);
+		normalize(reduce_weights(LogWeights()), LogWeights());
+		Instrumentation::end_stage(stage::Normalize);
+	}
+
+	// first stage weights: look-ahead times the weights of the last step
+	template<typename Input>
+	void run_auxiliary(const Input& observation) {
+		namespace stage = instrumentation_policies;
+
+		Instrumentation::begin_stage(stage::Predict);
+		apply_predict(Rank<1>());
+		Instrumentation::end_stage(stage::Predict);
+
+		Instrumentation::begin_stage(stage::State2Obs);
+		map_observations(observation);
+		Instrumentation::end_stage(stage::State2Obs);
+
+		Instrumentation::begin_stage(stage::Weight);
+		weigh_observations(observation);
+		lookahead.resize(particle_weights.size());
+		for_each_range([this](size_t begin, size_t end, unsigned int) {
+			for(size_t i = begin; i < end; ++i)
+				lookahead[i] = particle_weights[i] = temper(particle_weights[i], LogWeights());
+		});
+		if(carry_weights)
+			combine_weights(LogWeights());
+		Instrumentation::end_stage(stage::Weight);
+
+		Instrumentation::begin_stage(stage::Normalize);
+		first_stage = true;
+		normalize(reduce_weights(LogWeights()), LogWeights());
+		first_stage = false;
+		Instrumentation::end_stage(stage::Normalize);
+
+		// resample the predicted particles and keep the look-ahead of their ancestors
+		Instrumentation::begin_stage(stage::Resampling);
+		apply_select_ancestors(Rank<1>());
+		const size_t n = ancestor_index.size();
+		const bool neutral = zero_weights;
+		resize_like(particle_buffer, n, particles);
+		ancestor_lookahead.resize(n);
+		parallel_for(pool.get(), n, [this, neutral](size_t begin, size_t end, unsigned int) {
+			gather(particles, ancestor_index, particle_buffer, begin, end);
+			for(size_t k = begin; k < end; ++k)
+				ancestor_lookahead[k] = neutral ? neutral_weight(LogWeights()) : lookahead[ancestor_index[k]];
+		});
+		particles.swap(particle_buffer);
+		if(fixed_lag > 0)
+			next_parents = ancestor_index;
+		carry_weights = false;
+		Instrumentation::end_stage(stage::Resampling);
+
+		Instrumentation::begin_stage(stage::Noise);
+		apply_noise(Rank<1>());
+		Instrumentation::end_stage(stage::Noise);
+
+		Instrumentation::begin_stage(stage::State2Obs);
+		map_observations(observation);
+		Instrumentation::end_stage(stage::State2Obs);
+
+		// second stage weights: likelihood divided by the look-ahead of the ancestor
+		Instrumentation::begin_stage(stage::Weight);
+		weigh_observations(observation);
+		for_each_range([this](size_t begin, size_t end, unsigned int) {
+			for(size_t i = begin; i < end; ++i)
+				particle_weights[i] = divide_lookahead(particle_weights[i], ancestor_lookahead[i], LogWeights());
+		});
+		Instrumentation::end_stage(stage::Weight);
+
+		Instrumentation::begin_stage(stage::Normalize);
+		normalize(reduce_weights(LogWeights()), LogWeights());
+		Instrumentation::end_stage(stage::Normalize);
+	}
+
+	WeightType temper(WeightType w, std::false_type) const {
+		return lookahead_exponent == 1 ? w : std::pow(w, WeightType(lookahead_exponent));
+	}
+
+	WeightType temper(WeightType w, std::true_type) const {
+		return w * WeightType(lookahead_exponent);
+	}
+
+	// if all first stage weights are zero the look-ahead is ignored
+	static WeightType neutral_weight(std::false_type) {
+		return 1;
+	}
+
+	static WeightType neutral_weight(std::true_type) {
+		return 0;
+	}
+
+	// particles whose look-ahead is zero are only selected if all are zero,
+	// the look-ahead is then ignored
+	static WeightType divide_lookahead(WeightType w, WeightType l, std::false_type) {
+		return l > 0 ? w / l : w;
+	}
+
+	static WeightType divide_lookahead(WeightType w, WeightType l, std::true_type) {
+		return l > -std::numeric_limits<WeightType>::infinity() ? w - l : w;
+	}
+
+	template<typename T = void>
+	auto apply_select_ancestors(Rank<1>) -> decltype(self<T>()
+			.select_ancestors(std::declval<const Particles&>(), std::declval<const std::vector<WeightType>&>(),
+				std::declval<std::vector<Sum>&>(), std::declval<std::vector<size_t>&>(), (ThreadPool*) nullptr)) {
+		ResamplingPolicy<StateType, WeightType>::select_ancestors(particles, particle_weights, cdf,
+			ancestor_index, pool.get());
+	}
+
+	template<typename T = void>
+	void apply_select_ancestors(Rank<0>) {
+		throw std::logic_error("ParticleFilter: the resampling policy does not implement select_ancestors");
+	}
+
+	// Every thread works through its range in blocks, using its own block of
+	// observations and weights. The weights are reduced in the same pass.
+	template<typename T = void>
+	auto apply_fused(const Observation& observation, Rank<1>) -> decltype(
+			self<T>().predict(std::declval<Particles&>(), size_t(), size_t()),
+			self<T>().noise(std::declval<Particles&>(), size_t(), size_t(), 0u),
+			self<T>().observe(std::declval<const Particles&>(), size_t(), size_t(), std::declval<Observations&>()),
+			self<T>().weight(std::declval<Observations&>(), observation,
+				std::declval<std::vector<WeightType>&>(), size_t(), size_t()),
+			bool()) {
+		namespace stage = instrumentation_policies;
+		Instrumentation::begin_stage(stage::Fused);
+
+		// the unique ancestors are predicted before they are copied
+		const bool fanout = fanout_pending;
+		if(fanout) {
+			for_each_range([this](size_t begin, size_t end, unsigned int) {
+				PredictionPolicy<StateType>::predict(particles, begin, end);
+			});
+			resize_like(particle_buffer, ancestor_index.size(), particles);
+		}
+
+		Particles& target = fanout ? particle_buffer : particles;
+		const size_t n = target.size();
+		particle_weights.resize(n);
+		block_obs.resize(threads());
+		block_weights.resize(threads());
+
+		Sum r = reduce(n, [this, &observation, &target, fanout](size_t begin, size_t end, unsigned int t) {
+			Observations& obs_v = block_obs[t];
+			std::vector<WeightType>& weight_v = block_weights[t];
+			resize_like(obs_v, FusedBlockSize, observation);
+			weight_v.resize(FusedBlockSize);
+
+			Sum r = initial_weight(LogWeights());
+			for(size_t b = begin; b < end; b += FusedBlockSize) {
+				const size_t e = std::min(end, b + FusedBlockSize);
+				if(fanout)
+					gather(particles, ancestor_index, target, b, e);
+				else
+					PredictionPolicy<StateType>::predict(target, b, e);
+				NoisePolicy<StateType>::noise(target, b, e, t);
+				State2Obs<StateType, ObservationType>::observe(target, b, e, obs_v);
+				WeightPolicy<WeightType, ObservationType>::weight(obs_v, observation, weight_v, 0, e - b);
+
+				if(carry_weights)
+					for(size_t i = b; i < e; ++i)
+						weight_v[i - b] = combine_weight(weight_v[i - b], carried_weights[i], LogWeights());
+				for(size_t i = b; i < e; ++i) {
+					particle_weights[i] = weight_v[i - b];
+					r = accumulate_weight(r, weight_v[i - b], LogWeights());
+				}
+			}
+			return r;
+		}, [](Sum a, Sum b) { return accumulate_weight(a, b, LogWeights()); });
+
+		if(fanout) {
+			particles.swap(particle_buffer);
+			fanout_pending = false;
+		}
+		Instrumentation::end_stage(stage::Fused);
+
+		Instrumentation::begin_stage(stage::Normalize);
+		normalize(r, LogWeights());
+		Instrumentation::end_stage(stage::Normalize);
+		return true;
+	}
+
+	template<typename T = void>
+	bool apply_fused(const Observation&, Rank<0>) {
+		return false;
+	}
+
+	// Most stages prefer an interface working on the range [begin, end) of
+	// the particle set, which is used to split the work among the threads.
+	// Otherwise the policy is called once for the whole particle set, writing
+	// into the workspaces owned by the particle filter or returning newly
+	// allocated vectors (this allocates memory on every step).
+	template<typename T = void>
+	auto apply_predict(Rank<1>) -> decltype(self<T>().predict(std::declval<Particles&>(), size_t(), size_t())) {
+		for_each_range([this](size_t begin, size_t end, unsigned int) {
+			PredictionPolicy<StateType>::predict(particles, begin, end);
+		});
+	}
+
+	template<typename T = void>
+	void apply_predict(Rank<0>) {
+		PredictionPolicy<StateType>::predict(particles);
+	}
+
+	template<typename T = void>
+	auto apply_noise(Rank<1>) -> decltype(self<T>().noise(std::declval<Particles&>(), size_t(), size_t(), 0u)) {
+		if(fanout_pending) { // copy the ancestors and add the noise in one pass
+			resize_like(particle_buffer, ancestor_index.size(), particles);
+			parallel_for(pool.get(), ancestor_index.size(), [this](size_t begin, size_t end, unsigned int t) {
+				gather(particles, ancestor_index, particle_buffer, begin, end);
+				NoisePolicy<StateType>::noise(particle_buffer, begin, end, t);
+			});
+			particles.swap(particle_buffer);
+			fanout_pending = false;
+			return;
+		}
+
+		for_each_range([this](size_t begin, size_t end, unsigned int t) {
+			NoisePolicy<StateType>::noise(particles, begin, end, t);
+		});
+	}
+
+	template<typename T = void>
+	void apply_noise(Rank<0>) {
+		if(fanout_pending)
+			expand_ancestors();
+		NoisePolicy<StateType>::noise(particles);
+	}
+
+	// copies the pending unique ancestors by their multiplicity, the copies
+	// have uniform weights
+	void expand_ancestors() {
+		const size_t n = ancestor_index.size();
+		resize_like(particle_buffer, n, particles);
+		parallel_for(pool.get(), n, [this](size_t begin, size_t end, unsigned int) {
+			gather(particles, ancestor_index, particle_buffer, begin, end);
+		});
+		particles.swap(particle_buffer);
+		particle_weights.assign(n, WeightType(1.0 / n));
+		fanout_pending = false;
+	}
+
+	void map_observations(const Observation& observation) {
+		this->apply_state2obs(particles, observation, hyp_obs, pool.get());
+	}
+
+	void weigh_observations(const Observation& observation) {
+		this->apply_weight(hyp_obs, observation, particle_weights, pool.get());
+	}
+
+	// every sensor maps the particles to observations in its own workspace
+	template<size_t I = 0, typename... Readings>
+	typename std::enable_if<(I < sizeof...(Readings))>::type
+	map_observations(const SensorReadings<Readings...>& input) {
+		const auto& r = std::get<I>(input.readings);
+		if(r.observation)
+			r.sensor->map(particles, *r.observation, pool.get());
+		map_observations<I + 1>(input);
+	}
+
+	template<size_t I = 0, typename... Readings>
+	typename std::enable_if<(I == sizeof...(Readings))>::type
+	map_observations(const SensorReadings<Readings...>&) {}
+
+	// the weights are the neutral weight if no reading has an observation
+	template<typename... Readings>
+	void weigh_observations(const SensorReadings<Readings...>& input) {
+		particle_weights.resize(particles.size());
+		if(weigh_readings<0>(input, true))
+			return;
+		for_each_range([this](size_t begin, size_t end, unsigned int) {
+			std::fill(particle_weights.begin() + begin, particle_weights.begin() + end,
+				neutral_weight(LogWeights()));
+		});
+	}
+
+	// the first reading with an observation sets the weights, the others are
+	// accumulated; returns false if no reading has an observation
+	template<size_t I, typename... Readings>
+	typename std::enable_if<(I < sizeof...(Readings)), bool>::type
+	weigh_readings(const SensorReadings<Readings...>& input, bool first) {
+		typedef typename std::tuple_element<I, std::tuple<Readings...> >::type::SensorType Sensor;
+		typedef typename Sensor::LogWeights SensorLog;
+		static_assert(std::is_same<typename Sensor::Weight, WeightType>::value,
+			"the sensors must have the weight type of the particle filter");
+
+		const auto& r = std::get<I>(input.readings);
+		if(r.observation) {
+			r.sensor->weigh(*r.observation, pool.get());
+			const std::vector<WeightType>& l = r.sensor->weights();
+			for_each_range([this, &l, first](size_t begin, size_t end, unsigned int) {
+				for(size_t i = begin; i < end; ++i) {
+					const WeightType w = convert_likelihood(l[i], SensorLog(), LogWeights());
+					particle_weights[i] = first ? w : accumulate_likelihood(particle_weights[i], w, LogWeights());
+				}
+			});
+			first = false;
+		}
+		return weigh_readings<I + 1>(input, first);
+	}
+
+	template<size_t I, typename... Readings>
+	typename std::enable_if<(I == sizeof...(Readings)), bool>::type
+	weigh_readings(const SensorReadings<Readings...>&, bool first) {
+		return !first;
+	}
+
+	// converts the likelihood of a sensor to the domain of the weights
+	static WeightType convert_likelihood(WeightType l, std::false_type, std::false_type) {
+		return l;
+	}
+
+	static WeightType convert_likelihood(WeightType l, std::true_type, std::true_type) {
+		return l;
+	}
+
+	static WeightType convert_likelihood(WeightType l, std::false_type, std::true_type) {
+		return std::log(l);
+	}
+
+	static WeightType convert_likelihood(WeightType l, std::true_type, std::false_type) {
+		return std::exp(l);
+	}
+
+	static WeightType accumulate_likelihood(WeightType w, WeightType l, std::false_type) {
+		return w * l;
+	}
+
+	static WeightType accumulate_likelihood(WeightType w, WeightType l, std::true_type) {
+		return w + l;
+	}
+
+	// keeps the unique ancestors in place, ancestor_index then maps the slots
+	// of the next particle set to them
+	template<typename T = void>
+	auto apply_resampling(Rank<3>) -> decltype(self<T>()
+			.select_ancestors(std::declval<const Particles&>(), std::declval<const std::vector<WeightType>&>(),
+				std::declval<std::vector<Sum>&>(), std::declval<std::vector<size_t>&>(), (ThreadPool*) nullptr)) {
+		if(!ancestor_resampling && fixed_lag == 0)
+			return apply_resampling(Rank<2>());
+
+		ResamplingPolicy<StateType, WeightType>::select_ancestors(particles, particle_weights, cdf,
+			ancestor_index, pool.get());
+		if(fixed_lag > 0)
+			next_parents = ancestor_index;
+
+		if(!ancestor_resampling) { // copy the ancestors, as the resampling policy would
+			const size_t n = ancestor_index.size();
+			resize_like(particle_buffer, n, particles);
+			parallel_for(pool.get(), n, [this](size_t begin, size_t end, unsigned int) {
+				gather(particles, ancestor_index, particle_buffer, begin, end);
+			});
+			particles.swap(particle_buffer);
+			particle_weights.assign(n, WeightType(1) / n);
+			return;
+		}
+
+		const size_t n = particles.size();
+		multiplicity.assign(n, 0);
+		for(auto a : ancestor_index)
+			++multiplicity[a];
+
+		size_t k = 0;
+		for(size_t i = 0; i < n; ++i) {
+			if(multiplicity[i] > 0) {
+				particle_weights[k] = WeightType(multiplicity[i]) / ancestor_index.size();
+				relocate(particles, i, k);
+				multiplicity[i] = k++;
+			}
+		}
+		particles.resize(k);
+		particle_weights.resize(k);
+
+		for(auto& a : ancestor_index)
+			a = multiplicity[a];
+		fanout_pending = true;
+	}
+
+	template<typename T = void>
+	auto apply_resampling(Rank<2>) -> decltype(self<T>()
+			.resampling(std::declval<Particles&>(), std::declval<std::vector<WeightType>&>(),
+				std::declval<std::vector<Sum>&>(), std::declval<Particles&>(), (ThreadPool*) nullptr)) {
+		ResamplingPolicy<StateType, WeightType>::resampling(particles, particle_weights, cdf, particle_buffer, pool.get());
+	}
+
+	template<typename T = void>
+	auto apply_resampling(Rank<1>) -> decltype(self<T>()
+			.resampling(std::declval<Particles&>(), std::declval<std::vector<WeightType>&>(),
+				std::declval<std::vector<Sum>&>(), std::declval<Particles&>())) {
+		ResamplingPolicy<StateType, WeightType>::resampling(particles, particle_weights, cdf, particle_buffer);
+	}
+
+	template<typename T = void>
+	void apply_resampling(Rank<0>) {
 		ResamplingPolicy<StateType, WeightType>::resampling(particles, particle_weights);
+	}
 
-		// choose winner
+	// computed during the normalization
+	template<typename T = void>
+	auto apply_winner(Rank<2>) -> typename std::enable_if<
+			Dependent<T, WinnerBeforeResampling>::type::value, Winner>::type {
+		return before_winner;
+	}
+
+	// the partial winners of all ranges are combined in range order
+	template<typename T = void>
+	auto apply_winner(Rank<1>) -> decltype(self<T>()
+			.winner(std::declval<const Particles&>(), std::declval<const std::vector<WeightType>&>(), size_t(), size_t()),
+			self<T>().combine_winners(std::declval<PartialWinner&>(), std::declval<const PartialWinner&>()), Winner()) {
+		if(!pool)
+			return WinnerPolicy<StateType, WeightType>::winner(particles, particle_weights);
+
+		pool->parallel_for(particles.size(), [this](size_t begin, size_t end, unsigned int t) {
+			partial_winners[t] = WinnerPolicy<StateType, WeightType>::winner(particles, particle_weights, begin, end);
+		});
+		for(size_t t = 1; t < partial_winners.size(); ++t)
+			WinnerPolicy<StateType, WeightType>::combine_winners(partial_winners[0], partial_winners[t]);
+		return complete_winner(partial_winners[0], Rank<1>());
+	}
+
+	// rounds the combined partial results to the winner
+	template<typename T = void>
+	auto complete_winner(const PartialWinner& partial, Rank<1>)
+			-> decltype(self<T>().finish_winner(partial, std::declval<const Particles&>())) {
+		return WinnerPolicy<StateType, WeightType>::finish_winner(partial, particles);
+	}
+
+	template<typename T = void>
+	Winner complete_winner(const PartialWinner& partial, Rank<0>) {
+		return partial;
+	}
+
+	template<typename T = void>
+	Winner apply_winner(Rank<0>) {
 		return WinnerPolicy<StateType, WeightType>::winner(particles, particle_weights);
 	}
 
-	void reset() {
-		initialized = false;
+	template<typename T = void>
+	auto selects_ancestors(Rank<1>) -> decltype(self<T>()
+			.select_ancestors(std::declval<const Particles&>(), std::declval<const std::vector<WeightType>&>(),
+				std::declval<std::vector<Sum>&>(), std::declval<std::vector<size_t>&>(), (ThreadPool*) nullptr),
+			bool()) {
+		return true;
+	}
+
+	template<typename T = void>
+	bool selects_ancestors(Rank<0>) {
+		return false;
+	}
+
+	// stores the weighted particle set of this step in the ring buffer, with
+	// the indices of the ancestors of its particles in the previous step
+	void record_history() {
+		const size_t s = step_count % history.size();
+		history[s] = particles;
+		history_weights = particle_weights;
+		parents[s].swap(next_parents);
+		++step_count;
+	}
+
+	// saves and loads the state of the policies implementing save_state and load_state
+	template<typename Policy>
+	auto save_policy(snapshot::Writer& w, uint32_t section, Rank<1>) const
+			-> decltype(std::declval<const Policy&>().save_state(w)) {
+		w.begin_section(section);
+		static_cast<const Policy&>(*this).save_state(w);
+		w.end_section();
+	}
+
+	template<typename Policy>
+	void save_policy(snapshot::Writer&, uint32_t, Rank<0>) const {}
+
+	template<typename Policy>
+	auto load_policy(snapshot::Reader& r, uint32_t section, Rank<1>)
+			-> decltype(std::declval<Policy&>().load_state(r)) {
+		if(r.find_section(section))
+			static_cast<Policy&>(*this).load_state(r);
+	}
+
+	template<typename Policy>
+	void load_policy(snapshot::Reader&, uint32_t, Rank<0>) {}
+
+	// every thread needs its own random number stream
+	template<typename T = void>
+	auto apply_streams(Rank<1>) -> decltype(self<T>().setNoiseStreams(0u)) {
+		NoisePolicy<StateType>::setNoiseStreams(threads());
+	}
+
+	template<typename T = void>
+	void apply_streams(Rank<0>) {}
+
+	// calls f(begin, end, thread) for the ranges of the particle set
+	template<typename F>
+	void for_each_range(const F& f) {
+		parallel_for(pool.get(), particles.size(), f);
+	}
+
+	// applies f to the ranges of [0, n) and combines the results in range order
+	template<typename F, typename Op>
+	Sum reduce(size_t n, const F& f, const Op& op) {
+		if(!pool)
+			return f(0, n, 0);
+
+		pool->parallel_for(n, [this, &f](size_t begin, size_t end, unsigned int t) {
+			partial_sums[t] = f(begin, end, t);
+		});
+		Sum r = partial_sums[0];
+		for(size_t t = 1; t < partial_sums.size(); ++t)
+			r = op(r, partial_sums[t]);
+		return r;
+	}
+
+	double log_weight_sum(std::false_type) const {
+		return std::log(weight_sum);
+	}
+
+	double log_weight_sum(std::true_type) const {
+		return weight_sum;
+	}
+
+	// Normalization needs the sum of the probabilities or the maximum of the
+	// log-weights (for the log-sum-exp trick), accumulated from initial_weight
+	static Sum initial_weight(std::false_type) {
+		return 0;
+	}
+
+	static Sum initial_weight(std::true_type) {
+		return -std::numeric_limits<Sum>::infinity();
+	}
+
+	static Sum accumulate_weight(Sum r, Sum w, std::false_type) {
+		return r + w;
+	}
+
+	static Sum accumulate_weight(Sum r, Sum w, std::true_type) {
+		return std::max(r, w);
+	}
+
+	template<typename Log>
+	Sum reduce_weights(Log) {
+		return reduce(particle_weights.size(), [this](size_t begin, size_t end, unsigned int) {
+			Sum r = initial_weight(Log());
+			for(size_t i = begin; i < end; ++i)
+				r = accumulate_weight(r, particle_weights[i], Log());
+			return r;
+		}, [](Sum a, Sum b) { return accumulate_weight(a, b, Log()); });
+	}
+
+	// normalizes probabilities with the sum wsum
+	void normalize(Sum wsum, std::false_type) {
+		weight_sum = wsum;
+		if(wsum == 0) // if all weights are zero
+			uniform_weights();
+		else
+			scale_weights(wsum);
+	}
+
+	// normalizes log-weights with the maximum wmax using the log-sum-exp trick
+	void normalize(Sum max, std::true_type) {
+		const WeightType inf = std::numeric_limits<WeightType>::infinity();
+		const WeightType wmax = max; // the maximum of the weights, exactly representable
+		if(wmax == -inf) { // if all weights are zero
+			weight_sum = -inf;
+			uniform_weights();
+			return;
+		}
+
+		Sum wsum = reduce(particle_weights.size(), [this, wmax, inf](size_t begin, size_t end, unsigned int) {
+			Sum s = 0;
+			for(size_t i = begin; i < end; ++i) {
+				WeightType& w = particle_weights[i];
+				if(wmax == inf) // exact hits only
+					w = (w == wmax ? 1 : 0);
+				else
+					w = std::exp(w - wmax);
+				s += w;
+			}
+			return s;
+		}, std::plus<Sum>());
+
+		weight_sum = wmax + std::log(wsum);
+		scale_weights(wsum);
+	}
+
+	void uniform_weights() {
+		const size_t n = particle_weights.size();
+		for_each_range([this, n](size_t begin, size_t end, unsigned int) {
+			for(size_t i = begin; i < end; ++i)
+				particle_weights[i] = 1.0 / n;
+		});
+		ess = n;
+		zero_weights = true;
+		if(!first_stage)
+			evaluate_winner(WinnerBeforeResampling());
+	}
+
+	// divides the weights by wsum and computes the effective sample size
+	void scale_weights(Sum wsum) {
+		partial_winners.resize(threads());
+		Sum sq = reduce(particle_weights.size(), [this, wsum](size_t begin, size_t end, unsigned int t) {
+			Sum s = 0;
+			if(first_stage)
+				scale_range(wsum, begin, end, t, s, std::false_type());
+			else
+				scale_range(wsum, begin, end, t, s, WinnerBeforeResampling());
+			return s;
+		}, std::plus<Sum>());
+		ess = 1 / sq;
+		zero_weights = false;
+		if(!first_stage)
+			combine_partial_winners(WinnerBeforeResampling());
+	}
+
+	void scale_range(Sum wsum, size_t begin, size_t end, unsigned int, Sum& s, std::false_type) {
+		for(size_t i = begin; i < end; ++i) {
+			particle_weights[i] /= wsum;
+			s += Sum(particle_weights[i]) * particle_weights[i];
+		}
+	}
+
+	// evaluates the winner policy on every block right after its weights are scaled
+	void scale_range(Sum wsum, size_t begin, size_t end, unsigned int t, Sum& s, std::true_type) {
+		partial_winners[t] = WinnerPolicy<StateType, WeightType>::winner(particles, particle_weights, begin, begin);
+		for(size_t b = begin; b < end; b += FusedBlockSize) {
+			const size_t e = std::min(end, b + FusedBlockSize);
+			scale_range(wsum, b, e, t, s, std::false_type());
+			WinnerPolicy<StateType, WeightType>::combine_winners(partial_winners[t],
+				WinnerPolicy<StateType, WeightType>::winner(particles, particle_weights, b, e));
+		}
+	}
+
+	// evaluates winner policies deriving from BeforeResampling on the weighted particle set
+	void evaluate_winner(std::false_type) {}
+
+	void evaluate_winner(std::true_type) {
+		partial_winners.resize(threads());
+		for_each_range([this](size_t begin, size_t end, unsigned int t) {
+			partial_winners[t] = WinnerPolicy<StateType, WeightType>::winner(particles, particle_weights, begin, end);
+		});
+		combine_partial_winners(std::true_type());
+	}
+
+	// combines the partial winners in range order into before_winner
+	void combine_partial_winners(std::false_type) {}
+
+	void combine_partial_winners(std::true_type) {
+		for(size_t t = 1; t < partial_winners.size(); ++t)
+			WinnerPolicy<StateType, WeightType>::combine_winners(partial_winners[0], partial_winners[t]);
+		before_winner = WinnerPolicy<StateType, WeightType>::finish_winner(partial_winners[0], particles);
+	}
+
+	// multiplies the new likelihoods with the weights carried forward
+	static WeightType combine_weight(WeightType w, WeightType carried, std::false_type) {
+		return w * carried;
+	}
+
+	static WeightType combine_weight(WeightType w, WeightType carried, std::true_type) {
+		return w + std::log(carried);
+	}
+
+	template<typename Log>
+	void combine_weights(Log) {
+		for_each_range([this](size_t begin, size_t end, unsigned int) {
+			for(size_t i = begin; i < end; ++i)
+				particle_weights[i] = combine_weight(particle_weights[i], carried_weights[i], Log());
+		});
 	}
 
-private:
 	unsigned int num_particles;
 	bool initialized;
-	std::vector<StateType> particles;
+	Particles particles;
+
+	// workspaces reused by every call to run
+	Observations hyp_obs;
+	std::vector<WeightType> particle_weights;
+	std::vector<Sum> cdf;
+	Particles particle_buffer;
+
+	// adaptive resampling
+	double resampling_threshold, ess;
+
+	// sum (or log-sum) of the weights before normalization and the log of
+	// their mean, zero_weights is set if all weights were zero and the
+	// weights were set to 1/N
+	double weight_sum, log_likelihood;
+	bool zero_weights;
+
+	bool carry_weights;
+	std::vector<WeightType> carried_weights;
+
+	// resampling to the unique ancestors
+	bool ancestor_resampling, fanout_pending;
+	std::vector<size_t> ancestor_index, multiplicity;
+
+	// fused execution and the blocks of observations and weights of every thread
+	bool fused;
+	std::vector<Observations> block_obs;
+	std::vector<std::vector<WeightType> > block_weights;
+
+	// fixed-lag smoothing: ring buffers of the particle sets and of the
+	// ancestor indices of their particles (empty if identical), the weights
+	// of the last step and the ancestor indices of the next step
+	unsigned int fixed_lag;
+	size_t step_count;
+	std::vector<Particles> history;
+	std::vector<std::vector<size_t> > parents;
+	std::vector<WeightType> history_weights;
+	std::vector<size_t> next_parents, lineage;
+	Particles smooth_buffer;
+
+	// auxiliary particle filter: look-ahead likelihoods of the particles and
+	// of the ancestors of the resampled particles
+	bool auxiliary, first_stage;
+	double lookahead_exponent;
+	std::vector<WeightType> lookahead, ancestor_lookahead;
+
+	// worker threads and their partial results, no threads are used if pool is empty
+	std::unique_ptr<ThreadPool> pool;
+	std::vector<Sum> partial_sums;
+	std::vector<PartialWinner> partial_winners;
+	Winner before_winner;
 };
 
 }
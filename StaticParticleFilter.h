@@ -0,0 +1,396 @@
+#ifndef STATIC_PARTICLE_FILTER_H_
+#define STATIC_PARTICLE_FILTER_H_
+
+#include <array>
+#include <type_traits>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstddef>
+
+#ifndef GCC_VERSION
+#define GCC_VERSION (__GNUC__ * 10000 \
+					+ __GNUC_MINOR__ * 100 \
+					+ __GNUC_PATCHLEVEL__)
+#endif
+
+#include "storage.h"
+#include "rng.h"
+#include "simd.h"
+#include "weight.h"
+#include "init.h"
+
+namespace policy_pf {
+namespace static_policies {
+
+// The policies of StaticParticleFilter work on the whole particle set,
+// stored in std::array<T, N>. N is a template parameter of their methods,
+// so every loop has a trip count known at compile time. The policies must
+// neither allocate memory nor throw. States and observations are scalars or
+// std::array of scalars; the scalars of a particle set are contiguous.
+
+// number and type of the scalars of a state
+template<typename State, typename Enable = void>
+struct Elements;
+
+template<typename State>
+struct Elements<State, typename std::enable_if<std::is_arithmetic<State>::value >::type> {
+	typedef State Scalar;
+	static const size_t dimensions = 1;
+	static Scalar& at(State& s, size_t) { return s; }
+	static const Scalar& at(const State& s, size_t) { return s; }
+};
+
+template<typename T, size_t D>
+struct Elements<std::array<T, D> > {
+	typedef T Scalar;
+	static const size_t dimensions = D;
+	static Scalar& at(std::array<T, D>& s, size_t j) { return s[j]; }
+	static const Scalar& at(const std::array<T, D>& s, size_t j) { return s[j]; }
+};
+
+template<typename State, size_t N>
+typename Elements<State>::Scalar* scalars(std::array<State, N>& state_v) {
+	return reinterpret_cast<typename Elements<State>::Scalar*>(state_v.data());
+}
+
+template<typename State, size_t N>
+const typename Elements<State>::Scalar* scalars(const std::array<State, N>& state_v) {
+	return reinterpret_cast<const typename Elements<State>::Scalar*>(state_v.data());
+}
+
+template<typename State>
+class None {
+protected:
+	template<size_t N>
+	void predict(std::array<State, N>&) noexcept {}
+};
+
+template<typename State, typename Observation>
+class Identity {
+protected:
+	template<size_t N>
+	void state2obs(const std::array<State, N>& state_v, std::array<Observation, N>& obs_v) noexcept {
+		obs_v = state_v;
+	}
+};
+
+// the dimensions are treated as independent, so the densities are multiplied
+template<typename Weight, typename Observation>
+class NormPdf : public weight_policies::NormPdfBase {
+protected:
+	typedef Elements<Observation> E;
+
+	template<size_t N>
+	void weight(const std::array<Observation, N>& obs_v, const Observation& obs, std::array<Weight, N>& weight_v) noexcept {
+		squared_distances(obs_v, obs, weight_v);
+		simd::scaled_exp(weight_v.data(), N, Weight(exponent()),
+			Weight(std::pow(norm(), (double) E::dimensions)), weight_v.data());
+	}
+
+	// sum of the squared distances (x-obs-mu)^2 over all dimensions, the
+	// compiler vectorizes the loop over the particles
+	template<size_t N>
+	void squared_distances(const std::array<Observation, N>& obs_v, const Observation& obs, std::array<Weight, N>& d) noexcept {
+		typedef typename E::Scalar T;
+		T o[E::dimensions];
+		for(size_t j = 0; j < E::dimensions; ++j)
+			o[j] = T(E::at(obs, j) + mu);
+		const T* x = scalars(obs_v);
+		for(size_t i = 0; i < N; ++i) {
+			Weight s = 0;
+			for(size_t j = 0; j < E::dimensions; ++j) {
+				const T dj = x[i*E::dimensions + j] - o[j];
+				s += dj*dj;
+			}
+			d[i] = s;
+		}
+	}
+};
+
+// logarithm of NormPdf
+template<typename Weight, typename Observation>
+class LogNormPdf : public NormPdf<Weight, Observation>, public weight_policies::LogLikelihood {
+protected:
+	template<size_t N>
+	void weight(const std::array<Observation, N>& obs_v, const Observation& obs, std::array<Weight, N>& weight_v) noexcept {
+		const Weight n = Elements<Observation>::dimensions * std::log(this->norm()), e = this->exponent();
+		this->squared_distances(obs_v, obs, weight_v);
+		for(size_t i = 0; i < N; ++i)
+			weight_v[i] = n + e * weight_v[i];
+	}
+};
+
+// the weighted sums are accumulated in the type selected by Accumulator
+template<typename State, typename Weight>
+class WeightedArithmeticMean {
+protected:
+	template<size_t N>
+	State winner(const std::array<State, N>& state_v, const std::array<Weight, N>& weight_v) noexcept {
+		typedef Elements<State> E;
+		typedef typename Accumulator<typename E::Scalar>::type Sum;
+		Sum sum[E::dimensions] = {};
+		for(size_t i = 0; i < N; ++i)
+			for(size_t j = 0; j < E::dimensions; ++j)
+				sum[j] += Sum(E::at(state_v[i], j)) * weight_v[i];
+		State win;
+		for(size_t j = 0; j < E::dimensions; ++j)
+			E::at(win, j) = sum[j];
+		return win;
+	}
+};
+
+// adds gaussian noise to the initial states, which are zero
+template<typename State>
+class Gaussian : public init_policies::AutoDetectT<State> {
+protected:
+	template<size_t N>
+	void init(std::array<State, N>& state_v) noexcept {
+		for(auto& s : state_v) {
+			s = State();
+			this->apply_init(s);
+		}
+	}
+};
+
+// gaussian noise from a single random number stream, generated in blocks
+template<typename State, typename RNG = rng::Default>
+class GaussianNoise_ {
+public:
+	typedef typename Elements<State>::Scalar Scalar;
+
+	GaussianNoise_() : sigma(1) {}
+
+	void setNoiseSigma(Scalar sigma) {
+		this->sigma = sigma;
+	}
+
+	void setNoiseSeed(unsigned int seed) {
+		generator.seed(seed);
+	}
+
+protected:
+	template<size_t N>
+	void noise(std::array<State, N>& state_v) noexcept {
+		const size_t n = N * Elements<State>::dimensions;
+		Scalar* x = scalars(state_v);
+		Scalar z[256];
+		for(size_t i = 0; i < n; i += 256) {
+			const size_t m = std::min<size_t>(256, n - i);
+			generator.normal(z, m);
+			for(size_t j = 0; j < m; ++j)
+				x[i+j] += sigma * z[j];
+		}
+	}
+
+private:
+	RNG generator;
+	Scalar sigma;
+};
+
+// Systematic resampling, writes the selected particles to new_state_v; edges
+// is the workspace for the cumulative sum of the weights
+template<typename State, typename Weight, typename RNG = rng::Default>
+class SystematicResampling_ {
+public:
+	void setResamplingSeed(unsigned int seed) {
+		generator.seed(seed);
+	}
+
+protected:
+	typedef typename Accumulator<Weight>::type Sum;
+
+	template<size_t N>
+	void resampling(const std::array<State, N>& state_v, std::array<Weight, N>& weight_v,
+			std::array<Sum, N+1>& edges, std::array<State, N>& new_state_v) noexcept {
+		edges[0] = 0;
+		Sum sum = 0;
+		for(size_t i = 0; i < N; ++i)
+			edges[i+1] = std::min(sum += weight_v[i], Sum(1));
+		edges[N] = 1;
+
+		Sum u0 = generator.template uniform<Sum>();
+		size_t i = 1;
+		for(size_t k = 0; k < N; ++k) {
+			Sum u1 = (u0 + k) / N;
+			while(i < N && !(u1 < edges[i]))
+				++i;
+			new_state_v[k] = state_v[i-1];
+		}
+		weight_v.fill(Weight(1) / N);
+	}
+
+private:
+	RNG generator;
+};
+
+#if GCC_VERSION >= 40700
+// Workaround for g++ 4.7
+template<typename State>
+using GaussianNoise = GaussianNoise_<State>;
+
+template<typename State, typename Weight>
+using SystematicResampling = SystematicResampling_<State, Weight>;
+#else
+// Workaround for g++ 4.6
+template<typename State>
+class GaussianNoise : public GaussianNoise_<State> {};
+
+template<typename State, typename Weight>
+class SystematicResampling : public SystematicResampling_<State, Weight> {};
+#endif
+
+}
+
+// StaticParticleFilter is a particle filter for a number of particles N
+// known at compile time. The particles, observations, weights and the
+// cumulative sum of the weights are std::arrays inside the object, so it
+// never allocates memory and run is noexcept. A filter of many particles
+// should be a static or heap object rather than a local variable.
+//
+// It uses the policies of static_policies with the same roles as those of
+// ParticleFilter; a step predicts, adds noise, weights, normalizes the
+// weights, resamples and chooses the winner. The results are the same as
+// those of ParticleFilter on one thread with the corresponding policies.
+template <size_t N, typename StateType, typename ObservationType, typename WeightType,
+	template<class> class PredictionPolicy = static_policies::None,
+	template<class, class> class State2Obs = static_policies::Identity,
+	template<class, class> class WeightPolicy = static_policies::NormPdf,
+	template<class, class> class WinnerPolicy = static_policies::WeightedArithmeticMean,
+	template<class> class InitPolicy = static_policies::Gaussian,
+	template<class> class NoisePolicy = static_policies::GaussianNoise,
+	template<class, class> class ResamplingPolicy = static_policies::SystematicResampling>
+class StaticParticleFilter :
+	public PredictionPolicy<StateType>,
+	public WeightPolicy<WeightType, ObservationType>,
+	public ResamplingPolicy<StateType, WeightType>,
+	public NoisePolicy<StateType>,
+	public InitPolicy<StateType>,
+	public WinnerPolicy<StateType, WeightType>,
+	public State2Obs<StateType, ObservationType>
+{
+	static_assert(N > 0, "StaticParticleFilter needs at least one particle");
+	static_assert(std::is_floating_point<WeightType>::value, "the weights must be floating point numbers");
+
+	typedef typename Accumulator<WeightType>::type Sum;
+	typedef std::integral_constant<bool,
+		weight_policies::isLogLikelihood<WeightPolicy<WeightType, ObservationType> >::value> LogWeights;
+
+	// exposes the protected winner method to determine its result type
+	struct WinnerAccess : WinnerPolicy<StateType, WeightType> {
+		using WinnerPolicy<StateType, WeightType>::winner;
+	};
+
+public:
+	typedef std::array<StateType, N> Particles;
+	typedef std::array<ObservationType, N> Observations;
+	typedef std::array<WeightType, N> Weights;
+	typedef ObservationType Observation;
+
+	// type returned by run
+	typedef decltype(std::declval<WinnerAccess&>().winner(std::declval<const Particles&>(),
+		std::declval<const Weights&>())) Winner;
+
+	StaticParticleFilter() : current(0), initialized(false), ess(0), weight_sum(0) {}
+
+	static constexpr size_t particleCount() {
+		return N;
+	}
+
+	Winner run(const Observation& observation) noexcept {
+		if(!initialized) {
+			InitPolicy<StateType>::init(particles[current]);
+			initialized = true;
+		}
+		Particles& p = particles[current];
+
+		PredictionPolicy<StateType>::predict(p);
+		NoisePolicy<StateType>::noise(p);
+		State2Obs<StateType, ObservationType>::state2obs(p, hyp_obs);
+		WeightPolicy<WeightType, ObservationType>::weight(hyp_obs, observation, weights);
+		normalize(LogWeights());
+
+		ResamplingPolicy<StateType, WeightType>::resampling(p, weights, cdf, particles[1 - current]);
+		current = 1 - current;
+		return WinnerPolicy<StateType, WeightType>::winner(particles[current], weights);
+	}
+
+	const Particles& getParticles() const {
+		return particles[current];
+	}
+
+	// effective sample size of the normalized weights of the last step,
+	// before resampling
+	double effectiveSampleSize() const {
+		return ess;
+	}
+
+	// sum of the weights of the last step before normalization, for
+	// log-likelihood weight policies its logarithm
+	double weightSum() const {
+		return weight_sum;
+	}
+
+private:
+	void normalize(std::false_type) noexcept {
+		Sum wsum = 0;
+		for(size_t i = 0; i < N; ++i)
+			wsum += weights[i];
+		weight_sum = wsum;
+		scale(wsum);
+	}
+
+	// log-sum-exp trick
+	void normalize(std::true_type) noexcept {
+		const WeightType inf = std::numeric_limits<WeightType>::infinity();
+		WeightType wmax = -inf;
+		for(size_t i = 0; i < N; ++i)
+			wmax = std::max(wmax, weights[i]);
+		if(wmax == -inf) {
+			weight_sum = -inf;
+			scale(0);
+			return;
+		}
+
+		Sum wsum = 0;
+		for(size_t i = 0; i < N; ++i) {
+			WeightType& w = weights[i];
+			if(wmax == inf) // exact hits only
+				w = (w == wmax ? 1 : 0);
+			else
+				w = std::exp(w - wmax);
+			wsum += w;
+		}
+		weight_sum = wmax + std::log(wsum);
+		scale(wsum);
+	}
+
+	// divides the weights by wsum, uniform weights if all weights are zero
+	void scale(Sum wsum) noexcept {
+		if(wsum == 0) {
+			weights.fill(WeightType(1) / N);
+			ess = N;
+			return;
+		}
+		Sum sq = 0;
+		for(size_t i = 0; i < N; ++i) {
+			weights[i] /= wsum;
+			sq += Sum(weights[i]) * weights[i];
+		}
+		ess = 1 / sq;
+	}
+
+	// the particle set and the buffer the resampling policy writes to
+	Particles particles[2];
+	unsigned int current;
+	bool initialized;
+
+	Observations hyp_obs;
+	Weights weights;
+	std::array<Sum, N+1> cdf;
+	double ess, weight_sum;
+};
+
+}
+
+#endif
@@ -0,0 +1,459 @@
+#ifndef _POLPF_ASYNC_FILTER_H_
+#define _POLPF_ASYNC_FILTER_H_
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+namespace policy_pf {
+
+// Bounded queue for any number of producers and consumers (Vyukov). Every
+// cell carries a sequence number telling whether it is free for the push of
+// a given position or holds the value for the pop of that position, so push
+// and pop only compete for their position counter. They never block and
+// never allocate; push fails if the queue is full, pop if it is empty.
+template<typename T>
+class BoundedQueue {
+public:
+	// the capacity is rounded up to a power of two
+	explicit BoundedQueue(size_t capacity) : push_pos(0), pop_pos(0) {
+		size_t n = 1;
+		while(n < capacity)
+			n *= 2;
+		cells.reset(new Cell[n]);
+		mask = n - 1;
+		for(size_t i = 0; i < n; ++i)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	bool push(const T& x) {
+		size_t pos = push_pos.load(std::memory_order_relaxed);
+		for(;;) {
+			Cell& c = cells[pos & mask];
+			const size_t seq = c.sequence.load(std::memory_order_acquire);
+			if(seq == pos) {
+				if(push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					c.value = x;
+					c.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			} else if(seq < pos) { // the cell still holds the value of the last round
+				return false;
+			} else {
+				pos = push_pos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool pop(T& x) {
+		size_t pos = pop_pos.load(std::memory_order_relaxed);
+		for(;;) {
+			Cell& c = cells[pos & mask];
+			const size_t seq = c.sequence.load(std::memory_order_acquire);
+			if(seq == pos + 1) {
+				if(pop_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					x = c.value;
+					c.sequence.store(pos + mask + 1, std::memory_order_release);
+					return true;
+				}
+			} else if(seq < pos + 1) {
+				return false;
+			} else {
+				pos = pop_pos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool empty() const {
+		const size_t pos = pop_pos.load(std::memory_order_relaxed);
+		return cells[pos & mask].sequence.load(std::memory_order_acquire) != pos + 1;
+	}
+
+	// number of values in the queue, only exact if no push or pop is running
+	size_t size() const {
+		const size_t pushed = push_pos.load(std::memory_order_relaxed);
+		const size_t popped = pop_pos.load(std::memory_order_relaxed);
+		return pushed > popped ? pushed - popped : 0;
+	}
+
+	size_t capacity() const {
+		return mask + 1;
+	}
+
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	std::unique_ptr<Cell[]> cells;
+	size_t mask;
+
+	// the counters are padded to separate cache lines
+	char padding0[64];
+	std::atomic<size_t> push_pos;
+	char padding1[64];
+	std::atomic<size_t> pop_pos;
+	char padding2[64];
+};
+
+// Holds the last value published by one writer for any number of readers.
+// Plain old data is published with a sequence lock on two slots: the writer
+// fills the slot the readers are not directed to and then redirects them,
+// so a reader only retries if the writer has published twice while it was
+// copying. Readers never take a lock and never delay the writer.
+template<typename T, bool Pod = std::is_pod<T>::value>
+class Published {
+public:
+	Published() : latest(0) {
+		for(auto& s : slots) {
+			s.sequence.store(0, std::memory_order_relaxed);
+			for(auto& w : s.words)
+				w.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	void publish(const T& x) {
+		uint64_t words[Words] = {0};
+		std::memcpy(words, &x, sizeof(x));
+
+		const uint64_t n = latest.load(std::memory_order_relaxed) + 1;
+		Slot& s = slots[n & 1];
+		const uint64_t seq = s.sequence.load(std::memory_order_relaxed);
+		s.sequence.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for(size_t i = 0; i < Words; ++i)
+			s.words[i].store(words[i], std::memory_order_relaxed);
+		s.sequence.store(seq + 2, std::memory_order_release);
+		latest.store(n, std::memory_order_release);
+	}
+
+	// copies the last value into x and returns the number of values
+	// published so far (0 if none, x is then not changed)
+	uint64_t load(T& x) const {
+		uint64_t words[Words];
+		for(;;) {
+			const uint64_t n = latest.load(std::memory_order_acquire);
+			if(n == 0)
+				return 0;
+			const Slot& s = slots[n & 1];
+			const uint64_t before = s.sequence.load(std::memory_order_acquire);
+			for(size_t i = 0; i < Words; ++i)
+				words[i] = s.words[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			// the slot is written for every second value, it still holds
+			// value n if its sequence is n + (n & 1)
+			if(before == n + (n & 1) && s.sequence.load(std::memory_order_relaxed) == before) {
+				std::memcpy(&x, words, sizeof(x));
+				return n;
+			}
+		}
+	}
+
+private:
+	static const size_t Words = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	// padded, so the writer does not touch the cache line of the other slot
+	struct Slot {
+		std::atomic<uint64_t> sequence;
+		std::atomic<uint64_t> words[Words];
+		char padding[64];
+	};
+
+	Slot slots[2];
+	std::atomic<uint64_t> latest;
+};
+
+// Values which are not plain old data (e.g. std::vector winners) cannot be
+// copied while they are written, so the writer fills a slot of a small ring
+// no reader is copying from and then redirects the readers to it. A reader
+// enters the current slot with a single fetch_add on the word holding the
+// slot index and the number of readers which entered it, copies the value
+// and leaves by counting itself in the slot, so readers are wait-free. The
+// writer learns how many readers entered a slot when it redirects them and
+// reuses the slot once as many have left; it only waits if readers are still
+// copying from every other slot.
+template<typename T>
+class Published<T, false> {
+public:
+	Published() : state(uint64_t(Slots) << IndexShift), count(0), next(0) {
+		for(auto& s : slots) {
+			s.left.store(0, std::memory_order_relaxed);
+			s.entered = 0;
+			s.count = 0;
+		}
+	}
+
+	void publish(const T& x) {
+		const size_t current = state.load(std::memory_order_relaxed) >> IndexShift;
+		size_t j = next;
+		for(size_t tries = 1; j == current || slots[j].left.load(std::memory_order_acquire) != slots[j].entered;
+				++tries) {
+			j = (j + 1) % Slots;
+			if(tries % Slots == 0)
+				std::this_thread::yield();
+		}
+		next = (j + 1) % Slots;
+
+		Slot& s = slots[j];
+		s.value = x;
+		s.count = ++count;
+		s.left.store(0, std::memory_order_relaxed);
+		s.entered = 0;
+		const uint64_t old = state.exchange(uint64_t(j) << IndexShift, std::memory_order_acq_rel);
+		if((old >> IndexShift) < Slots)
+			slots[old >> IndexShift].entered = old & ReaderMask;
+	}
+
+	uint64_t load(T& x) const {
+		const uint64_t entered = state.fetch_add(1, std::memory_order_acquire);
+		if((entered >> IndexShift) >= Slots)
+			return 0;
+		const Slot& s = slots[entered >> IndexShift];
+		try {
+			x = s.value;
+		} catch(...) {
+			s.left.fetch_add(1, std::memory_order_release);
+			throw;
+		}
+		const uint64_t n = s.count;
+		s.left.fetch_add(1, std::memory_order_release);
+		return n;
+	}
+
+private:
+	// the upper byte of state is the index of the current slot (Slots if
+	// none), the lower bytes count the readers which entered it
+	static const size_t Slots = 4;
+	static const unsigned int IndexShift = 56;
+	static const uint64_t ReaderMask = (uint64_t(1) << IndexShift) - 1;
+
+	// padded, so the readers leaving a slot do not touch the cache line of
+	// the other slots
+	struct Slot {
+		mutable std::atomic<uint64_t> left;
+		uint64_t entered; // only used by the writer
+		uint64_t count;
+		T value;
+		char padding[64];
+	};
+
+	Slot slots[Slots];
+	mutable std::atomic<uint64_t> state;
+	uint64_t count, next; // only used by the writer
+};
+
+// AsyncFilter runs a particle filter on its own thread. Sensor threads push
+// timestamped observations into a bounded queue and return at once, the
+// filter thread runs a step for every observation and publishes the winner
+// with the timestamp of its observation. Any number of threads read the
+// latest estimate without waiting for the filter.
+//
+// If coalescing is enabled and the filter thread falls behind, it skips all
+// queued observations but the newest one, so the estimate follows the
+// sensors with the delay of a single step instead of a growing backlog.
+template<typename Filter>
+class AsyncFilter {
+public:
+	typedef typename Filter::Observation Observation;
+	typedef typename Filter::Winner Winner;
+	typedef std::chrono::steady_clock Clock;
+
+	struct Estimate {
+		Winner winner;
+		Clock::time_point time; // timestamp of the last observation of the step, the epoch if none
+		uint64_t steps;         // number of steps run, 0 if there is no estimate yet
+		uint64_t observations;  // number of observations taken from the queue, including skipped ones
+	};
+
+	// constructs the filter with the given arguments; it is configured through
+	// filter() before start is called
+	template<typename... Args>
+	AsyncFilter(size_t queue_capacity, Args&&... args) : queue(queue_capacity),
+			pf(std::forward<Args>(args)...), coalescing(false), running(false), stopping(false),
+			waiting(false), steps(0), taken(0), skipped_count(0), dropped_count(0) {}
+
+	~AsyncFilter() {
+		halt();
+	}
+
+	AsyncFilter(const AsyncFilter&) = delete;
+	AsyncFilter& operator=(const AsyncFilter&) = delete;
+
+	// the filter may only be used while the filter thread is stopped
+	Filter& filter() {
+		return pf;
+	}
+
+	void setCoalescing(bool enable) {
+		coalescing = enable;
+	}
+
+	void start() {
+		if(running)
+			return;
+		error = nullptr;
+		stopping = false;
+		running = true;
+		worker = std::thread(&AsyncFilter::work, this);
+	}
+
+	// Stops the filter thread after its current step. Observations still in
+	// the queue are processed after the next start. Rethrows an exception
+	// thrown by the filter, which has stopped the filter thread.
+	void stop() {
+		halt();
+		if(error) {
+			std::exception_ptr e = error;
+			error = nullptr;
+			std::rethrow_exception(e);
+		}
+	}
+
+	// Called by the sensor threads, returns false if the queue is full and the
+	// observation has been dropped. Does not block while the filter thread is
+	// busy; if it is idle, a mutex is taken to wake it up.
+	bool push(const Observation& observation, Clock::time_point time = Clock::now()) {
+		Measurement m = {observation, time};
+		if(!queue.push(m)) {
+			dropped_count.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(waiting.load(std::memory_order_relaxed)) {
+			std::lock_guard<std::mutex> lock(mutex);
+			wake.notify_one();
+		}
+		return true;
+	}
+
+	// latest estimate, steps is 0 if the filter has not run yet
+	Estimate estimate() const {
+		Record r;
+		Estimate e = Estimate();
+		e.steps = published.load(r) > 0 ? r.steps : 0;
+		if(e.steps > 0) {
+			e.winner = r.winner;
+			e.time = Clock::time_point(Clock::duration(r.time));
+			e.observations = r.observations;
+		}
+		return e;
+	}
+
+	// number of observations waiting in the queue
+	size_t pending() const {
+		return queue.size();
+	}
+
+	// observations skipped by coalescing
+	uint64_t skipped() const {
+		return skipped_count.load(std::memory_order_relaxed);
+	}
+
+	// observations dropped because the queue was full
+	uint64_t dropped() const {
+		return dropped_count.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Measurement {
+		Observation observation;
+		Clock::time_point time;
+	};
+
+	// published as plain old data if the winner is
+	struct Record {
+		Winner winner;
+		Clock::rep time;
+		uint64_t steps, observations;
+	};
+
+	void halt() {
+		if(!running)
+			return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_one();
+		worker.join();
+		running = false;
+	}
+
+	void work() {
+		Measurement m;
+		Record r;
+		try {
+			while(next(m)) {
+				uint64_t n = 1;
+				if(coalescing)
+					while(queue.pop(m))
+						++n;
+				skipped_count.fetch_add(n - 1, std::memory_order_relaxed);
+				taken += n;
+
+				r.winner = pf.run(m.observation);
+				r.time = m.time.time_since_epoch().count();
+				r.steps = ++steps;
+				r.observations = taken;
+				published.publish(r);
+			}
+		} catch(...) {
+			error = std::current_exception();
+		}
+	}
+
+	// waits for the next observation, returns false if the thread is stopped
+	bool next(Measurement& m) {
+		for(;;) {
+			if(stopping.load(std::memory_order_relaxed))
+				return false;
+			if(queue.pop(m))
+				return true;
+
+			// the fence orders setting waiting before checking the queue, so
+			// either push sees waiting or this thread sees the observation
+			std::unique_lock<std::mutex> lock(mutex);
+			waiting.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			while(!stopping.load(std::memory_order_relaxed) && queue.empty())
+				wake.wait(lock);
+			waiting.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	BoundedQueue<Measurement> queue;
+	Published<Record> published;
+	Filter pf;
+	bool coalescing, running;
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::atomic<bool> stopping, waiting;
+	std::exception_ptr error;
+
+	// only used by the filter thread
+	uint64_t steps, taken;
+
+	std::atomic<uint64_t> skipped_count, dropped_count;
+};
+
+}
+
+#endif
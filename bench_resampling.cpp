@@ -0,0 +1,83 @@
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <cstdlib>
+#include "ParticleFilter.h"
+
+// Benchmark of the resampling policies for different numbers of particles
+// and threads; usage: bench_resampling [max threads]
+
+using namespace policy_pf;
+using namespace policy_pf::resampling_policies;
+
+// makes the protected resampling method accessible
+template<template<class, class> class Policy>
+struct Bench : public Policy<double, double> {
+	using Policy<double, double>::resampling;
+};
+
+template<typename B>
+auto call(B& policy, std::vector<double>& s, std::vector<double>& w, std::vector<double>& e,
+		std::vector<double>& b, ThreadPool* pool, int) -> decltype(policy.resampling(s, w, e, b, pool)) {
+	policy.resampling(s, w, e, b, pool);
+}
+
+// the serial policy does not take a thread pool
+template<typename B>
+void call(B& policy, std::vector<double>& s, std::vector<double>& w, std::vector<double>& e,
+		std::vector<double>& b, ThreadPool*, long) {
+	policy.resampling(s, w, e, b);
+}
+
+// returns the mean time per resampling step in microseconds
+template<template<class, class> class Policy>
+double measure(size_t n, ThreadPool* pool) {
+	std::default_random_engine gen(1);
+	std::normal_distribution<double> dist(0, 1);
+	std::vector<double> state(n), weights(n), edges, buffer;
+	Bench<Policy> policy;
+
+	const int steps = std::max<int>(3, 20000000 / n);
+	double elapsed = 0;
+	for(int k = 0; k < steps; ++k) {
+		// gaussian likelihood of the particles, not timed
+		double sum = 0;
+		for(size_t i = 0; i < n; ++i) {
+			state[i] = dist(gen);
+			weights[i] = std::exp(-state[i]*state[i]);
+			sum += weights[i];
+		}
+		for(auto& w : weights)
+			w /= sum;
+
+		auto start = std::chrono::steady_clock::now();
+		call(policy, state, weights, edges, buffer, pool, 0);
+		elapsed += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	}
+	return elapsed / steps;
+}
+
+int main(int argc, char *argv[]) {
+	unsigned int max_threads = argc > 1 ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+
+	std::cout << std::setw(10) << "particles" << std::setw(9) << "threads"
+		<< std::setw(13) << "systematic" << std::setw(13) << "prefix-sum"
+		<< std::setw(13) << "stratified" << std::setw(13) << "metropolis"
+		<< std::setw(13) << "rejection" << "   [us per step]" << std::endl;
+
+	for(size_t n = 1000; n <= 10000000; n *= 10) {
+		for(unsigned int t = 1; t <= std::max(max_threads, 1u); t *= 2) {
+			std::unique_ptr<ThreadPool> pool(t > 1 ? new ThreadPool(t) : nullptr);
+			std::cout << std::setw(10) << n << std::setw(9) << t << std::fixed << std::setprecision(1)
+				<< std::setw(13) << measure<SystematicResampling>(n, pool.get())
+				<< std::setw(13) << measure<ParallelSystematicResampling>(n, pool.get())
+				<< std::setw(13) << measure<StratifiedResampling>(n, pool.get())
+				<< std::setw(13) << measure<MetropolisResampling>(n, pool.get())
+				<< std::setw(13) << measure<RejectionResampling>(n, pool.get()) << std::endl;
+		}
+	}
+	return 0;
+}
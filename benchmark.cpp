@@ -0,0 +1,323 @@
+#include <vector>
+#include <array>
+#include <string>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "ParticleFilter.h"
+
+// Microbenchmarks of the policies and of ParticleFilter::run for scalar, C
+// array, std::vector and std::array states of float and double.
+// usage: benchmark [--json] [--max-particles N]
+//
+// For every policy the time per particle, the number of memory allocations
+// per step and the bandwidth of the memory traffic the policy cannot avoid
+// (reading its input and writing its output once) are reported, as CSV or as
+// JSON. run_fused is run with the fused execution of the particle filter.
+// C array states cannot be copied, so resampling and run are skipped for them.
+
+using namespace policy_pf;
+
+// counts all allocations of the program; the operators are not inlined, so
+// the compiler does not pair the calls to malloc and free with new and delete
+static std::atomic<size_t> allocations(0);
+
+__attribute__((noinline)) void* operator new(size_t n) {
+	++allocations;
+	void *p = std::malloc(n > 0 ? n : 1);
+	if(!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+static const size_t Dim = 4;
+
+// keeps the compiler from removing the computation of unused results
+template<typename T>
+void keep(const T& result) {
+	asm volatile("" : : "g"(&result) : "memory");
+}
+
+// access to the elements of the different state types
+template<typename State>
+struct StateInfo {
+	typedef State Scalar;
+	static const bool copyable = true;
+	static std::string name() { return scalar_name(); }
+	static size_t dim(const State&) { return 1; }
+	static Scalar& at(State& s, size_t) { return s; }
+	static State make() { return State(); }
+	static std::string scalar_name() { return sizeof(State) == sizeof(float) ? "float" : "double"; }
+};
+
+template<typename T>
+struct StateInfo<T[Dim]> {
+	typedef T Scalar;
+	static const bool copyable = false;
+	static std::string name() { return StateInfo<T>::name() + "[4]"; }
+	static size_t dim(const T (&)[Dim]) { return Dim; }
+	static Scalar& at(T (&s)[Dim], size_t j) { return s[j]; }
+};
+
+template<typename T>
+struct StateInfo<std::vector<T> > {
+	typedef T Scalar;
+	static const bool copyable = true;
+	static std::string name() { return "vector<" + StateInfo<T>::name() + ">(4)"; }
+	static size_t dim(const std::vector<T>& s) { return s.size(); }
+	static Scalar& at(std::vector<T>& s, size_t j) { return s[j]; }
+	static std::vector<T> make() { return std::vector<T>(Dim); }
+};
+
+template<typename T>
+struct StateInfo<std::array<T, Dim> > {
+	typedef T Scalar;
+	static const bool copyable = true;
+	static std::string name() { return "array<" + StateInfo<T>::name() + ",4>"; }
+	static size_t dim(const std::array<T, Dim>&) { return Dim; }
+	static Scalar& at(std::array<T, Dim>& s, size_t j) { return s[j]; }
+	static std::array<T, Dim> make() { return std::array<T, Dim>(); }
+};
+
+// random particles around zero
+template<typename State>
+void fill(std::vector<State>& state_v, State& obs) {
+	typedef StateInfo<State> Info;
+	std::default_random_engine gen(1);
+	std::normal_distribution<double> dist(0, 1);
+	for(auto& s : state_v)
+		for(size_t j = 0; j < Info::dim(s); ++j)
+			Info::at(s, j) = dist(gen);
+	for(size_t j = 0; j < Info::dim(obs); ++j)
+		Info::at(obs, j) = 0.5;
+}
+
+template<typename State>
+void make_particles(std::vector<State>& state_v, State& obs, size_t n, std::true_type) {
+	state_v.assign(n, StateInfo<State>::make());
+	obs = StateInfo<State>::make();
+	fill(state_v, obs);
+}
+
+template<typename State>
+void make_particles(std::vector<State>& state_v, State& obs, size_t n, std::false_type) {
+	std::vector<State>(n).swap(state_v);
+	fill(state_v, obs);
+}
+
+// the protected methods of the policies made accessible
+template<typename W, typename O>
+struct NormPdf : weight_policies::NormPdf<W, O> { using weight_policies::NormPdf<W, O>::weight; };
+
+template<typename W, typename O>
+struct SquareError : weight_policies::SquareError<W, O> { using weight_policies::SquareError<W, O>::weight; };
+
+template<typename S, typename W>
+struct Systematic : resampling_policies::SystematicResampling<S, W> {
+	using resampling_policies::SystematicResampling<S, W>::resampling;
+};
+
+template<typename S>
+struct Noise : noise_policies::GaussianNoise<S> { using noise_policies::GaussianNoise<S>::noise; };
+
+template<typename S>
+struct Init : init_policies::Gaussian<S> { using init_policies::Gaussian<S>::init; };
+
+template<typename S, typename W>
+struct Mean : winner_policies::WeightedArithmeticMean<S, W> {
+	using winner_policies::WeightedArithmeticMean<S, W>::winner;
+};
+
+template<typename S, typename W>
+struct Moments : winner_policies::PosteriorMoments<S, W> {
+	using winner_policies::PosteriorMoments<S, W>::winner;
+};
+
+template<class S> using None = prediction_policies::None<S>;
+template<class S, class O> using Identity = state2obs::Identity<S, O>;
+template<class W, class O> using Pdf = weight_policies::NormPdf<W, O>;
+
+struct Report {
+	bool json;
+	bool first;
+
+	void print(const std::string& benchmark, const std::string& state, const std::string& weight,
+			size_t n, double ns, double allocs, double bytes) {
+		std::ostringstream line;
+		if(json) {
+			line << (first ? "[\n" : ",\n") << "{\"benchmark\": \"" << benchmark << "\", \"state\": \"" << state
+				<< "\", \"weight\": \"" << weight << "\", \"particles\": " << n
+				<< ", \"ns_per_particle\": " << ns / n << ", \"allocations_per_step\": " << allocs
+				<< ", \"gb_per_s\": " << bytes / ns << "}";
+		} else {
+			if(first)
+				line << "benchmark,state,weight,particles,ns_per_particle,allocations_per_step,gb_per_s\n";
+			line << benchmark << "," << state << "," << weight << "," << n << ","
+				<< ns / n << "," << allocs << "," << bytes / ns << "\n";
+		}
+		std::cout << line.str() << std::flush;
+		first = false;
+	}
+
+	void finish() {
+		if(json)
+			std::cout << (first ? "[]\n" : "\n]\n");
+	}
+};
+
+// Calls step until at least 50ms have passed (at least 3 times, after one
+// call to warm up) and reports the mean time and allocations per call;
+// bytes is the memory traffic of one call
+template<typename F>
+void measure(Report& report, const std::string& benchmark, const std::string& state, const std::string& weight,
+		size_t n, double bytes, const F& step) {
+	step();
+
+	size_t allocs = allocations, calls = 0;
+	auto start = std::chrono::steady_clock::now();
+	double elapsed = 0;
+	while(calls < 3 || elapsed < 5e7) {
+		step();
+		++calls;
+		elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	}
+	report.print(benchmark, state, weight, n, elapsed / calls, double(allocations - allocs) / calls, bytes);
+}
+
+// the init policy needs the dimension of std::vector states
+template<typename PF>
+auto call_setInitDimension(PF& pf, int) -> decltype(pf.setInitDimension(Dim)) {
+	pf.setInitDimension(Dim);
+}
+
+template<typename PF>
+void call_setInitDimension(PF&, long) {}
+
+template<typename State, typename Weight>
+void run_filter(Report& report, size_t n, size_t state_bytes, std::true_type) {
+	typedef ParticleFilter<State, State, Weight, None, Identity, Pdf> PF;
+	PF pf(n);
+	call_setInitDimension(pf, 0);
+	std::vector<State> unused;
+	State obs;
+	make_particles(unused, obs, 0, std::true_type());
+
+	const double bytes = n * (5.0*state_bytes + 6.0*sizeof(Weight) + sizeof(size_t));
+	measure(report, "run", StateInfo<State>::name(), StateInfo<Weight>::name(), n, bytes, [&]() {
+		keep(pf.run(obs));
+	});
+
+	pf.setFusedExecution(true);
+	measure(report, "run_fused", StateInfo<State>::name(), StateInfo<Weight>::name(), n, bytes, [&]() {
+		keep(pf.run(obs));
+	});
+}
+
+template<typename State, typename Weight>
+void run_filter(Report&, size_t, size_t, std::false_type) {}
+
+template<typename State, typename Weight>
+void resample(Report& report, size_t n, size_t state_bytes, std::vector<State>& state_v,
+		std::vector<Weight>& weight_v, std::true_type) {
+	Systematic<State, Weight> policy;
+	std::vector<State> buffer;
+	std::vector<typename Accumulator<Weight>::type> edges;
+	std::vector<Weight> weights = weight_v;
+	measure(report, "SystematicResampling", StateInfo<State>::name(), StateInfo<Weight>::name(), n,
+			n * (2.0*state_bytes + 3.0*sizeof(Weight) + sizeof(size_t)), [&]() {
+		weights = weight_v;
+		policy.resampling(state_v, weights, edges, buffer);
+	});
+}
+
+template<typename State, typename Weight>
+void resample(Report&, size_t, size_t, std::vector<State>&, std::vector<Weight>&, std::false_type) {}
+
+template<typename State, typename Weight>
+void benchmark(Report& report, size_t max_particles) {
+	typedef StateInfo<State> Info;
+	typedef std::integral_constant<bool, Info::copyable> Copyable;
+	const std::string state = Info::name(), weight = StateInfo<Weight>::name();
+
+	for(size_t n = 1000; n <= max_particles; n *= 10) {
+		std::vector<State> state_v;
+		State obs;
+		make_particles(state_v, obs, n, Copyable());
+		const size_t state_bytes = sizeof(typename Info::Scalar) * Info::dim(state_v[0]);
+		std::vector<Weight> weight_v(n, Weight(1) / n);
+
+		NormPdf<Weight, State> normpdf;
+		measure(report, "NormPdf", state, weight, n, n * (state_bytes + sizeof(Weight)), [&]() {
+			normpdf.weight(state_v, obs, weight_v, 0, n);
+		});
+
+		SquareError<Weight, State> square_error;
+		measure(report, "SquareError", state, weight, n, n * (state_bytes + sizeof(Weight)), [&]() {
+			square_error.weight(state_v, obs, weight_v, 0, n);
+		});
+
+		for(auto& w : weight_v)
+			w = Weight(1) / n;
+		resample(report, n, state_bytes, state_v, weight_v, Copyable());
+
+		Noise<State> noise;
+		measure(report, "GaussianNoise", state, weight, n, n * 2.0*state_bytes, [&]() {
+			noise.noise(state_v, 0, n, 0);
+		});
+
+		Init<State> init;
+		call_setInitDimension(init, 0);
+		measure(report, "Gaussian", state, weight, n, n * state_bytes, [&]() {
+			keep(init.init(n));
+		});
+
+		Mean<State, Weight> mean;
+		measure(report, "WeightedArithmeticMean", state, weight, n, n * (state_bytes + sizeof(Weight)), [&]() {
+			keep(mean.winner(state_v, weight_v));
+		});
+
+		Moments<State, Weight> moments;
+		measure(report, "PosteriorMoments", state, weight, n, n * (state_bytes + sizeof(Weight)), [&]() {
+			keep(moments.winner(state_v, weight_v));
+		});
+
+		run_filter<State, Weight>(report, n, state_bytes, Copyable());
+	}
+}
+
+template<typename T>
+void benchmark_all(Report& report, size_t max_particles) {
+	benchmark<T, T>(report, max_particles);
+	benchmark<T[Dim], T>(report, max_particles);
+	benchmark<std::vector<T>, T>(report, max_particles);
+	benchmark<std::array<T, Dim>, T>(report, max_particles);
+}
+
+int main(int argc, char *argv[]) {
+	Report report = {false, true};
+	size_t max_particles = 1000000;
+	for(int i = 1; i < argc; ++i) {
+		if(std::strcmp(argv[i], "--json") == 0) {
+			report.json = true;
+		} else if(std::strcmp(argv[i], "--max-particles") == 0 && i+1 < argc) {
+			max_particles = std::strtoul(argv[++i], nullptr, 10);
+		} else {
+			std::cerr << "usage: " << argv[0] << " [--json] [--max-particles N]" << std::endl;
+			return 1;
+		}
+	}
+
+	benchmark_all<double>(report, max_particles);
+	benchmark_all<float>(report, max_particles);
+	report.finish();
+	return 0;
+}
@@ -33,16 +33,17 @@ private:
 
 };
 
-// wrapper around the observation equation
+// wrapper around the observation equation; the observations are written
+// into a workspace owned by the particle filter (returning a new vector
+// instead is supported as well, but allocates memory on every step)
 
 template <typename State, typename Obs>
 class ExState2Obs {
 protected:
-	std::vector<Obs> state2obs(std::vector<State>& state_v) {
-		std::vector<Obs> obs_v(state_v.size(), 0);
+	void state2obs(const std::vector<State>& state_v, std::vector<Obs>& obs_v) {
+		obs_v.resize(state_v.size());
 		for(size_t i = 0; i < state_v.size(); ++i)
 			obs_v[i] = generate_observation(state_v[i]);
-		return obs_v;
 	}
 };
 
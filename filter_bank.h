@@ -0,0 +1,139 @@
+#ifndef _POLPF_FILTER_BANK_H_
+#define _POLPF_FILTER_BANK_H_
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <stdexcept>
+#include <cstddef>
+
+#include "thread_pool.h"
+
+namespace policy_pf {
+
+// FilterBank owns many independent particle filters of the same type and
+// advances all of them with one call to run. The filters are stored in
+// blocks of BlockSize filters, so adding a filter never moves the others and
+// removed slots are reused. A filter is identified by the index of its slot.
+// Only the filter objects are pooled in the blocks: every filter still
+// allocates its particle set, weights and workspaces on its own, so they are
+// neither contiguous nor taken from a shared arena.
+template<typename Filter, size_t BlockSize = 64>
+class FilterBank {
+public:
+	typedef typename Filter::Observation Observation;
+	typedef typename Filter::Winner Winner;
+
+	FilterBank(unsigned int num_threads = 1) : count(0), grain(1) {
+		setThreads(num_threads);
+	}
+
+	~FilterBank() {
+		for(size_t i = 0; i < live.size(); ++i)
+			if(live[i])
+				slot(i)->~Filter();
+	}
+
+	FilterBank(const FilterBank&) = delete;
+	FilterBank& operator=(const FilterBank&) = delete;
+
+	// the filters of the bank should not start threads on their own
+	void setThreads(unsigned int num_threads) {
+		pool.reset(num_threads > 1 ? new ThreadPool(num_threads) : nullptr);
+	}
+
+	// number of filters a thread takes at once from another thread
+	void setGrainSize(size_t grain) {
+		this->grain = grain > 0 ? grain : 1;
+	}
+
+	// constructs a filter with the given arguments and returns its index
+	template<typename... Args>
+	size_t add(Args&&... args) {
+		size_t i;
+		if(!free_slots.empty()) {
+			i = free_slots.back();
+			free_slots.pop_back();
+		} else {
+			i = live.size();
+			if(i == blocks.size() * BlockSize)
+				blocks.push_back(std::unique_ptr<Block>(new Block));
+			live.push_back(false);
+		}
+		new (slot(i)) Filter(std::forward<Args>(args)...);
+		live[i] = true;
+		++count;
+		return i;
+	}
+
+	void remove(size_t i) {
+		if(!contains(i))
+			throw std::out_of_range("FilterBank::remove: no filter at this index");
+		slot(i)->~Filter();
+		live[i] = false;
+		free_slots.push_back(i);
+		--count;
+	}
+
+	bool contains(size_t i) const {
+		return i < live.size() && live[i];
+	}
+
+	Filter& operator[](size_t i) {
+		return *slot(i);
+	}
+
+	const Filter& operator[](size_t i) const {
+		return *slot(i);
+	}
+
+	// number of filters
+	size_t size() const {
+		return count;
+	}
+
+	// indices of the filters are smaller than capacity
+	size_t capacity() const {
+		return live.size();
+	}
+
+	// Advances every filter i with the observation observations[i] and stores
+	// its result in winners[i]. Both vectors are indexed by the filter index
+	// and must have at least capacity() elements, entries of removed filters
+	// are ignored.
+	void run(const std::vector<Observation>& observations, std::vector<Winner>& winners) {
+		if(observations.size() < capacity() || winners.size() < capacity())
+			throw std::length_error("FilterBank::run: fewer observations or winners than filters");
+
+		auto step = [&](size_t begin, size_t end, unsigned int) {
+			for(size_t i = begin; i < end; ++i)
+				if(live[i])
+					winners[i] = slot(i)->run(observations[i]);
+		};
+		if(pool)
+			pool->stealing_for(capacity(), grain, step);
+		else
+			step(0, capacity(), 0);
+	}
+
+private:
+	struct Block {
+		typename std::aligned_storage<sizeof(Filter), alignof(Filter)>::type slots[BlockSize];
+	};
+
+	Filter* slot(size_t i) const {
+		return reinterpret_cast<Filter*>(&blocks[i / BlockSize]->slots[i % BlockSize]);
+	}
+
+	std::vector<std::unique_ptr<Block> > blocks;
+	std::vector<char> live;
+	std::vector<size_t> free_slots;
+	size_t count, grain;
+	std::unique_ptr<ThreadPool> pool;
+};
+
+}
+
+#endif
@@ -8,35 +8,57 @@
 #include <type_traits>
 #include <algorithm>
 
+#include "storage.h"
+#include "rng.h"
+
 namespace policy_pf {
 namespace init_policies {
 
 // GaussianBase encapsulates a gaussian distributed random number generator
-template<typename FloatingType>
+// of type RNG (see rng.h)
+template<typename FloatingType, typename RNG = rng::Default>
 class GaussianBase {
 public:
+	GaussianBase() : sigma(1) {}
+
 	inline void setInitSigma(FloatingType sigma) {
-		uni_rand = std::normal_distribution<FloatingType>(0, sigma);
+		this->sigma = sigma;
+	}
+
+	void setInitSeed(unsigned int seed) {
+		generator.seed(seed);
+	}
+
+	template<typename Writer>
+	void save_state(Writer& w) const {
+		w.write(sigma);
+		generator.save_state(w);
+	}
+
+	template<typename Reader>
+	void load_state(Reader& r) {
+		r.read(sigma);
+		generator.load_state(r);
 	}
 
 protected:
 	inline FloatingType random() {
-		return uni_rand(generator);
+		return sigma * generator.template normal<FloatingType>();
 	}
 
 private:
-	std::default_random_engine generator;
-	std::normal_distribution<FloatingType> uni_rand;
+	RNG generator;
+	FloatingType sigma;
 };
 
 // compilation fails if no type trait is applicable
-template<typename State, typename Enable = void>
+template<typename State, typename RNG = rng::Default, typename Enable = void>
 class AutoDetect;
 
 // implementation for scalar floating point types
-template<typename State>
-class AutoDetect<State, typename std::enable_if<std::is_floating_point<State>::value >::type>
-	: public GaussianBase<State> {
+template<typename State, typename RNG>
+class AutoDetect<State, RNG, typename std::enable_if<std::is_floating_point<State>::value >::type>
+	: public GaussianBase<State, RNG> {
 protected:
 	inline void apply_init(State& s) {
 		s += this->random();
@@ -44,32 +66,119 @@ protected:
 };
 
 // recursive implementation for arrays
-template<typename State>
-class AutoDetect<State, typename std::enable_if<std::is_array<State>::value >::type>
-	: public AutoDetect<typename std::remove_extent<State>::type> {
+template<typename State, typename RNG>
+class AutoDetect<State, RNG, typename std::enable_if<std::is_array<State>::value >::type>
+	: public AutoDetect<typename std::remove_extent<State>::type, RNG> {
 protected:
 	inline void apply_init(State& s) {
 		for(size_t i = 0; i < std::extent<State>::value; ++i)
-			AutoDetect<typename std::remove_extent<State>::type>::apply_init(s[i]);
+			AutoDetect<typename std::remove_extent<State>::type, RNG>::apply_init(s[i]);
 	}
 };
 
 // recursive implementation for standard container types vector, deque and array
-template <typename T> struct isContainer {static const bool value = false;};
-template <typename T> struct isContainer<std::vector<T> > {static const bool value = true;};
-template <typename T> struct isContainer<std::deque<T> > {static const bool value = true;};
-template <typename T, int N> struct isContainer<std::array<T, N> > {static const bool value = true;};
+template<typename State, typename RNG>
+class AutoDetect<State, RNG, typename std::enable_if<isContainer<State>::value
+		|| (isFixedArray<State>::value && !std::is_array<State>::value) >::type>
+	: public AutoDetect<typename State::value_type, RNG> {
+public:
+	// number of elements of the initial states, required for std::vector
+	// and std::deque states
+	void setInitDimension(size_t dimension) {
+		this->dimension = dimension;
+	}
+
+	template<typename Writer>
+	void save_state(Writer& w) const {
+		w.write(uint64_t(dimension));
+		AutoDetect<typename State::value_type, RNG>::save_state(w);
+	}
+
+	template<typename Reader>
+	void load_state(Reader& r) {
+		uint64_t d;
+		r.read(d);
+		dimension = d;
+		AutoDetect<typename State::value_type, RNG>::load_state(r);
+	}
 
-template<typename State>
-class AutoDetect<State, typename std::enable_if<isContainer<State>::value >::type>
-	: public AutoDetect<typename State::value_type> {
 protected:
+	AutoDetect() : dimension(0) {}
+
 	inline void apply_init(State& s) {
+		resize(s, dimension);
 		for(size_t i = 0; i < s.size(); ++i)
-			AutoDetect<typename State::value_type>::apply_init(s[i]);
+			AutoDetect<typename State::value_type, RNG>::apply_init(s[i]);
+	}
+
+private:
+	template<typename Container>
+	static void resize(Container& s, size_t n) {
+		if(n > 0)
+			s.resize(n);
+	}
+
+	template<typename T, size_t N>
+	static void resize(std::array<T, N>&, size_t) {}
+
+	size_t dimension;
+};
+
+// implementation for structure of arrays states, fills one column at a time
+template<typename State, typename RNG>
+class AutoDetect<State, RNG, typename std::enable_if<isSoA<State>::value >::type>
+	: public GaussianBase<typename ParticleStorage<State>::value_type::value_type, RNG> {
+protected:
+	inline void apply_init(typename ParticleStorage<State>::type& s) {
+		for(size_t j = 0; j < ParticleStorage<State>::type::dimensions; ++j) {
+			auto c = s.column(j);
+			for(size_t i = 0; i < s.size(); ++i)
+				c[i] += this->random();
+		}
 	}
 };
 
+// implementation for flat states, fills the arena in memory order
+template<typename State, typename RNG>
+class AutoDetect<State, RNG, typename std::enable_if<isFlat<State>::value >::type>
+	: public GaussianBase<typename ParticleStorage<State>::type::element_type, RNG> {
+public:
+	// number of elements of the states, the dimension of the particle set
+	void setInitDimension(size_t dimension) {
+		this->dimension = dimension;
+	}
+
+	template<typename Writer>
+	void save_state(Writer& w) const {
+		w.write(uint64_t(dimension));
+		GaussianBase<typename ParticleStorage<State>::type::element_type, RNG>::save_state(w);
+	}
+
+	template<typename Reader>
+	void load_state(Reader& r) {
+		uint64_t d;
+		r.read(d);
+		dimension = d;
+		GaussianBase<typename ParticleStorage<State>::type::element_type, RNG>::load_state(r);
+	}
+
+protected:
+	AutoDetect() : dimension(0) {}
+
+	size_t init_dimension() const {
+		return dimension;
+	}
+
+	inline void apply_init(typename ParticleStorage<State>::type& s) {
+		auto x = s.data();
+		for(size_t i = 0; i < s.size() * s.dimension(); ++i)
+			x[i] += this->random();
+	}
+
+private:
+	size_t dimension;
+};
+
 #if GCC_VERSION >= 40700
 // Workaround for g++ 4.7
 template<typename State> using AutoDetectT = AutoDetect<State>;
@@ -80,12 +189,12 @@ template<typename State> class AutoDetectT : public AutoDetect<State> {};
 
 // Appies gaussian noise based on an ApplicationPolicy;
 // the default policy AutoDetect works for scalar floating point types,
-// (multidimensional) arrays, std::vector, std::deque and std::array
-template<typename State, template<class> class ApplicationPolicy = AutoDetectT>
+// (multidimensional) arrays, std::vector, std::deque, std::array, SoA and Flat states
+template<typename State, template<class> class ApplicationPolicy = AutoDetectT, typename Enable = void>
 class Gaussian_ : public ApplicationPolicy<State> {
 protected:
 	std::vector<State> init(unsigned int sz) {
-		std::vector<State> res(sz, 0);
+		std::vector<State> res(sz);
 		for(size_t i = 0; i < sz; ++i) {
 			this->apply_init(res[i]);
 		}
@@ -93,6 +202,29 @@ protected:
 	}
 };
 
+template<typename State, template<class> class ApplicationPolicy>
+class Gaussian_<State, ApplicationPolicy, typename std::enable_if<isSoA<State>::value >::type>
+	: public ApplicationPolicy<State> {
+protected:
+	typename ParticleStorage<State>::type init(unsigned int sz) {
+		typename ParticleStorage<State>::type res(sz);
+		this->apply_init(res);
+		return res;
+	}
+};
+
+// the dimension of flat states is set with setInitDimension
+template<typename State, template<class> class ApplicationPolicy>
+class Gaussian_<State, ApplicationPolicy, typename std::enable_if<isFlat<State>::value >::type>
+	: public ApplicationPolicy<State> {
+protected:
+	typename ParticleStorage<State>::type init(unsigned int sz) {
+		typename ParticleStorage<State>::type res(sz, this->init_dimension());
+		this->apply_init(res);
+		return res;
+	}
+};
+
 #if GCC_VERSION >= 40700
 // Workaround for g++ 4.7
 template<typename State>
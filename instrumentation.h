@@ -0,0 +1,124 @@
+#ifndef _POLPF_INSTRUMENTATION_H_
+#define _POLPF_INSTRUMENTATION_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+namespace policy_pf {
+namespace instrumentation_policies {
+
+// stages of a step of the particle filter, the fused execution reports
+// Fused instead of Predict, Noise, State2Obs and Weight
+enum Stage {
+	Predict, Noise, State2Obs, Weight, Normalize, Resampling, Winner, Fused, NumStages
+};
+
+// The particle filter calls begin_stage and end_stage around every stage and
+// end_step at the end of every step. The weight sum is the sum of the weights
+// before normalization, for log-likelihood weight policies its logarithm.
+
+// does not record anything, all calls compile to nothing
+template<typename Weight>
+class None {
+protected:
+	void begin_stage(Stage) {}
+	void end_stage(Stage) {}
+	void end_step(size_t, double, double, bool, bool) {}
+};
+
+// statistics of the last step and totals of all steps
+struct Statistics {
+	double stage_seconds[NumStages];
+	double total_stage_seconds[NumStages];
+	double effective_sample_size;
+	double weight_sum;
+	uint64_t particles;
+	uint64_t steps;
+	uint64_t resamplings;
+	uint64_t zero_weight_fallbacks;
+	bool zero_weight_fallback;
+	bool resampled;
+};
+
+// Counters records the wall time of every stage and the statistics of every
+// step. They are published after every step using a sequence lock, so
+// statistics() can be called from any thread at any time without blocking
+// the filter; it retries while a step is being published.
+template<typename Weight>
+class Counters {
+public:
+	Counters() : sequence(0) {
+		std::memset(&current, 0, sizeof(current));
+		publish();
+	}
+
+	Statistics statistics() const {
+		Statistics s;
+		uint64_t words[Words];
+		for(;;) {
+			uint64_t before = sequence.load(std::memory_order_acquire);
+			for(size_t i = 0; i < Words; ++i)
+				words[i] = published[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(!(before & 1) && sequence.load(std::memory_order_relaxed) == before)
+				break;
+		}
+		std::memcpy(&s, words, sizeof(s));
+		return s;
+	}
+
+protected:
+	void begin_stage(Stage stage) {
+		started[stage] = std::chrono::steady_clock::now();
+	}
+
+	void end_stage(Stage stage) {
+		current.stage_seconds[stage] = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started[stage]).count();
+		current.total_stage_seconds[stage] += current.stage_seconds[stage];
+	}
+
+	void end_step(size_t particles, double ess, double weight_sum, bool zero_weight_fallback, bool resampled) {
+		current.particles = particles;
+		current.effective_sample_size = ess;
+		current.weight_sum = weight_sum;
+		current.zero_weight_fallback = zero_weight_fallback;
+		current.resampled = resampled;
+		current.steps++;
+		current.resamplings += resampled;
+		current.zero_weight_fallbacks += zero_weight_fallback;
+		publish();
+
+		// stages which are skipped in the next step take no time
+		for(size_t i = 0; i < NumStages; ++i)
+			current.stage_seconds[i] = 0;
+	}
+
+private:
+	static const size_t Words = (sizeof(Statistics) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	void publish() {
+		uint64_t words[Words] = {0};
+		std::memcpy(words, &current, sizeof(current));
+
+		uint64_t s = sequence.load(std::memory_order_relaxed);
+		sequence.store(s + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for(size_t i = 0; i < Words; ++i)
+			published[i].store(words[i], std::memory_order_relaxed);
+		sequence.store(s + 2, std::memory_order_release);
+	}
+
+	Statistics current;
+	std::chrono::steady_clock::time_point started[NumStages];
+
+	std::atomic<uint64_t> sequence;
+	std::atomic<uint64_t> published[Words];
+};
+
+}}
+
+#endif
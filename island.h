@@ -0,0 +1,721 @@
+#ifndef _POLPF_ISLAND_H_
+#define _POLPF_ISLAND_H_
+
+#include <vector>
+#include <array>
+#include <string>
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <type_traits>
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "storage.h"
+#include "snapshot.h"
+
+namespace policy_pf {
+namespace island {
+
+// A transport connects the islands of an IslandFilter, one per process.
+// It provides
+//   rank(), size()          the index of this island and the number of islands
+//   send(to, message)       queues the message for island to and returns
+//                           without waiting for it to be received
+//   receive(from, message)  waits for the next message of island from
+// The messages between two islands arrive in the order they were sent.
+
+// Transport over Unix domain stream sockets, one connection between every
+// pair of islands. Messages are framed by their length. While receive waits
+// it also writes the queued messages, so islands sending to each other
+// before receiving do not block each other.
+class UnixSocketTransport {
+public:
+	// Connects the islands running in separate processes, each process passes
+	// its rank. Island r listens at path + "." + r, the file is removed once
+	// all islands have connected. Waits up to timeout seconds for the others.
+	UnixSocketTransport(const std::string& path, unsigned int rank, unsigned int size, double timeout = 10)
+			: r(rank), peers(size) {
+		if(rank >= size)
+			throw std::invalid_argument("UnixSocketTransport: the rank must be smaller than the number of islands");
+		const std::string own = path + "." + std::to_string(rank);
+		const int listener = listen_at(own, size);
+		const auto deadline = std::chrono::steady_clock::now()
+			+ std::chrono::milliseconds((long long) (timeout * 1000));
+		try {
+			// lower ranks are connected to, higher ranks are accepted
+			for(unsigned int k = 0; k < rank; ++k) {
+				peers[k].fd = connect_to(path + "." + std::to_string(k), deadline);
+				uint32_t me = rank;
+				write_all(peers[k].fd, &me, sizeof(me));
+			}
+			for(unsigned int k = rank + 1; k < size; ++k) {
+				const int fd = accept_from(listener, deadline);
+				uint32_t other;
+				if(!read_all(fd, &other, sizeof(other)) || other <= rank || other >= size || peers[other].fd >= 0) {
+					::close(fd);
+					throw std::runtime_error("UnixSocketTransport: unexpected connection");
+				}
+				peers[other].fd = fd;
+			}
+		} catch(...) {
+			::close(listener);
+			::unlink(own.c_str());
+			close_all();
+			throw;
+		}
+		::close(listener);
+		::unlink(own.c_str());
+		set_nonblocking();
+	}
+
+	// Forks size - 1 processes, connected to each other and to the calling
+	// process by socket pairs. Returns in every process with its own
+	// transport, the calling process has rank 0 and waits for the others when
+	// its transport is destroyed. The forked processes only return once all
+	// of them are started; if a fork fails, the processes already started
+	// exit without returning and fork throws. The forked processes should end
+	// with _exit after their work. Call this before any thread (e.g. the
+	// thread pool of a particle filter) is started.
+	static UnixSocketTransport fork(unsigned int size) {
+		std::vector<int> fds(size * size, -1); // fds[i*size + j] is the end of island i
+		// closes the ends of all islands but rank, all ends if rank is size
+		auto close_others = [&fds, size](unsigned int rank) {
+			for(unsigned int i = 0; i < size; ++i)
+				for(unsigned int j = 0; j < size; ++j)
+					if(i != rank && fds[i*size + j] >= 0) {
+						::close(fds[i*size + j]);
+						fds[i*size + j] = -1;
+					}
+		};
+
+		for(unsigned int i = 0; i < size; ++i) {
+			for(unsigned int j = i + 1; j < size; ++j) {
+				int sv[2];
+				if(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+					close_others(size);
+					throw std::runtime_error("UnixSocketTransport: cannot create socket pair");
+				}
+				fds[i*size + j] = sv[0];
+				fds[j*size + i] = sv[1];
+			}
+		}
+
+		// the forked processes wait for a byte from the calling process, which
+		// closes its ends instead if a fork fails
+		std::vector<pid_t> started;
+		for(unsigned int k = 1; k < size; ++k) {
+			const pid_t pid = ::fork();
+			if(pid == 0) {
+				close_others(k);
+				char go;
+				if(!read_all(fds[k*size], &go, sizeof(go)))
+					::_exit(1);
+				UnixSocketTransport t(k, size);
+				for(unsigned int j = 0; j < size; ++j)
+					t.peers[j].fd = fds[k*size + j];
+				t.set_nonblocking();
+				return t;
+			}
+			if(pid < 0) {
+				close_others(size);
+				for(auto p : started)
+					::waitpid(p, nullptr, 0);
+				throw std::runtime_error("UnixSocketTransport: cannot fork");
+			}
+			started.push_back(pid);
+		}
+
+		close_others(0);
+		UnixSocketTransport t(0, size);
+		t.children = started;
+		for(unsigned int j = 0; j < size; ++j)
+			t.peers[j].fd = fds[j];
+		const char go = 1;
+		for(unsigned int k = 1; k < size; ++k)
+			write_all(t.peers[k].fd, &go, sizeof(go));
+		t.set_nonblocking();
+		return t;
+	}
+
+	UnixSocketTransport(UnixSocketTransport&& other)
+			: r(other.r), peers(std::move(other.peers)), children(std::move(other.children)) {
+		other.peers.clear();
+		other.children.clear();
+	}
+
+	UnixSocketTransport(const UnixSocketTransport&) = delete;
+	UnixSocketTransport& operator=(const UnixSocketTransport&) = delete;
+
+	// writes the queued messages before closing the connections
+	~UnixSocketTransport() {
+		try {
+			flush();
+		} catch(...) {}
+		close_all();
+		for(auto pid : children)
+			::waitpid(pid, nullptr, 0);
+	}
+
+	unsigned int rank() const {
+		return r;
+	}
+
+	unsigned int size() const {
+		return peers.size();
+	}
+
+	void send(unsigned int to, const std::vector<char>& message) {
+		if(to >= peers.size() || to == r)
+			throw std::invalid_argument("UnixSocketTransport::send: no such island");
+		Peer& p = peers[to];
+		if(p.fd < 0 || !p.writable)
+			throw std::runtime_error("UnixSocketTransport: connection to an island closed");
+		const uint64_t n = message.size();
+		const char* c = reinterpret_cast<const char*>(&n);
+		p.out.insert(p.out.end(), c, c + sizeof(n));
+		p.out.insert(p.out.end(), message.begin(), message.end());
+		progress(false);
+	}
+
+	void receive(unsigned int from, std::vector<char>& message) {
+		if(from >= peers.size() || from == r)
+			throw std::invalid_argument("UnixSocketTransport::receive: no such island");
+		while(!extract(peers[from], message)) {
+			if(peers[from].fd < 0)
+				throw std::runtime_error("UnixSocketTransport: connection to an island closed");
+			progress(true);
+		}
+	}
+
+	// waits until all queued messages are written
+	void flush() {
+		while(pending())
+			progress(true);
+	}
+
+private:
+	struct Peer {
+		Peer() : fd(-1), out_pos(0), writable(true) {}
+		int fd;
+		std::vector<char> in, out;
+		size_t out_pos;
+		bool writable;
+	};
+
+	UnixSocketTransport(unsigned int rank, unsigned int size) : r(rank), peers(size) {}
+
+	bool pending() const {
+		for(const auto& p : peers)
+			if(p.fd >= 0 && p.out_pos < p.out.size())
+				return true;
+		return false;
+	}
+
+	// moves the first complete message of p into message
+	static bool extract(Peer& p, std::vector<char>& message) {
+		uint64_t n;
+		if(p.in.size() < sizeof(n))
+			return false;
+		std::memcpy(&n, p.in.data(), sizeof(n));
+		if(p.in.size() - sizeof(n) < n)
+			return false;
+		message.assign(p.in.begin() + sizeof(n), p.in.begin() + sizeof(n) + n);
+		p.in.erase(p.in.begin(), p.in.begin() + sizeof(n) + n);
+		return true;
+	}
+
+	// Writes queued messages and reads incoming data on all connections,
+	// waiting for at least one of them to be ready if wait is set. A
+	// connection closed by an island which has finished is only an error
+	// when a message is sent to it or expected from it.
+	void progress(bool wait) {
+		std::vector<pollfd>& fds = poll_fds;
+		std::vector<size_t>& index = poll_index;
+		fds.clear();
+		index.clear();
+		for(size_t k = 0; k < peers.size(); ++k) {
+			if(peers[k].fd < 0)
+				continue;
+			pollfd f = {peers[k].fd, POLLIN, 0};
+			if(peers[k].out_pos < peers[k].out.size())
+				f.events |= POLLOUT;
+			fds.push_back(f);
+			index.push_back(k);
+		}
+		if(fds.empty())
+			return;
+		if(::poll(fds.data(), fds.size(), wait ? -1 : 0) < 0) {
+			if(errno == EINTR)
+				return;
+			throw std::runtime_error("UnixSocketTransport: poll failed");
+		}
+
+		char buffer[65536];
+		for(size_t i = 0; i < fds.size(); ++i) {
+			Peer& p = peers[index[i]];
+			if(fds[i].revents & POLLOUT) {
+				const ssize_t n = ::send(p.fd, p.out.data() + p.out_pos, p.out.size() - p.out_pos, MSG_NOSIGNAL);
+				if(n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+					p.writable = false; // the data sent by the island can still be read
+				else if(n > 0)
+					p.out_pos += n;
+				if(p.out_pos == p.out.size() || !p.writable) {
+					p.out.clear();
+					p.out_pos = 0;
+				}
+			}
+			if(fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+				const ssize_t n = ::recv(p.fd, buffer, sizeof(buffer), 0);
+				if(n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+					close(p);
+				else if(n > 0)
+					p.in.insert(p.in.end(), buffer, buffer + n);
+			}
+		}
+	}
+
+	static sockaddr_un address(const std::string& path) {
+		sockaddr_un a;
+		std::memset(&a, 0, sizeof(a));
+		a.sun_family = AF_UNIX;
+		if(path.size() >= sizeof(a.sun_path))
+			throw std::invalid_argument("UnixSocketTransport: socket path too long");
+		std::strcpy(a.sun_path, path.c_str());
+		return a;
+	}
+
+	static int listen_at(const std::string& path, unsigned int backlog) {
+		const sockaddr_un a = address(path);
+		const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if(fd < 0)
+			throw std::runtime_error("UnixSocketTransport: cannot create socket");
+		::unlink(path.c_str());
+		if(::bind(fd, reinterpret_cast<const sockaddr*>(&a), sizeof(a)) != 0 || ::listen(fd, backlog) != 0) {
+			::close(fd);
+			throw std::runtime_error("UnixSocketTransport: cannot listen at " + path);
+		}
+		return fd;
+	}
+
+	// retries until the island listens at path
+	static int connect_to(const std::string& path, std::chrono::steady_clock::time_point deadline) {
+		const sockaddr_un a = address(path);
+		for(;;) {
+			const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+			if(fd < 0)
+				throw std::runtime_error("UnixSocketTransport: cannot create socket");
+			if(::connect(fd, reinterpret_cast<const sockaddr*>(&a), sizeof(a)) == 0)
+				return fd;
+			const int error = errno;
+			::close(fd);
+			if((error != ENOENT && error != ECONNREFUSED && error != EAGAIN)
+					|| std::chrono::steady_clock::now() > deadline)
+				throw std::runtime_error("UnixSocketTransport: cannot connect to " + path);
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+
+	static int accept_from(int listener, std::chrono::steady_clock::time_point deadline) {
+		for(;;) {
+			const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+				deadline - std::chrono::steady_clock::now()).count();
+			pollfd f = {listener, POLLIN, 0};
+			const int ready = ::poll(&f, 1, left > 0 ? int(left) : 0);
+			if(ready < 0 && errno == EINTR)
+				continue;
+			if(ready <= 0)
+				throw std::runtime_error("UnixSocketTransport: timeout waiting for the other islands");
+			const int fd = ::accept(listener, nullptr, nullptr);
+			if(fd >= 0)
+				return fd;
+			if(errno != EINTR && errno != EAGAIN)
+				throw std::runtime_error("UnixSocketTransport: accept failed");
+		}
+	}
+
+	// blocking transfers of the handshake
+	static void write_all(int fd, const void* data, size_t n) {
+		const char* c = static_cast<const char*>(data);
+		while(n > 0) {
+			const ssize_t k = ::send(fd, c, n, MSG_NOSIGNAL);
+			if(k < 0 && errno == EINTR)
+				continue;
+			if(k <= 0)
+				throw std::runtime_error("UnixSocketTransport: handshake failed");
+			c += k;
+			n -= k;
+		}
+	}
+
+	static bool read_all(int fd, void* data, size_t n) {
+		char* c = static_cast<char*>(data);
+		while(n > 0) {
+			const ssize_t k = ::recv(fd, c, n, 0);
+			if(k < 0 && errno == EINTR)
+				continue;
+			if(k <= 0)
+				return false;
+			c += k;
+			n -= k;
+		}
+		return true;
+	}
+
+	void set_nonblocking() {
+		for(auto& p : peers)
+			if(p.fd >= 0)
+				::fcntl(p.fd, F_SETFL, ::fcntl(p.fd, F_GETFL) | O_NONBLOCK);
+	}
+
+	static void close(Peer& p) {
+		if(p.fd >= 0)
+			::close(p.fd);
+		p.fd = -1;
+	}
+
+	void close_all() {
+		for(auto& p : peers)
+			close(p);
+	}
+
+	unsigned int r;
+	std::vector<Peer> peers;
+	std::vector<pid_t> children;
+	std::vector<pollfd> poll_fds;
+	std::vector<size_t> poll_index;
+};
+
+// The winners of the islands are combined into their weighted mean, so the
+// winners have to be arithmetic types, std::array or std::vector of them.
+template<typename T>
+typename std::enable_if<std::is_arithmetic<T>::value>::type
+write_winner(snapshot::Writer& w, const T& x) {
+	w.write(x);
+}
+
+template<typename T, size_t N>
+void write_winner(snapshot::Writer& w, const std::array<T, N>& x) {
+	w.write(x);
+}
+
+template<typename T>
+void write_winner(snapshot::Writer& w, const std::vector<T>& x) {
+	w.write_array(x.data(), x.size());
+}
+
+template<typename T>
+typename std::enable_if<std::is_arithmetic<T>::value>::type
+read_winner(snapshot::Reader& r, T& x) {
+	r.read(x);
+}
+
+template<typename T, size_t N>
+void read_winner(snapshot::Reader& r, std::array<T, N>& x) {
+	r.read(x);
+}
+
+template<typename T>
+void read_winner(snapshot::Reader& r, std::vector<T>& x) {
+	r.read_array(x);
+}
+
+// x = a*x
+template<typename T>
+typename std::enable_if<std::is_arithmetic<T>::value>::type
+scale_winner(T& x, double a) {
+	x = T(a * x);
+}
+
+template<typename Container>
+auto scale_winner(Container& x, double a) -> decltype(x.begin(), void()) {
+	for(auto& v : x)
+		scale_winner(v, a);
+}
+
+// x += a*y
+template<typename T>
+typename std::enable_if<std::is_arithmetic<T>::value>::type
+add_winner(T& x, const T& y, double a) {
+	x = T(x + a * y);
+}
+
+template<typename Container>
+auto add_winner(Container& x, const Container& y, double a) -> decltype(x.begin(), void()) {
+	if(x.size() != y.size())
+		throw std::runtime_error("IslandFilter: the winners of the islands have different sizes");
+	for(size_t j = 0; j < x.size(); ++j)
+		add_winner(x[j], y[j], a);
+}
+
+enum Topology {
+	Ring,    // island r sends its migrants to island r+1
+	AllToAll // the migrants are divided among all other islands
+};
+
+// IslandFilter splits the particle population among islands, one per
+// process, each running its own particle filter on the same observations.
+// Every island resamples locally and keeps the logarithm of its island
+// weight, the product of the mean weights of its steps. After every step the
+// islands exchange their island weights, effective sample sizes and
+// winners, so every island returns the same global winner: the mean of the
+// winners weighted with the island weights.
+//
+// Every exchange interval steps each island sends migrants particles to its
+// neighbours and replaces the particles it sent by the ones it receives.
+// The island weight then becomes the weight of the mixed particle set, and
+// the particles of an island are treated as equally weighted again, which
+// is exact if the islands had the same weight. The particle filters should
+// resample on every step and must not use ancestor resampling.
+//
+// Messages are snapshot sections (see snapshot.h), the migrants of a
+// neighbour are sent as one batch in the layout of the particle storage.
+template<typename Filter, typename Transport = UnixSocketTransport>
+class IslandFilter {
+public:
+	typedef typename Filter::Observation Observation;
+	typedef typename Filter::Winner Winner;
+	typedef typename Filter::Particles Particles;
+
+	// takes over the transport and constructs the local filter with args
+	template<typename... Args>
+	IslandFilter(Transport&& transport, Args&&... args) : transport(std::move(transport)),
+			pf(std::forward<Args>(args)...), topology(Ring), interval(1), migrants(0), step_count(0),
+			log_weight(0), ess(0), total_particles(0), bytes_sent(0) {}
+
+	IslandFilter(const IslandFilter&) = delete;
+	IslandFilter& operator=(const IslandFilter&) = delete;
+
+	// the particle filter of this island
+	Filter& filter() {
+		return pf;
+	}
+
+	unsigned int rank() const {
+		return transport.rank();
+	}
+
+	unsigned int islands() const {
+		return transport.size();
+	}
+
+	void setTopology(Topology topology) {
+		this->topology = topology;
+	}
+
+	// number of particles every island sends per exchange, 0 (the default)
+	// disables the exchange of particles
+	void setMigrants(size_t migrants) {
+		this->migrants = migrants;
+	}
+
+	// steps between two exchanges of particles (default 1)
+	void setExchangeInterval(unsigned int steps) {
+		interval = steps > 0 ? steps : 1;
+	}
+
+	// runs a step on every island, all islands have to call run with the same
+	// observations
+	Winner run(const Observation& observation) {
+		const Winner local = pf.run(observation);
+		log_weight += pf.logLikelihood();
+
+		snapshot::Writer w;
+		w.begin_section(SummarySection);
+		w.write(log_weight);
+		w.write(pf.effectiveSampleSize());
+		w.write(uint64_t(pf.particleCount()));
+		write_winner(w, local);
+		w.end_section();
+		for(unsigned int k = 0; k < islands(); ++k)
+			if(k != rank())
+				send(k, w.data());
+
+		summaries.resize(islands());
+		for(unsigned int k = 0; k < islands(); ++k) {
+			Summary& s = summaries[k];
+			if(k == rank()) {
+				s.log_weight = log_weight;
+				s.ess = pf.effectiveSampleSize();
+				s.particles = pf.particleCount();
+				s.winner = local;
+				continue;
+			}
+			transport.receive(k, buffer);
+			snapshot::Reader r(buffer.data(), buffer.size());
+			if(!r.find_section(SummarySection))
+				throw std::runtime_error("IslandFilter: unexpected message");
+			r.read(s.log_weight);
+			r.read(s.ess);
+			r.read(s.particles);
+			read_winner(r, s.winner);
+		}
+		const Winner win = combine();
+
+		++step_count;
+		if(migrants > 0 && islands() > 1 && step_count % interval == 0)
+			exchange();
+		return win;
+	}
+
+	// effective sample size of the particles of all islands, weighted with
+	// the island weights, in the last step before resampling
+	double effectiveSampleSize() const {
+		return ess;
+	}
+
+	// number of particles of all islands
+	size_t particleCount() const {
+		return total_particles;
+	}
+
+	// logarithm of the weight of this island relative to the largest one
+	double logIslandWeight() const {
+		return log_weight;
+	}
+
+	// bytes of the messages sent by this island
+	uint64_t bytesSent() const {
+		return bytes_sent;
+	}
+
+private:
+	enum {SummarySection = 32, MigrantsSection};
+
+	struct Summary {
+		double log_weight, ess;
+		uint64_t particles;
+		Winner winner;
+	};
+
+	void send(unsigned int to, const std::vector<char>& message) {
+		transport.send(to, message);
+		bytes_sent += message.size();
+	}
+
+	// Weighted mean of the winners and global effective sample size. The
+	// island weights are scaled so the largest one is 1. Every island sums in
+	// the order of the ranks, so all get the same results.
+	Winner combine() {
+		const double inf = std::numeric_limits<double>::infinity();
+		double lmax = -inf;
+		for(const auto& s : summaries)
+			lmax = std::max(lmax, s.log_weight);
+		for(auto& s : summaries) // equal weights if all are zero
+			s.log_weight = lmax == -inf ? 0 : s.log_weight - lmax;
+		log_weight = summaries[rank()].log_weight;
+
+		double total = 0;
+		for(const auto& s : summaries)
+			total += std::exp(s.log_weight);
+
+		Winner win = summaries[0].winner;
+		scale_winner(win, std::exp(summaries[0].log_weight) / total);
+		double sq = 0;
+		total_particles = 0;
+		for(size_t k = 0; k < summaries.size(); ++k) {
+			const double a = std::exp(summaries[k].log_weight) / total;
+			if(k > 0)
+				add_winner(win, summaries[k].winner, a);
+			if(summaries[k].ess > 0)
+				sq += a * a / summaries[k].ess;
+			total_particles += summaries[k].particles;
+		}
+		ess = sq > 0 ? 1 / sq : 0;
+		return win;
+	}
+
+	// the neighbours particles are sent to and received from
+	void neighbours(std::vector<unsigned int>& to, std::vector<unsigned int>& from) const {
+		to.clear();
+		from.clear();
+		const unsigned int n = islands(), r = rank();
+		if(topology == Ring) {
+			to.push_back((r + 1) % n);
+			from.push_back((r + n - 1) % n);
+			return;
+		}
+		for(unsigned int k = 0; k < n; ++k)
+			if(k != r) {
+				to.push_back(k);
+				from.push_back(k);
+			}
+	}
+
+	// Sends evenly spaced particles to the neighbours, the slots sent to the
+	// i-th neighbour are filled with the particles of the i-th source.
+	void exchange() {
+		std::vector<unsigned int> to, from;
+		neighbours(to, from);
+		const size_t n = pf.particleCount(), m = std::min(migrants, n);
+		slots.resize(to.size());
+		for(auto& s : slots)
+			s.clear();
+		for(size_t k = 0; k < m; ++k)
+			slots[k % to.size()].push_back((2*k + 1) * n / (2*m));
+
+		for(size_t i = 0; i < to.size(); ++i) {
+			gather(pf.getParticles(), slots[i], batch);
+			snapshot::Writer w;
+			w.begin_section(MigrantsSection);
+			snapshot::write_particles(w, batch);
+			w.end_section();
+			send(to[i], w.data());
+		}
+
+		// island weight of the mixed particle set, each particle carries the
+		// weight of its island divided by the number of its particles
+		double mass = std::exp(log_weight);
+		for(size_t i = 0; i < from.size(); ++i) {
+			transport.receive(from[i], buffer);
+			snapshot::Reader r(buffer.data(), buffer.size());
+			if(!r.find_section(MigrantsSection))
+				throw std::runtime_error("IslandFilter: unexpected message");
+			snapshot::read_particles(r, batch);
+
+			const Summary& s = summaries[from[i]];
+			const size_t k = std::min<size_t>(batch.size(), slots[i].size());
+			slots[i].resize(k);
+			batch.resize(k);
+			pf.replaceParticles(batch, slots[i]);
+			if(n > 0 && s.particles > 0)
+				mass += k * (std::exp(s.log_weight) / s.particles - std::exp(log_weight) / n);
+		}
+		log_weight = std::log(mass);
+	}
+
+	Transport transport;
+	Filter pf;
+
+	Topology topology;
+	unsigned int interval;
+	size_t migrants, step_count;
+
+	double log_weight, ess;
+	size_t total_particles;
+	uint64_t bytes_sent;
+
+	// workspaces reused by every step
+	std::vector<Summary> summaries;
+	std::vector<char> buffer;
+	std::vector<std::vector<size_t> > slots;
+	Particles batch;
+};
+
+}}
+
+#endif
@@ -8,65 +8,199 @@
 #include <type_traits>
 #include <algorithm>
 
+#include "policy.h"
+#include "storage.h"
+#include "rng.h"
+
 namespace policy_pf {
 namespace noise_policies {
 
-// GaussianNoiseBase encapsulates a gaussian distributed random number generator
-template<typename FloatingType>
+// GaussianNoiseBase encapsulates gaussian distributed random number generators
+// of type RNG (see rng.h). There is one independent stream per thread of the
+// particle filter; stream k is seeded with (seed, k).
+template<typename FloatingType, typename RNG = rng::Default>
 class GaussianNoiseBase {
 public:
+	GaussianNoiseBase() : streams(1), sigma(1), seed(0), seeded(false) {}
+
 	inline void setNoiseSigma(FloatingType sigma) {
-		uni_rand = std::normal_distribution<FloatingType>(0, sigma);
+		this->sigma = sigma;
+	}
+
+	void setNoiseSeed(unsigned int seed) {
+		this->seed = seed;
+		seeded = true;
+		for(size_t k = 0; k < streams.size(); ++k)
+			seed_stream(k);
+	}
+
+	// called by the particle filter when the number of threads changes
+	void setNoiseStreams(unsigned int num_streams) {
+		size_t old_size = streams.size();
+		streams.resize(num_streams > 0 ? num_streams : 1);
+		for(size_t k = old_size; k < streams.size(); ++k)
+			seed_stream(k);
+	}
+
+	// saves sigma, the seed and the state of every stream to a snapshot
+	template<typename Writer>
+	void save_state(Writer& w) const {
+		w.write(sigma);
+		w.write(seed);
+		w.write(seeded);
+		w.write(uint64_t(streams.size()));
+		for(const auto& s : streams)
+			s.save_state(w);
+	}
+
+	// the particle filter adapts the number of streams to its threads afterwards
+	template<typename Reader>
+	void load_state(Reader& r) {
+		uint64_t n;
+		r.read(sigma);
+		r.read(seed);
+		r.read(seeded);
+		r.read(n);
+		streams.assign(n > 0 ? n : 1, RNG());
+		for(size_t k = 0; k < n; ++k)
+			streams[k].load_state(r);
 	}
 
 protected:
-	inline FloatingType random() {
-		return uni_rand(generator);
+	inline FloatingType random(unsigned int stream = 0) {
+		return sigma * streams[stream].template normal<FloatingType>();
+	}
+
+	// adds noise to the n contiguous numbers x, generated in blocks
+	template<typename T>
+	void add_noise(T* x, size_t n, unsigned int stream) {
+		T z[256];
+		for(size_t i = 0; i < n; i += 256) {
+			const size_t m = std::min<size_t>(256, n - i);
+			streams[stream].normal(z, m);
+			for(size_t j = 0; j < m; ++j)
+				x[i+j] += T(sigma) * z[j];
+		}
 	}
 
 private:
-	std::default_random_engine generator;
-	std::normal_distribution<FloatingType> uni_rand;
+	// stream 0 keeps the default seed of the generator unless a seed is set
+	void seed_stream(size_t k) {
+		if(k == 0 && !seeded)
+			return;
+		streams[k].seed(seed, k);
+	}
+
+	std::vector<RNG> streams;
+	FloatingType sigma;
+	unsigned int seed;
+	bool seeded;
 };
 
 // compilation fails if no type trait is applicable
-template<typename State, typename Enable = void>
+template<typename State, typename RNG = rng::Default, typename Enable = void>
 class AutoDetect;
 
 // implementation for scalar floating point types
-template<typename State>
-class AutoDetect<State, typename std::enable_if<std::is_floating_point<State>::value >::type>
-	: public GaussianNoiseBase<State> {
+template<typename State, typename RNG>
+class AutoDetect<State, RNG, typename std::enable_if<std::is_floating_point<State>::value >::type>
+	: public GaussianNoiseBase<State, RNG> {
 protected:
-	inline void apply_noise(State& s) {
-		s += this->random();
+	inline void apply_noise(State& s, unsigned int stream = 0) {
+		s += this->random(stream);
+	}
+
+	void apply_noise(std::vector<State>& state_v, size_t begin, size_t end, unsigned int stream) {
+		this->add_noise(state_v.data() + begin, end - begin, stream);
 	}
 };
 
 // recursive implementation for arrays
-template<typename State>
-class AutoDetect<State, typename std::enable_if<std::is_array<State>::value >::type>
-	: public AutoDetect<typename std::remove_extent<State>::type> {
+template<typename State, typename RNG>
+class AutoDetect<State, RNG, typename std::enable_if<std::is_array<State>::value >::type>
+	: public AutoDetect<typename std::remove_extent<State>::type, RNG> {
 protected:
-	inline void apply_noise(State& s) {
+	typedef AutoDetect<typename std::remove_extent<State>::type, RNG> Element;
+
+	inline void apply_noise(State& s, unsigned int stream = 0) {
 		for(size_t i = 0; i < std::extent<State>::value; ++i)
-			AutoDetect<typename std::remove_extent<State>::type>::apply_noise(s[i]);
+			Element::apply_noise(s[i], stream);
+	}
+
+	void apply_noise(std::vector<State>& state_v, size_t begin, size_t end, unsigned int stream) {
+		apply_range(state_v, begin, end, stream,
+			std::is_floating_point<typename std::remove_all_extents<State>::type>());
+	}
+
+private:
+	// arrays of floating point numbers are contiguous
+	void apply_range(std::vector<State>& state_v, size_t begin, size_t end, unsigned int stream, std::true_type) {
+		typedef typename std::remove_all_extents<State>::type T;
+		this->add_noise(reinterpret_cast<T*>(state_v.data() + begin),
+			(end - begin) * (sizeof(State) / sizeof(T)), stream);
+	}
+
+	void apply_range(std::vector<State>& state_v, size_t begin, size_t end, unsigned int stream, std::false_type) {
+		for(size_t i = begin; i < end; ++i)
+			apply_noise(state_v[i], stream);
 	}
 };
 
 // recursive implementation for standard container types vector, deque and array
-template <typename T> struct isContainer {static const bool value = false;};
-template <typename T> struct isContainer<std::vector<T> > {static const bool value = true;};
-template <typename T> struct isContainer<std::deque<T> > {static const bool value = true;};
-template <typename T, int N> struct isContainer<std::array<T, N> > {static const bool value = true;};
-
-template<typename State>
-class AutoDetect<State, typename std::enable_if<isContainer<State>::value >::type>
-	: public AutoDetect<typename State::value_type> {
+template<typename State, typename RNG>
+class AutoDetect<State, RNG, typename std::enable_if<isContainer<State>::value
+		|| (isFixedArray<State>::value && !std::is_array<State>::value) >::type>
+	: public AutoDetect<typename State::value_type, RNG> {
 protected:
-	inline void apply_noise(State& s) {
+	typedef AutoDetect<typename State::value_type, RNG> Element;
+
+	inline void apply_noise(State& s, unsigned int stream = 0) {
 		for(size_t i = 0; i < s.size(); ++i)
-			AutoDetect<typename State::value_type>::apply_noise(s[i]);
+			Element::apply_noise(s[i], stream);
+	}
+
+	void apply_noise(std::vector<State>& state_v, size_t begin, size_t end, unsigned int stream) {
+		for(size_t i = begin; i < end; ++i)
+			apply_contiguous(state_v[i], stream);
+	}
+
+private:
+	// std::vector and std::array of floating point numbers are contiguous
+	template<typename S>
+	typename std::enable_if<std::is_floating_point<typename S::value_type>::value
+		&& !std::is_same<S, std::deque<typename S::value_type> >::value>::type
+	apply_contiguous(S& s, unsigned int stream) {
+		this->add_noise(s.data(), s.size(), stream);
+	}
+
+	template<typename S>
+	typename std::enable_if<!std::is_floating_point<typename S::value_type>::value
+		|| std::is_same<S, std::deque<typename S::value_type> >::value>::type
+	apply_contiguous(S& s, unsigned int stream) {
+		apply_noise(s, stream);
+	}
+};
+
+// implementation for structure of arrays states, fills one column at a time
+template<typename State, typename RNG>
+class AutoDetect<State, RNG, typename std::enable_if<isSoA<State>::value >::type>
+	: public GaussianNoiseBase<typename ParticleStorage<State>::value_type::value_type, RNG> {
+protected:
+	inline void apply_noise(typename ParticleStorage<State>::type& s,
+			size_t begin, size_t end, unsigned int stream = 0) {
+		for(size_t j = 0; j < ParticleStorage<State>::type::dimensions; ++j)
+			this->add_noise(s.column(j) + begin, end - begin, stream);
+	}
+};
+
+// implementation for flat states, the particles [begin, end) are contiguous
+template<typename State, typename RNG>
+class AutoDetect<State, RNG, typename std::enable_if<isFlat<State>::value >::type>
+	: public GaussianNoiseBase<typename ParticleStorage<State>::type::element_type, RNG> {
+protected:
+	inline void apply_noise(typename ParticleStorage<State>::type& s,
+			size_t begin, size_t end, unsigned int stream = 0) {
+		this->add_noise(s.row(begin), (end - begin) * s.dimension(), stream);
 	}
 };
 
@@ -80,14 +214,52 @@ template<typename State> class AutoDetectT : public AutoDetect<State> {};
 
 // Appies gaussian noise based on an ApplicationPolicy;
 // the default policy AutoDetect works for scalar floating point types,
-// (multidimensional) arrays, std::vector, std::deque and std::array
-template<typename State, template<class> class ApplicationPolicy = AutoDetectT>
+// (multidimensional) arrays, std::vector, std::deque, std::array, SoA and Flat
+// states. noise is applied to the whole particle set, or to the particles
+// [begin, end) using the given random stream. The range form only exists if
+// the ApplicationPolicy implements apply_noise for a range or for a single
+// state and a stream; policies which only implement apply_noise(State&) are
+// called on the whole particle set, from one thread.
+template<typename State, template<class> class ApplicationPolicy = AutoDetectT, typename Enable = void>
 class GaussianNoise_ : public ApplicationPolicy<State> {
+private:
+	template<typename T>
+	static typename Dependent<T, GaussianNoise_>::type& self();
+
+	template<typename T = void>
+	auto apply_range(std::vector<State>& state_v, size_t begin, size_t end, unsigned int stream, Rank<1>)
+			-> decltype(self<T>().apply_noise(state_v, begin, end, stream)) {
+		this->apply_noise(state_v, begin, end, stream);
+	}
+
+	template<typename T = void>
+	auto apply_range(std::vector<State>& state_v, size_t begin, size_t end, unsigned int stream, Rank<0>)
+			-> decltype(self<T>().apply_noise(state_v[begin], stream)) {
+		for(size_t i = begin; i < end; ++i)
+			this->apply_noise(state_v[i], stream);
+	}
+
 protected:
 	void noise(std::vector<State>& state_v) {
 		for(size_t i = 0; i < state_v.size(); ++i)
 			this->apply_noise(state_v[i]);
 	}
+
+	template<typename T = void>
+	auto noise(std::vector<State>& state_v, size_t begin, size_t end, unsigned int stream)
+			-> decltype(self<T>().apply_range(state_v, begin, end, stream, Rank<1>())) {
+		apply_range(state_v, begin, end, stream, Rank<1>());
+	}
+};
+
+template<typename State, template<class> class ApplicationPolicy>
+class GaussianNoise_<State, ApplicationPolicy,
+		typename std::enable_if<isSoA<State>::value || isFlat<State>::value >::type>
+	: public ApplicationPolicy<State> {
+protected:
+	void noise(typename ParticleStorage<State>::type& state_v, size_t begin, size_t end, unsigned int stream) {
+		this->apply_noise(state_v, begin, end, stream);
+	}
 };
 
 #if GCC_VERSION >= 40700
@@ -0,0 +1,95 @@
+#ifndef _POLPF_OBSERVATION_MODEL_H_
+#define _POLPF_OBSERVATION_MODEL_H_
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+#include "policy.h"
+#include "storage.h"
+#include "thread_pool.h"
+
+namespace policy_pf {
+
+// Combines a state2obs and a weight policy and calls the most specific form
+// either implements: the range form on the threads of a pool, the form
+// filling a given container, or the form returning a new one. Both the
+// particle filter and Sensor derive from it.
+template<
+	typename StateType,
+	typename ObservationType,
+	typename WeightType,
+	template<class, class> class State2Obs,
+	template<class, class> class WeightPolicy>
+class ObservationModel :
+	public State2Obs<StateType, ObservationType>,
+	public WeightPolicy<WeightType, ObservationType>
+{
+	typedef typename ParticleStorage<StateType>::type Particles;
+	typedef typename ParticleStorage<ObservationType>::type Observations;
+	typedef typename ParticleStorage<ObservationType>::value_type Observation;
+
+protected:
+	// maps the particles to the hypothetical observations hyp_obs
+	void apply_state2obs(const Particles& particles, const Observation& observation, Observations& hyp_obs,
+			ThreadPool* pool) {
+		apply_state2obs(particles, observation, hyp_obs, pool, Rank<2>());
+	}
+
+	// computes the weights of the hypothetical observations
+	void apply_weight(const Observations& hyp_obs, const Observation& observation, std::vector<WeightType>& weight_v,
+			ThreadPool* pool) {
+		apply_weight(hyp_obs, observation, weight_v, pool, Rank<2>());
+	}
+
+private:
+	template<typename T>
+	static typename Dependent<T, ObservationModel>::type& self();
+
+	template<typename T = void>
+	auto apply_state2obs(const Particles& particles, const Observation& observation, Observations& hyp_obs,
+			ThreadPool* pool, Rank<2>) -> decltype(self<T>().state2obs(particles, hyp_obs, size_t(), size_t())) {
+		resize_like(hyp_obs, particles.size(), observation);
+		parallel_for(pool, particles.size(), [this, &particles, &hyp_obs](size_t begin, size_t end, unsigned int) {
+			State2Obs<StateType, ObservationType>::state2obs(particles, hyp_obs, begin, end);
+		});
+	}
+
+	template<typename T = void>
+	auto apply_state2obs(const Particles& particles, const Observation&, Observations& hyp_obs,
+			ThreadPool*, Rank<1>) -> decltype(self<T>().state2obs(particles, hyp_obs)) {
+		State2Obs<StateType, ObservationType>::state2obs(particles, hyp_obs);
+	}
+
+	template<typename T = void>
+	void apply_state2obs(const Particles& particles, const Observation&, Observations& hyp_obs,
+			ThreadPool*, Rank<0>) {
+		hyp_obs = State2Obs<StateType, ObservationType>::state2obs(particles);
+	}
+
+	template<typename T = void>
+	auto apply_weight(const Observations& hyp_obs, const Observation& observation, std::vector<WeightType>& weight_v,
+			ThreadPool* pool, Rank<2>) -> decltype(self<T>().weight(hyp_obs, observation, weight_v, size_t(), size_t())) {
+		weight_v.resize(hyp_obs.size());
+		parallel_for(pool, hyp_obs.size(), [this, &hyp_obs, &observation, &weight_v](size_t begin, size_t end,
+				unsigned int) {
+			WeightPolicy<WeightType, ObservationType>::weight(hyp_obs, observation, weight_v, begin, end);
+		});
+	}
+
+	template<typename T = void>
+	auto apply_weight(const Observations& hyp_obs, const Observation& observation, std::vector<WeightType>& weight_v,
+			ThreadPool*, Rank<1>) -> decltype(self<T>().weight(hyp_obs, observation, weight_v)) {
+		WeightPolicy<WeightType, ObservationType>::weight(hyp_obs, observation, weight_v);
+	}
+
+	template<typename T = void>
+	void apply_weight(const Observations& hyp_obs, const Observation& observation, std::vector<WeightType>& weight_v,
+			ThreadPool*, Rank<0>) {
+		weight_v = WeightPolicy<WeightType, ObservationType>::weight(hyp_obs, observation);
+	}
+};
+
+}
+
+#endif
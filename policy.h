@@ -0,0 +1,19 @@
+#ifndef _POLPF_POLICY_H_
+#define _POLPF_POLICY_H_
+
+namespace policy_pf {
+
+// makes an expression dependent on a template parameter so that the policy
+// interface can be detected using SFINAE
+template<typename T, typename U>
+struct Dependent {
+	typedef U type;
+};
+
+// overloads taking Rank<N> are preferred over those taking Rank<N-1>
+template<unsigned int N> struct Rank : Rank<N-1> {};
+template<> struct Rank<0> {};
+
+}
+
+#endif
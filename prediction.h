@@ -2,6 +2,7 @@
 #define _POLPF_PREDICTION_H_
 
 #include <vector>
+#include <cstddef>
 
 namespace policy_pf {
 namespace prediction_policies {
@@ -9,8 +10,13 @@ namespace prediction_policies {
 template<typename State>
 class None {
 protected:
+	// the whole particle set or the particles [begin, end)
 	void predict(std::vector<State> &state_v) {
 	}
+
+	template<typename Particles>
+	void predict(Particles &state_v, size_t begin, size_t end) {
+	}
 };
 
 }}
@@ -3,25 +3,68 @@
 
 #include <random>
 #include <vector>
-#include <numeric>
+#include <algorithm>
+#include <unordered_set>
+#include <functional>
+#include <cmath>
+
+#include "storage.h"
+#include "thread_pool.h"
+#include "rng.h"
 
 namespace policy_pf {
 namespace resampling_policies {
 
-template<typename State, typename Weight>
-class SystematicResampling {
+template<typename State, typename Weight, typename RNG = rng::Default>
+class SystematicResampling_ {
+public:
+	void setResamplingSeed(unsigned int seed) {
+		generator.seed(seed);
+	}
+
+	template<typename Writer>
+	void save_state(Writer& w) const {
+		generator.save_state(w);
+	}
+
+	template<typename Reader>
+	void load_state(Reader& r) {
+		generator.load_state(r);
+	}
+
 protected:
-	void resampling(std::vector<State> &state_v, std::vector<Weight> &weight_v) {
-	
+	typedef typename ParticleStorage<State>::type Particles;
+	typedef typename Accumulator<Weight>::type Sum;
+
+	// edges and new_state_v are workspaces owned by the caller, so no memory is
+	// allocated once they have reached the size of the particle set
+	void resampling(Particles &state_v, std::vector<Weight> &weight_v,
+			std::vector<Sum> &edges, Particles &new_state_v) {
+		select_ancestors(state_v, weight_v, edges, ancestors, nullptr);
+		for(auto& w : weight_v)
+			w = 1.0 / ancestors.size();
+
+		// copy the selected particles into the second buffer
+		gather(state_v, ancestors, new_state_v);
+		state_v.swap(new_state_v);
+	}
+
+	// Resampling policies may also only select the indices of the particles to
+	// keep (sorted or not), the particle filter then copies the particles.
+	// This policy does not use the thread pool.
+	void select_ancestors(const Particles &, const std::vector<Weight> &weight_v,
+			std::vector<Sum> &edges, std::vector<size_t> &ancestors, ThreadPool*) {
 		unsigned int num_particles = weight_v.size();
 		/*
 		 * Es wird die Kumulative Summe der (normalisierten) Gewichte berechnet, sodass man
 		 * sich edges als Treppe mit je nach Gewicht unterschiedlich hohen Stufen vorstellen kann.
 		 */
-		std::vector<Weight> edges(num_particles + 1, 0);
-        std::partial_sum(weight_v.cbegin(), weight_v.cend(), edges.begin()+1);
-        for(auto& e : edges) e > 1 ? e = 1 : 0;
-        edges.back() = 1;
+		edges.resize(num_particles + 1);
+		edges[0] = 0;
+		Sum sum = 0;
+		for(size_t i = 0; i < num_particles; ++i)
+			edges[i+1] = std::min(sum += weight_v[i], Sum(1));
+		edges.back() = 1;
 
 		/*
 		 * Ein Startwert [0,1/n] wird zufällig gewählt und danach jeweils um 1/n erhöht.
@@ -30,25 +73,451 @@ protected:
 		 * Dadurch wird sichergestellt, dass jedes Partikel proportional häufig zu seinem Gewicht
 		 * ausgewählt wird.
 		 */
-		Weight u1 = uni_rand(generator) / num_particles;
-		std::vector<State> new_state_v;
+		Sum u0 = generator.template uniform<Sum>();
+		ancestors.resize(num_particles);
+
+		size_t i = 1;
+		for(size_t k = 0; k < num_particles; ++k) {
+			Sum u1 = (u0 + k) / num_particles;
+			while(i < num_particles && !(u1 < edges[i]))
+				++i;
+			ancestors[k] = i-1;
+		}
+	}
+
+private:
+	std::vector<size_t> ancestors;
+	RNG generator;
+};
+
+#if GCC_VERSION >= 40700
+// Workaround for g++ 4.7
+template<typename State, typename Weight>
+using SystematicResampling = SystematicResampling_<State, Weight>;
+#else
+// Workaround for g++ 4.6
+template<typename State, typename Weight>
+class SystematicResampling : public SystematicResampling_<State, Weight> {};
+#endif
+
+// ParallelResamplingBase contains the parts shared by the resampling policies
+// which use the thread pool of the particle filter: one random stream per
+// thread, stream k is seeded with the seed sequence (seed, k), and the
+// parallel copy of the selected particles. The results are reproducible for
+// a given seed and number of threads.
+template<typename State, typename Weight, typename RNG = rng::Default>
+class ParallelResamplingBase {
+public:
+	ParallelResamplingBase() : seed(0) {}
+
+	void setResamplingSeed(unsigned int seed) {
+		this->seed = seed;
+		streams.clear();
+	}
+
+	template<typename Writer>
+	void save_state(Writer& w) const {
+		w.write(seed);
+		w.write(uint64_t(streams.size()));
+		for(const auto& s : streams)
+			s.save_state(w);
+	}
+
+	template<typename Reader>
+	void load_state(Reader& r) {
+		uint64_t n;
+		r.read(seed);
+		r.read(n);
+		streams.assign(n, RNG());
+		for(auto& s : streams)
+			s.load_state(r);
+	}
+
+protected:
+	typedef typename ParticleStorage<State>::type Particles;
+
+	RNG& stream(unsigned int k) {
+		return streams[k];
+	}
 
-		for(size_t i = 1; i < edges.size(); ++i) {
-			while(u1 < edges[i]) {
-				new_state_v.push_back(state_v[i-1]);
-				u1 += 1.0 / num_particles;
+	void prepare_streams(ThreadPool* pool) {
+		size_t old_size = streams.size();
+		streams.resize(num_chunks(pool));
+		for(size_t k = old_size; k < streams.size(); ++k)
+			streams[k].seed(seed, k);
+	}
+
+	// copies the particles selected in ancestors into the second buffer and
+	// resets the weights
+	void finish(Particles &state_v, std::vector<Weight> &weight_v, Particles &new_state_v, ThreadPool* pool) {
+		const size_t n = ancestors.size();
+		resize_like(new_state_v, n, state_v);
+		parallel_for(pool, n, [&](size_t begin, size_t end, unsigned int) {
+			gather(state_v, ancestors, new_state_v, begin, end);
+			for(size_t k = begin; k < end; ++k)
+				weight_v[k] = 1.0 / n;
+		});
+		state_v.swap(new_state_v);
+	}
+
+	std::vector<size_t> ancestors;
+
+private:
+	std::vector<RNG> streams;
+	unsigned int seed;
+};
+
+// Systematic (or stratified) resampling on a parallel prefix sum of the weights.
+// Every thread locates the start of its range of output slots with a binary
+// search and walks the cumulative sum from there. Systematic resampling selects
+// the same particles as SystematicResampling given the same random offset.
+template<typename State, typename Weight, bool Stratified = false, typename RNG = rng::Default>
+class PrefixSumResampling : public ParallelResamplingBase<State, Weight, RNG> {
+protected:
+	typedef typename ParticleStorage<State>::type Particles;
+	typedef typename Accumulator<Weight>::type Sum;
+
+	void resampling(Particles &state_v, std::vector<Weight> &weight_v,
+			std::vector<Sum> &edges, Particles &new_state_v, ThreadPool* pool) {
+		select_ancestors(state_v, weight_v, edges, this->ancestors, pool);
+		this->finish(state_v, weight_v, new_state_v, pool);
+	}
+
+	void select_ancestors(const Particles &, const std::vector<Weight> &weight_v,
+			std::vector<Sum> &edges, std::vector<size_t> &ancestors, ThreadPool* pool) {
+		const size_t n = weight_v.size();
+		this->prepare_streams(pool);
+		prefix_sum(weight_v, edges, pool);
+		ancestors.resize(n);
+
+		Sum u0 = this->stream(0).template uniform<Sum>();
+		parallel_for(pool, n, [&](size_t begin, size_t end, unsigned int t) {
+			auto& s = this->stream(t);
+			size_t i = 0;
+			for(size_t k = begin; k < end; ++k) {
+				Sum u1 = ((Stratified ? s.template uniform<Sum>() : u0) + k) / n;
+				if(k == begin)
+					i = std::upper_bound(edges.begin() + 1, edges.begin() + n, u1) - edges.begin();
+				while(i < n && !(u1 < edges[i]))
+					++i;
+				ancestors[k] = i-1;
 			}
-			weight_v[i-1] = 1.0 / num_particles;
+		});
+	}
+
+private:
+	// edges = (0, w0, w0+w1, ..., 1): every thread sums up its range, the
+	// offsets of the ranges are summed up serially and added in a second pass
+	void prefix_sum(const std::vector<Weight> &weight_v, std::vector<Sum> &edges, ThreadPool* pool) {
+		const size_t n = weight_v.size();
+		edges.resize(n + 1);
+		edges[0] = 0;
+		offsets.resize(num_chunks(pool));
+
+		parallel_for(pool, n, [&](size_t begin, size_t end, unsigned int t) {
+			Sum sum = 0;
+			for(size_t i = begin; i < end; ++i)
+				edges[i+1] = sum += weight_v[i];
+			offsets[t] = sum;
+		});
+
+		Sum sum = 0;
+		for(auto& o : offsets) {
+			Sum chunk = o;
+			o = sum;
+			sum += chunk;
 		}
 
-		state_v = new_state_v;
+		parallel_for(pool, n, [&](size_t begin, size_t end, unsigned int t) {
+			for(size_t i = begin + 1; i <= end; ++i) {
+				edges[i] += offsets[t];
+				if(edges[i] > 1)
+					edges[i] = 1;
+			}
+		});
+		edges.back() = 1;
+	}
+
+	std::vector<Sum> offsets;
+};
+
+template<typename State, typename Weight>
+class ParallelSystematicResampling : public PrefixSumResampling<State, Weight, false> {};
+
+template<typename State, typename Weight>
+class StratifiedResampling : public PrefixSumResampling<State, Weight, true> {};
+
+// Metropolis resampling (Murray et al.) only compares the weights of pairs of
+// particles and needs no cumulative sum. It is biased for a small number of
+// iterations, which should grow with the variance of the weights.
+template<typename State, typename Weight, typename RNG = rng::Default>
+class MetropolisResampling_ : public ParallelResamplingBase<State, Weight, RNG> {
+public:
+	MetropolisResampling_() : iterations(32) {}
+
+	void setMetropolisIterations(unsigned int iterations) {
+		this->iterations = iterations;
+	}
+
+	template<typename Writer>
+	void save_state(Writer& w) const {
+		w.write(iterations);
+		ParallelResamplingBase<State, Weight, RNG>::save_state(w);
+	}
+
+	template<typename Reader>
+	void load_state(Reader& r) {
+		r.read(iterations);
+		ParallelResamplingBase<State, Weight, RNG>::load_state(r);
+	}
+
+protected:
+	typedef typename ParticleStorage<State>::type Particles;
+	typedef typename Accumulator<Weight>::type Sum;
+
+	void resampling(Particles &state_v, std::vector<Weight> &weight_v,
+			std::vector<Sum> &edges, Particles &new_state_v, ThreadPool* pool) {
+		select_ancestors(state_v, weight_v, edges, this->ancestors, pool);
+		this->finish(state_v, weight_v, new_state_v, pool);
+	}
+
+	void select_ancestors(const Particles &, const std::vector<Weight> &weight_v,
+			std::vector<Sum> &, std::vector<size_t> &ancestors, ThreadPool* pool) {
+		const size_t n = weight_v.size();
+		this->prepare_streams(pool);
+		ancestors.resize(n);
+
+		parallel_for(pool, n, [&](size_t begin, size_t end, unsigned int t) {
+			auto& s = this->stream(t);
+			for(size_t i = begin; i < end; ++i) {
+				size_t k = i;
+				for(unsigned int b = 0; b < iterations; ++b) {
+					size_t j = s.below(n);
+					if(s.template uniform<Weight>() * weight_v[k] <= weight_v[j])
+						k = j;
+				}
+				ancestors[i] = k;
+			}
+		});
+	}
+
+private:
+	unsigned int iterations;
+};
+
+// Rejection resampling (Murray et al.) is unbiased and only needs the maximum
+// weight. Its run time grows with the ratio of the maximum to the mean weight.
+template<typename State, typename Weight, typename RNG = rng::Default>
+class RejectionResampling_ : public ParallelResamplingBase<State, Weight, RNG> {
+protected:
+	typedef typename ParticleStorage<State>::type Particles;
+	typedef typename Accumulator<Weight>::type Sum;
+
+	void resampling(Particles &state_v, std::vector<Weight> &weight_v,
+			std::vector<Sum> &edges, Particles &new_state_v, ThreadPool* pool) {
+		select_ancestors(state_v, weight_v, edges, this->ancestors, pool);
+		this->finish(state_v, weight_v, new_state_v, pool);
+	}
+
+	void select_ancestors(const Particles &, const std::vector<Weight> &weight_v,
+			std::vector<Sum> &, std::vector<size_t> &ancestors, ThreadPool* pool) {
+		const size_t n = weight_v.size();
+		this->prepare_streams(pool);
+		ancestors.resize(n);
+
+		partial_max.resize(num_chunks(pool));
+		parallel_for(pool, n, [&](size_t begin, size_t end, unsigned int t) {
+			partial_max[t] = 0;
+			for(size_t i = begin; i < end; ++i)
+				partial_max[t] = std::max(partial_max[t], weight_v[i]);
+		});
+		const Weight wmax = *std::max_element(partial_max.cbegin(), partial_max.cend());
+
+		parallel_for(pool, n, [&](size_t begin, size_t end, unsigned int t) {
+			auto& s = this->stream(t);
+			for(size_t i = begin; i < end; ++i) {
+				size_t j = i;
+				while(s.template uniform<Weight>() * wmax > weight_v[j])
+					j = s.below(n);
+				ancestors[i] = j;
+			}
+		});
+	}
+
+private:
+	std::vector<Weight> partial_max;
+};
+
+
+// hash of the histogram bin of a state, each dimension is divided into bins
+// of the given size
+template<typename T>
+typename std::enable_if<std::is_arithmetic<T>::value>::type
+hash_bin(const T& x, double bin_size, size_t& h) {
+	long long b = (long long) std::floor(x / bin_size);
+	h ^= std::hash<long long>()(b) + 0x9e3779b9 + (h << 6) + (h >> 2);
+}
+
+template<typename T, size_t N>
+void hash_bin(const T (&x)[N], double bin_size, size_t& h) {
+	for(size_t j = 0; j < N; ++j)
+		hash_bin(x[j], bin_size, h);
+}
+
+template<typename Container>
+auto hash_bin(const Container& x, double bin_size, size_t& h) -> decltype(x.begin(), void()) {
+	for(const auto& v : x)
+		hash_bin(v, bin_size, h);
+}
+
+template<typename State>
+size_t bin_of(const std::vector<State>& state_v, size_t i, double bin_size) {
+	size_t h = 0;
+	hash_bin(state_v[i], bin_size, h);
+	return h;
+}
+
+template<typename T, size_t N>
+size_t bin_of(const SoAVector<T, N>& state_v, size_t i, double bin_size) {
+	size_t h = 0;
+	for(size_t j = 0; j < N; ++j)
+		hash_bin(state_v(i, j), bin_size, h);
+	return h;
+}
+
+template<typename T>
+size_t bin_of(const FlatVector<T>& state_v, size_t i, double bin_size) {
+	size_t h = 0;
+	hash_bin(state_v[i], bin_size, h);
+	return h;
+}
+
+// KLD-sampling (Fox) draws particles until their number is large enough that
+// the KL divergence between the sample based and the true posterior is below
+// epsilon with probability 1 - delta, where z is the upper 1 - delta quantile
+// of the standard normal distribution. The bound grows with the number of
+// occupied histogram bins, so a tight posterior needs few particles.
+// The number of particles changes between the steps.
+template<typename State, typename Weight, typename RNG = rng::Default>
+class KLDResampling_ : public ParallelResamplingBase<State, Weight, RNG> {
+public:
+	KLDResampling_() : min_particles(100), max_particles(100000),
+		bin_size(1), epsilon(0.05), z(2.326) {}
+
+	void setKLDBounds(size_t min_particles, size_t max_particles) {
+		this->min_particles = min_particles;
+		this->max_particles = std::max(min_particles, max_particles);
+	}
+
+	void setKLDBinSize(double bin_size) {
+		this->bin_size = bin_size;
+	}
+
+	void setKLDError(double epsilon) {
+		this->epsilon = epsilon;
+	}
+
+	void setKLDQuantile(double z) {
+		this->z = z;
+	}
+
+	template<typename Writer>
+	void save_state(Writer& w) const {
+		w.write(uint64_t(min_particles));
+		w.write(uint64_t(max_particles));
+		w.write(bin_size);
+		w.write(epsilon);
+		w.write(z);
+		ParallelResamplingBase<State, Weight, RNG>::save_state(w);
+	}
+
+	template<typename Reader>
+	void load_state(Reader& r) {
+		uint64_t lo, hi;
+		r.read(lo);
+		r.read(hi);
+		r.read(bin_size);
+		r.read(epsilon);
+		r.read(z);
+		min_particles = lo;
+		max_particles = hi;
+		ParallelResamplingBase<State, Weight, RNG>::load_state(r);
 	}
-	
+
+protected:
+	typedef typename ParticleStorage<State>::type Particles;
+	typedef typename Accumulator<Weight>::type Sum;
+
+	void resampling(Particles &state_v, std::vector<Weight> &weight_v,
+			std::vector<Sum> &edges, Particles &new_state_v, ThreadPool* pool) {
+		select_ancestors(state_v, weight_v, edges, this->ancestors, pool);
+		weight_v.resize(this->ancestors.size());
+		this->finish(state_v, weight_v, new_state_v, pool);
+	}
+
+	void select_ancestors(const Particles &state_v, const std::vector<Weight> &weight_v,
+			std::vector<Sum> &edges, std::vector<size_t> &ancestors, ThreadPool* pool) {
+		const size_t n = weight_v.size();
+		this->prepare_streams(pool);
+
+		edges.resize(n + 1);
+		edges[0] = 0;
+		Sum sum = 0;
+		for(size_t i = 0; i < n; ++i)
+			edges[i+1] = sum += weight_v[i];
+		edges.back() = 1;
+
+		// draws particles until the bound for the number of occupied bins is reached
+		auto& s = this->stream(0);
+		ancestors.clear();
+		bins.clear();
+		size_t needed = min_particles;
+		while(ancestors.size() < std::max(needed, min_particles) && ancestors.size() < max_particles) {
+			Sum u = s.template uniform<Sum>();
+			size_t i = std::upper_bound(edges.begin() + 1, edges.begin() + n, u) - edges.begin() - 1;
+			ancestors.push_back(i);
+			if(bins.insert(bin_of(state_v, i, bin_size)).second)
+				needed = bound(bins.size());
+		}
+	}
+
 private:
-	std::default_random_engine generator;
-	std::uniform_real_distribution<Weight> uni_rand;
+	// Wilson-Hilferty approximation of the chi-square quantile
+	size_t bound(size_t k) const {
+		if(k < 2)
+			return 0;
+		double a = 2.0 / (9.0 * (k-1));
+		double b = 1 - a + std::sqrt(a) * z;
+		return (size_t) std::ceil((k-1) / (2*epsilon) * b*b*b);
+	}
+
+	std::unordered_set<size_t> bins;
+	size_t min_particles, max_particles;
+	double bin_size, epsilon, z;
 };
 
+#if GCC_VERSION >= 40700
+// Workaround for g++ 4.7
+template<typename State, typename Weight>
+using MetropolisResampling = MetropolisResampling_<State, Weight>;
+
+template<typename State, typename Weight>
+using RejectionResampling = RejectionResampling_<State, Weight>;
+
+template<typename State, typename Weight>
+using KLDResampling = KLDResampling_<State, Weight>;
+#else
+// Workaround for g++ 4.6
+template<typename State, typename Weight>
+class MetropolisResampling : public MetropolisResampling_<State, Weight> {};
+
+template<typename State, typename Weight>
+class RejectionResampling : public RejectionResampling_<State, Weight> {};
+
+template<typename State, typename Weight>
+class KLDResampling : public KLDResampling_<State, Weight> {};
+#endif
+
 }}
 
 #endif
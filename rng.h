@@ -0,0 +1,234 @@
+#ifndef _POLPF_RNG_H_
+#define _POLPF_RNG_H_
+
+#include <random>
+#include <sstream>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+namespace policy_pf {
+namespace rng {
+
+// The random number generators used by the noise, init and resampling
+// policies. A generator provides
+//   seed(seed, stream)  independent streams for the same seed
+//   uniform<T>()        uniform number in [0, 1)
+//   below(n)            uniform integer in [0, n)
+//   normal<T>()         standard normal number
+//   normal<T>(out, n)   n standard normal numbers
+//   save_state, load_state  write and read the state to a snapshot (see snapshot.h)
+
+// Tables of the ziggurat method (Marsaglia, Tsang) with 128 layers of equal
+// area under the density exp(-x^2/2); layer 0 is the base strip with the tail.
+struct Ziggurat {
+	static const Ziggurat& table() {
+		static const Ziggurat t;
+		return t;
+	}
+
+	static double f(double x) {
+		return std::exp(-0.5 * x*x);
+	}
+
+	static constexpr double r = 3.442619855899;
+	double x[129], fx[129];
+
+private:
+	Ziggurat() {
+		const double v = 9.91256303526217e-3;
+		x[0] = v / f(r);
+		x[1] = r;
+		for(size_t i = 1; i < 127; ++i)
+			x[i+1] = std::sqrt(-2 * std::log(v / x[i] + f(x[i])));
+		x[128] = 0;
+		for(size_t i = 0; i < 129; ++i)
+			fx[i] = f(x[i]);
+	}
+};
+
+// xoshiro256++ (Blackman, Vigna) with normal numbers from the ziggurat method.
+// Stream k starts 2^128 * k numbers after the start of stream 0, so the
+// streams never overlap.
+class Xoshiro {
+public:
+	typedef uint64_t result_type;
+
+	Xoshiro() {
+		seed(0);
+	}
+
+	void seed(uint64_t seed, uint64_t stream = 0) {
+		// splitmix64 expands the seed into the state
+		for(size_t i = 0; i < 4; ++i) {
+			seed += 0x9e3779b97f4a7c15ULL;
+			uint64_t z = seed;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			s[i] = z ^ (z >> 31);
+		}
+		for(uint64_t k = 0; k < stream; ++k)
+			jump();
+	}
+
+	static constexpr uint64_t min() {
+		return 0;
+	}
+
+	static constexpr uint64_t max() {
+		return ~uint64_t(0);
+	}
+
+	uint64_t operator()() {
+		const uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+		const uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+
+	// advances the generator by 2^128 numbers
+	void jump() {
+		static const uint64_t jump_poly[] = {
+			0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+		uint64_t t[4] = {0, 0, 0, 0};
+		for(size_t i = 0; i < 4; ++i) {
+			for(size_t b = 0; b < 64; ++b) {
+				if(jump_poly[i] & (uint64_t(1) << b))
+					for(size_t j = 0; j < 4; ++j)
+						t[j] ^= s[j];
+				(*this)();
+			}
+		}
+		for(size_t j = 0; j < 4; ++j)
+			s[j] = t[j];
+	}
+
+	// uses as many bits as T can represent exactly, so the result is below 1
+	template<typename T>
+	T uniform() {
+		return sizeof(T) <= sizeof(float)
+			? T((*this)() >> 40) * T(1.0 / 16777216.0)
+			: T((*this)() >> 11) * T(1.0 / 9007199254740992.0);
+	}
+
+	// the modulo bias is below n / 2^64
+	uint64_t below(uint64_t n) {
+		return (*this)() % n;
+	}
+
+	template<typename T>
+	T normal() {
+		return T(ziggurat(Ziggurat::table()));
+	}
+
+	template<typename T>
+	void normal(T* out, size_t n) {
+		const Ziggurat& table = Ziggurat::table();
+		for(size_t i = 0; i < n; ++i)
+			out[i] = T(ziggurat(table));
+	}
+
+	template<typename Writer>
+	void save_state(Writer& w) const {
+		w.write(s);
+	}
+
+	template<typename Reader>
+	void load_state(Reader& r) {
+		r.read(s);
+	}
+
+private:
+	static uint64_t rotl(uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+
+	// one random number selects the layer (7 bits), the sign (1 bit) and the
+	// position in the layer (53 bits); about 99% of the numbers are accepted
+	// by the first comparison
+	double ziggurat(const Ziggurat& t) {
+		for(;;) {
+			const uint64_t u = (*this)();
+			const size_t i = u & 127;
+			const double sign = (u & 128) ? -1 : 1;
+			const double z = double(int64_t(u >> 11)) * (1.0 / 9007199254740992.0) * t.x[i];
+			if(z < t.x[i+1])
+				return sign * z;
+
+			if(i == 0) { // tail beyond r
+				double a, b;
+				do {
+					a = -std::log(1 - uniform<double>()) / Ziggurat::r;
+					b = -std::log(1 - uniform<double>());
+				} while(2*b < a*a);
+				return sign * (Ziggurat::r + a);
+			}
+
+			if(t.fx[i] + uniform<double>() * (t.fx[i+1] - t.fx[i]) < Ziggurat::f(z))
+				return sign * z;
+		}
+	}
+
+	uint64_t s[4];
+};
+
+// std::default_random_engine with the distributions of the standard library,
+// the generators used before Xoshiro was added
+class Standard {
+public:
+	void seed(uint64_t seed, uint64_t stream = 0) {
+		std::seed_seq seq = {(unsigned int) seed, (unsigned int) stream};
+		generator.seed(seq);
+		gauss.reset();
+	}
+
+	template<typename T>
+	T uniform() {
+		return std::uniform_real_distribution<T>()(generator);
+	}
+
+	uint64_t below(uint64_t n) {
+		return std::uniform_int_distribution<uint64_t>(0, n-1)(generator);
+	}
+
+	template<typename T>
+	T normal() {
+		return T(gauss(generator));
+	}
+
+	template<typename T>
+	void normal(T* out, size_t n) {
+		for(size_t i = 0; i < n; ++i)
+			out[i] = normal<T>();
+	}
+
+	// the state of the standard library generators is only available as text
+	template<typename Writer>
+	void save_state(Writer& w) const {
+		std::ostringstream s;
+		s << generator << ' ' << gauss;
+		w.write_string(s.str());
+	}
+
+	template<typename Reader>
+	void load_state(Reader& r) {
+		std::istringstream s(r.read_string());
+		s >> generator >> gauss;
+	}
+
+private:
+	std::default_random_engine generator;
+	std::normal_distribution<double> gauss;
+};
+
+typedef Xoshiro Default;
+
+}}
+
+#endif
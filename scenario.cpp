@@ -0,0 +1,633 @@
+#include <vector>
+#include <array>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ParticleFilter.h"
+
+// End-to-end scenarios: the observations and the ground truth of a model are
+// recorded to a file and replayed through particle filters of different
+// configurations and particle counts.
+// usage: scenario record <model> <file> [--steps T] [--seed S]
+//        scenario replay <file> [--particles N,...] [--threads K] [--json]
+//        scenario [--steps T] [--seed S] [--particles N,...] [--threads K] [--json]
+// The last form records every model in memory and replays it.
+//
+// Models: growth (the univariate nonstationary growth model of example.cpp),
+// cv2d and cv3d (constant velocity targets in 2 and 3 dimensions observed by
+// their position). The noise of the simulation is drawn from rng::Xoshiro,
+// so a recording only depends on the model, the seed and the number of steps.
+//
+// For every configuration and particle count the RMSE of the estimate (of
+// the position for the tracking models), the steps per second, the median
+// and 99th percentile of the step latency and the peak resident memory are
+// reported, as CSV or as JSON. The filters are seeded with the seed of the
+// recording, so a replay with the same number of threads always gives the
+// same estimates; their hash is reported to compare runs. Every replay runs
+// in its own process, so its peak memory is not hidden by earlier replays.
+
+using namespace policy_pf;
+
+// the sections of a recording, stored in the snapshot format
+enum ScenarioSection {
+	ModelSection = 64, TruthSection, ObservationSection
+};
+
+// truth and observations of all steps, row by row
+struct Scenario {
+	std::string model;
+	uint32_t seed;
+	uint64_t steps, state_dim, obs_dim;
+	std::vector<double> truth, observations;
+};
+
+// ---- models ----
+
+double growth(double x, int k) {
+	return x/2.0 + 25*x/(1+x*x) + 8*cos(1.2*k);
+}
+
+double growth_observation(double x) {
+	return x*x / 20.0;
+}
+
+const double GrowthNoise = std::sqrt(10.0), GrowthInit = std::sqrt(10.0);
+const double CvNoise = 0.5, CvInit = 2.0;
+
+Scenario simulate(const std::string& model, uint64_t steps, uint32_t seed) {
+	Scenario sc = {model, seed, steps, 0, 0, {}, {}};
+	rng::Xoshiro gen;
+	gen.seed(seed);
+
+	if(model == "growth") {
+		sc.state_dim = sc.obs_dim = 1;
+		double x = 0;
+		for(uint64_t k = 1; k <= steps; ++k) {
+			x = growth(x, k) + GrowthNoise * gen.normal<double>();
+			sc.truth.push_back(x);
+			sc.observations.push_back(growth_observation(x) + gen.normal<double>());
+		}
+		return sc;
+	}
+
+	if(model != "cv2d" && model != "cv3d")
+		throw std::invalid_argument("scenario: unknown model " + model);
+
+	// position and velocity, every component with the noise of the filter
+	const size_t d = model == "cv2d" ? 2 : 3;
+	sc.state_dim = 2*d;
+	sc.obs_dim = d;
+	std::vector<double> x(2*d, 0);
+	for(uint64_t k = 1; k <= steps; ++k) {
+		for(size_t j = 0; j < d; ++j)
+			x[j] += x[j + d];
+		for(auto& v : x)
+			v += CvNoise * gen.normal<double>();
+		sc.truth.insert(sc.truth.end(), x.begin(), x.end());
+		for(size_t j = 0; j < d; ++j)
+			sc.observations.push_back(x[j] + gen.normal<double>());
+	}
+	return sc;
+}
+
+// ---- recordings ----
+
+void save(const Scenario& sc, const std::string& filename) {
+	snapshot::Writer w;
+	w.begin_section(ModelSection);
+	w.write_string(sc.model);
+	w.write(sc.seed);
+	w.write(sc.steps);
+	w.write(sc.state_dim);
+	w.write(sc.obs_dim);
+	w.end_section();
+
+	w.begin_section(TruthSection);
+	w.write_array(sc.truth.data(), sc.truth.size());
+	w.end_section();
+
+	w.begin_section(ObservationSection);
+	w.write_array(sc.observations.data(), sc.observations.size());
+	w.end_section();
+	w.save(filename);
+}
+
+Scenario load(const std::string& filename) {
+	snapshot::MappedFile file(filename);
+	snapshot::Reader r(file.data(), file.size());
+	Scenario sc;
+	if(!r.find_section(ModelSection))
+		throw std::runtime_error("scenario: " + filename + " is not a recording");
+	sc.model = r.read_string();
+	r.read(sc.seed);
+	r.read(sc.steps);
+	r.read(sc.state_dim);
+	r.read(sc.obs_dim);
+
+	if(!r.find_section(TruthSection))
+		throw std::runtime_error("scenario: " + filename + " has no ground truth");
+	r.read_array(sc.truth);
+	if(!r.find_section(ObservationSection))
+		throw std::runtime_error("scenario: " + filename + " has no observations");
+	r.read_array(sc.observations);
+
+	if(sc.steps == 0)
+		throw std::runtime_error("scenario: " + filename + " has no steps");
+	if(sc.truth.size() != sc.steps * sc.state_dim || sc.observations.size() != sc.steps * sc.obs_dim)
+		throw std::runtime_error("scenario: " + filename + " is truncated");
+	return sc;
+}
+
+// ---- policies of the models ----
+
+// the process equation depends on the step, which the harness sets before
+// every step
+template<typename State>
+class GrowthPrediction {
+public:
+	void setStep(int k) {
+		this->k = k;
+	}
+
+protected:
+	GrowthPrediction() : k(0) {}
+
+	void predict(std::vector<State>& state_v, size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i)
+			state_v[i] = growth(state_v[i], k);
+	}
+
+private:
+	int k;
+};
+
+template<typename State, typename Obs>
+class GrowthState2Obs {
+protected:
+	void state2obs(const std::vector<State>& state_v, std::vector<Obs>& obs_v, size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i)
+			obs_v[i] = growth_observation(state_v[i]);
+	}
+
+	void observe(const std::vector<State>& state_v, size_t begin, size_t end, std::vector<Obs>& obs_v) {
+		for(size_t i = begin; i < end; ++i)
+			obs_v[i - begin] = growth_observation(state_v[i]);
+	}
+};
+
+// the first half of a state is the position, the second half the velocity
+template<typename State>
+class CvPrediction {
+protected:
+	template<typename T, size_t N>
+	void predict(std::vector<std::array<T, N> >& state_v, size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i)
+			for(size_t j = 0; j < N/2; ++j)
+				state_v[i][j] += state_v[i][j + N/2];
+	}
+
+	template<typename T, size_t N>
+	void predict(SoAVector<T, N>& state_v, size_t begin, size_t end) {
+		for(size_t j = 0; j < N/2; ++j) {
+			T* x = state_v.column(j);
+			const T* v = state_v.column(j + N/2);
+			for(size_t i = begin; i < end; ++i)
+				x[i] += v[i];
+		}
+	}
+
+	template<typename T>
+	void predict(FlatVector<T>& state_v, size_t begin, size_t end) {
+		const size_t d = state_v.dimension() / 2;
+		for(size_t i = begin; i < end; ++i) {
+			T* x = state_v.row(i);
+			for(size_t j = 0; j < d; ++j)
+				x[j] += x[j + d];
+		}
+	}
+};
+
+// observes the position
+template<typename State, typename Obs>
+class CvState2Obs {
+protected:
+	template<typename T, size_t N, size_t M>
+	void state2obs(const std::vector<std::array<T, N> >& state_v, std::vector<std::array<T, M> >& obs_v,
+			size_t begin, size_t end) {
+		observe(state_v, begin, end, obs_v, begin);
+	}
+
+	template<typename T, size_t N, size_t M>
+	void state2obs(const SoAVector<T, N>& state_v, SoAVector<T, M>& obs_v, size_t begin, size_t end) {
+		for(size_t j = 0; j < M; ++j)
+			std::copy(state_v.column(j) + begin, state_v.column(j) + end, obs_v.column(j) + begin);
+	}
+
+	template<typename T>
+	void state2obs(const FlatVector<T>& state_v, FlatVector<T>& obs_v, size_t begin, size_t end) {
+		observe(state_v, begin, end, obs_v, begin);
+	}
+
+	template<typename T, size_t N, size_t M>
+	void observe(const std::vector<std::array<T, N> >& state_v, size_t begin, size_t end,
+			std::vector<std::array<T, M> >& obs_v, size_t offset = 0) {
+		for(size_t i = begin; i < end; ++i)
+			std::copy(state_v[i].begin(), state_v[i].begin() + M, obs_v[i - begin + offset].begin());
+	}
+
+	template<typename T, size_t N, size_t M>
+	void observe(const SoAVector<T, N>& state_v, size_t begin, size_t end, SoAVector<T, M>& obs_v) {
+		for(size_t j = 0; j < M; ++j)
+			std::copy(state_v.column(j) + begin, state_v.column(j) + end, obs_v.column(j));
+	}
+
+	template<typename T>
+	void observe(const FlatVector<T>& state_v, size_t begin, size_t end, FlatVector<T>& obs_v,
+			size_t offset = 0) {
+		const size_t d = obs_v.dimension();
+		for(size_t i = begin; i < end; ++i)
+			std::copy(state_v.row(i), state_v.row(i) + d, obs_v.row(i - begin + offset));
+	}
+};
+
+// ---- replay ----
+
+// observations and estimates of the different state types
+template<typename T>
+typename std::enable_if<std::is_arithmetic<T>::value>::type
+make_observation(const double* y, size_t, T& obs) {
+	obs = T(y[0]);
+}
+
+template<typename T, size_t N>
+void make_observation(const double* y, size_t, std::array<T, N>& obs) {
+	for(size_t j = 0; j < N; ++j)
+		obs[j] = T(y[j]);
+}
+
+template<typename T>
+void make_observation(const double* y, size_t d, std::vector<T>& obs) {
+	obs.assign(y, y + d);
+}
+
+template<typename T>
+typename std::enable_if<std::is_arithmetic<T>::value, double>::type
+at(const T& x, size_t) {
+	return x;
+}
+
+template<typename C>
+typename std::enable_if<!std::is_arithmetic<C>::value, double>::type
+at(const C& x, size_t j) {
+	return x[j];
+}
+
+// FNV-1a over the bytes of the estimates
+void hash_value(uint64_t& h, double x) {
+	unsigned char b[sizeof(x)];
+	std::memcpy(b, &x, sizeof(x));
+	for(auto c : b)
+		h = (h ^ c) * 1099511628211ull;
+}
+
+template<typename PF>
+auto call_setStep(PF& pf, int k, int) -> decltype(pf.setStep(k)) {
+	pf.setStep(k);
+}
+
+template<typename PF>
+void call_setStep(PF&, int, long) {}
+
+template<typename PF>
+auto call_setInitDimension(PF& pf, size_t d, int) -> decltype(pf.setInitDimension(d)) {
+	pf.setInitDimension(d);
+}
+
+template<typename PF>
+void call_setInitDimension(PF&, size_t, long) {}
+
+struct Result {
+	double rmse, steps_per_second, p50_us, p99_us;
+	uint64_t hash;
+	long peak_rss_kb;
+	char error[160];
+};
+
+struct Configuration {
+	size_t particles;
+	unsigned int threads;
+};
+
+// runs the filter over the recording; the estimate of a tracking model is
+// compared to the position only
+template<typename PF, typename Setup>
+Result replay(const Scenario& sc, const Configuration& conf, const Setup& setup) {
+	typedef typename PF::Observation Observation;
+	typedef typename PF::Winner Winner;
+
+	// the latency percentiles need at least one step
+	if(sc.steps == 0)
+		throw std::invalid_argument("scenario: the recording has no steps");
+
+	std::unique_ptr<PF> pf(new PF(conf.particles));
+	pf->setThreads(conf.threads);
+	pf->setInitSeed(sc.seed);
+	pf->setNoiseSeed(sc.seed);
+	pf->setResamplingSeed(sc.seed);
+	call_setInitDimension(*pf, sc.state_dim, 0);
+	setup(*pf);
+
+	std::vector<double> latency(sc.steps);
+	Observation obs;
+	Winner w;
+	Result r = {};
+	r.hash = 14695981039346656037ull;
+	double squared_error = 0;
+
+	for(uint64_t k = 0; k < sc.steps; ++k) {
+		make_observation(&sc.observations[k * sc.obs_dim], sc.obs_dim, obs);
+		call_setStep(*pf, int(k + 1), 0);
+
+		auto start = std::chrono::steady_clock::now();
+		w = pf->run(obs);
+		latency[k] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+		const double* truth = &sc.truth[k * sc.state_dim];
+		for(size_t j = 0; j < sc.obs_dim; ++j) {
+			const double e = at(w, j) - truth[j];
+			squared_error += e*e;
+		}
+		for(size_t j = 0; j < sc.state_dim; ++j)
+			hash_value(r.hash, at(w, j));
+	}
+
+	double total = 0;
+	for(auto t : latency)
+		total += t;
+	std::sort(latency.begin(), latency.end());
+	r.rmse = std::sqrt(squared_error / sc.steps);
+	r.steps_per_second = sc.steps / (total * 1e-6);
+	r.p50_us = latency[(sc.steps - 1) / 2];
+	r.p99_us = latency[(sc.steps - 1) * 99 / 100];
+	return r;
+}
+
+// Runs f in a child process and returns its result with the peak resident
+// memory of the child. The parent does not start any threads, so it is safe
+// to fork.
+template<typename F>
+Result isolated(const F& f) {
+	int fds[2];
+	if(pipe(fds) != 0)
+		throw std::runtime_error("scenario: cannot create a pipe");
+	pid_t pid = fork();
+	if(pid < 0)
+		throw std::runtime_error("scenario: cannot fork");
+
+	if(pid == 0) {
+		close(fds[0]);
+		Result r = {};
+		try {
+			r = f();
+		} catch(const std::exception& e) {
+			std::snprintf(r.error, sizeof(r.error), "%s", e.what());
+		}
+		const char* p = reinterpret_cast<const char*>(&r);
+		for(size_t n = 0; n < sizeof(r); ) {
+			ssize_t m = write(fds[1], p + n, sizeof(r) - n);
+			if(m <= 0)
+				_exit(1);
+			n += m;
+		}
+		_exit(0);
+	}
+
+	close(fds[1]);
+	Result r = {};
+	char* p = reinterpret_cast<char*>(&r);
+	size_t n = 0;
+	while(n < sizeof(r)) {
+		ssize_t m = read(fds[0], p + n, sizeof(r) - n);
+		if(m <= 0)
+			break;
+		n += m;
+	}
+	close(fds[0]);
+
+	int status;
+	struct rusage usage;
+	if(wait4(pid, &status, 0, &usage) < 0) {
+		std::snprintf(r.error, sizeof(r.error), "the replay cannot be waited for");
+		return r;
+	}
+	if(n < sizeof(r) || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		std::snprintf(r.error, sizeof(r.error), "the replay has crashed");
+	r.peak_rss_kb = usage.ru_maxrss;
+	return r;
+}
+
+struct Options {
+	std::vector<size_t> particles;
+	unsigned int threads;
+	bool json;
+};
+
+struct Report {
+	bool json;
+	bool first;
+
+	void print(const Scenario& sc, const std::string& config, const Configuration& conf, const Result& r) {
+		std::ostringstream line;
+		if(json) {
+			line << (first ? "[\n" : ",\n") << "{\"model\": \"" << sc.model << "\", \"config\": \"" << config
+				<< "\", \"particles\": " << conf.particles << ", \"threads\": " << conf.threads
+				<< ", \"steps\": " << sc.steps;
+			if(r.error[0])
+				line << ", \"error\": \"" << r.error << "\"}";
+			else
+				line << ", \"rmse\": " << r.rmse << ", \"steps_per_s\": " << r.steps_per_second
+					<< ", \"p50_us\": " << r.p50_us << ", \"p99_us\": " << r.p99_us
+					<< ", \"peak_rss_kb\": " << r.peak_rss_kb << ", \"hash\": \"" << std::hex << r.hash << "\"}";
+		} else {
+			if(first)
+				line << "model,config,particles,threads,steps,rmse,steps_per_s,p50_us,p99_us,peak_rss_kb,hash\n";
+			line << sc.model << "," << config << "," << conf.particles << "," << conf.threads << "," << sc.steps << ",";
+			if(r.error[0])
+				line << "error: " << r.error << "\n";
+			else
+				line << r.rmse << "," << r.steps_per_second << "," << r.p50_us << "," << r.p99_us << ","
+					<< r.peak_rss_kb << "," << std::hex << r.hash << "\n";
+		}
+		std::cout << line.str() << std::flush;
+		first = false;
+	}
+
+	void finish() {
+		if(json)
+			std::cout << (first ? "[]\n" : "\n]\n");
+	}
+};
+
+template<typename PF, typename Setup>
+void sweep(Report& report, const Scenario& sc, const std::string& config, const Options& opt, const Setup& setup) {
+	for(size_t n : opt.particles) {
+		Configuration conf = {n, opt.threads};
+		report.print(sc, config, conf, isolated([&]() { return replay<PF>(sc, conf, setup); }));
+	}
+}
+
+// ---- configurations ----
+
+template<class S, class O> using Pdf = weight_policies::NormPdf<S, O>;
+template<class S, class O> using LogPdf = weight_policies::LogNormPdf<S, O>;
+template<class S, class W> using Mean = winner_policies::WeightedArithmeticMean<S, W>;
+template<class S> using Gaussian = init_policies::Gaussian<S>;
+template<class S> using Noise = noise_policies::GaussianNoise<S>;
+template<class S, class W> using Systematic = resampling_policies::SystematicResampling<S, W>;
+template<class S, class W> using Stratified = resampling_policies::StratifiedResampling<S, W>;
+
+template<typename PF>
+struct Sigmas {
+	double init, noise;
+
+	void operator()(PF& pf) const {
+		pf.setInitSigma(init);
+		pf.setNoiseSigma(noise);
+	}
+};
+
+// Sigmas with one of the modes of the particle filter
+template<typename PF>
+struct Mode : Sigmas<PF> {
+	void (PF::*enable)(bool);
+
+	Mode(const Sigmas<PF>& s, void (PF::*enable)(bool)) : Sigmas<PF>(s), enable(enable) {}
+
+	void operator()(PF& pf) const {
+		Sigmas<PF>::operator()(pf);
+		(pf.*enable)(true);
+	}
+};
+
+void sweep_growth(Report& report, const Scenario& sc, const Options& opt) {
+	typedef ParticleFilter<double, double, double, GrowthPrediction, GrowthState2Obs> PF;
+	typedef ParticleFilter<double, double, double, GrowthPrediction, GrowthState2Obs, Pdf, Mean, Gaussian,
+		Noise, Stratified> Strat;
+	typedef ParticleFilter<double, double, double, GrowthPrediction, GrowthState2Obs, LogPdf> Log;
+	typedef ParticleFilter<float, float, float, GrowthPrediction, GrowthState2Obs> Float;
+
+	sweep<PF>(report, sc, "systematic", opt, Sigmas<PF>{GrowthInit, GrowthNoise});
+	sweep<Strat>(report, sc, "stratified", opt, Sigmas<Strat>{GrowthInit, GrowthNoise});
+	sweep<Log>(report, sc, "log_weights", opt, Sigmas<Log>{GrowthInit, GrowthNoise});
+	sweep<Float>(report, sc, "float", opt, Sigmas<Float>{GrowthInit, GrowthNoise});
+	sweep<PF>(report, sc, "fused", opt, Mode<PF>({GrowthInit, GrowthNoise}, &PF::setFusedExecution));
+	sweep<PF>(report, sc, "auxiliary", opt, Mode<PF>({GrowthInit, GrowthNoise}, &PF::setAuxiliary));
+}
+
+template<size_t D>
+void sweep_cv(Report& report, const Scenario& sc, const Options& opt) {
+	typedef ParticleFilter<std::array<double, 2*D>, std::array<double, D>, double, CvPrediction, CvState2Obs> Array;
+	typedef ParticleFilter<SoA<double, 2*D>, SoA<double, D>, double, CvPrediction, CvState2Obs> Columns;
+	typedef ParticleFilter<SoA<float, 2*D>, SoA<float, D>, float, CvPrediction, CvState2Obs> ColumnsFloat;
+	typedef ParticleFilter<Flat<double>, Flat<double>, double, CvPrediction, CvState2Obs> Rows;
+	typedef ParticleFilter<std::array<double, 2*D>, std::array<double, D>, double, CvPrediction, CvState2Obs,
+		LogPdf> ArrayLog;
+
+	sweep<Array>(report, sc, "array", opt, Sigmas<Array>{CvInit, CvNoise});
+	sweep<ArrayLog>(report, sc, "array_log_weights", opt, Sigmas<ArrayLog>{CvInit, CvNoise});
+	sweep<Array>(report, sc, "array_fused", opt, Mode<Array>({CvInit, CvNoise}, &Array::setFusedExecution));
+	sweep<Array>(report, sc, "array_auxiliary", opt, Mode<Array>({CvInit, CvNoise}, &Array::setAuxiliary));
+	sweep<Columns>(report, sc, "soa", opt, Sigmas<Columns>{CvInit, CvNoise});
+	sweep<ColumnsFloat>(report, sc, "soa_float", opt, Sigmas<ColumnsFloat>{CvInit, CvNoise});
+	sweep<Rows>(report, sc, "flat", opt, Sigmas<Rows>{CvInit, CvNoise});
+}
+
+void sweep_all(Report& report, const Scenario& sc, const Options& opt) {
+	if(sc.model == "growth")
+		sweep_growth(report, sc, opt);
+	else if(sc.model == "cv2d")
+		sweep_cv<2>(report, sc, opt);
+	else if(sc.model == "cv3d")
+		sweep_cv<3>(report, sc, opt);
+	else
+		throw std::runtime_error("scenario: unknown model " + sc.model);
+}
+
+std::vector<size_t> parse_list(const char* s) {
+	std::vector<size_t> v;
+	std::istringstream in(s);
+	std::string item;
+	while(std::getline(in, item, ','))
+		if(!item.empty())
+			v.push_back(std::strtoul(item.c_str(), nullptr, 10));
+	return v;
+}
+
+int usage(const char* name) {
+	std::cerr << "usage: " << name << " record <model> <file> [--steps T] [--seed S]\n"
+		<< "       " << name << " replay <file> [--particles N,...] [--threads K] [--json]\n"
+		<< "       " << name << " [--steps T] [--seed S] [--particles N,...] [--threads K] [--json]\n"
+		<< "models: growth, cv2d, cv3d" << std::endl;
+	return 1;
+}
+
+int main(int argc, char *argv[]) {
+	Options opt = {{100, 1000, 10000}, 1, false};
+	uint64_t steps = 200;
+	uint32_t seed = 1;
+	std::vector<std::string> args;
+	for(int i = 1; i < argc; ++i) {
+		if(std::strcmp(argv[i], "--json") == 0) {
+			opt.json = true;
+		} else if(std::strcmp(argv[i], "--particles") == 0 && i+1 < argc) {
+			opt.particles = parse_list(argv[++i]);
+		} else if(std::strcmp(argv[i], "--threads") == 0 && i+1 < argc) {
+			opt.threads = std::strtoul(argv[++i], nullptr, 10);
+		} else if(std::strcmp(argv[i], "--steps") == 0 && i+1 < argc) {
+			steps = std::strtoull(argv[++i], nullptr, 10);
+			if(steps == 0)
+				return usage(argv[0]);
+		} else if(std::strcmp(argv[i], "--seed") == 0 && i+1 < argc) {
+			seed = std::strtoul(argv[++i], nullptr, 10);
+		} else if(argv[i][0] == '-') {
+			return usage(argv[0]);
+		} else {
+			args.push_back(argv[i]);
+		}
+	}
+	if(opt.particles.empty())
+		return usage(argv[0]);
+
+	try {
+		Report report = {opt.json, true};
+		if(args.size() == 3 && args[0] == "record") {
+			save(simulate(args[1], steps, seed), args[2]);
+		} else if(args.size() == 2 && args[0] == "replay") {
+			sweep_all(report, load(args[1]), opt);
+			report.finish();
+		} else if(args.empty()) {
+			for(const char* model : {"growth", "cv2d", "cv3d"})
+				sweep_all(report, simulate(model, steps, seed), opt);
+			report.finish();
+		} else {
+			return usage(argv[0]);
+		}
+	} catch(const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,82 @@
+#ifndef _POLPF_SENSOR_H_
+#define _POLPF_SENSOR_H_
+
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+
+#include "ParticleFilter.h"
+#include "observation_model.h"
+
+namespace policy_pf {
+
+// A Sensor combines a state2obs and a weight policy for the observations of
+// one sensor, with its own workspaces for the hypothetical observations and
+// the likelihoods. ParticleFilter::update weights a predicted particle set
+// with the readings of several sensors at once:
+//
+//   Sensor<State, SoA<double, 2>, double, PositionState2Obs, NormPdf> camera;
+//   Sensor<State, double, double, RangeState2Obs, LogNormPdf> radar;
+//   pf.update(camera.reading(position), radar.reading(range));
+//
+// The policies may implement the same interfaces as those of the particle
+// filter; their setters are called on the sensor.
+template<
+	typename StateType,
+	typename ObservationType,
+	typename WeightType = double,
+	template<class, class> class State2Obs = state2obs::Identity,
+	template<class, class> class WeightPolicy = weight_policies::NormPdf>
+class Sensor : public ObservationModel<StateType, ObservationType, WeightType, State2Obs, WeightPolicy>
+{
+public:
+	typedef typename ParticleStorage<StateType>::type Particles;
+	typedef typename ParticleStorage<ObservationType>::type Observations;
+	typedef typename ParticleStorage<ObservationType>::value_type Observation;
+	typedef WeightType Weight;
+	typedef std::integral_constant<bool,
+		weight_policies::isLogLikelihood<WeightPolicy<WeightType, ObservationType> >::value> LogWeights;
+
+	// an observation of the sensor, it has to live until update returns
+	struct Reading {
+		typedef Sensor SensorType;
+		Sensor* sensor;
+		const Observation* observation;
+	};
+
+	Reading reading(const Observation& observation) {
+		Reading r = {this, &observation};
+		return r;
+	}
+
+	// the reading is skipped if observation is null, e.g. if the sensor has
+	// no observation in this step
+	Reading reading(const Observation* observation) {
+		Reading r = {this, observation};
+		return r;
+	}
+
+	// called by the particle filter: maps the particles to observations and
+	// computes the likelihoods of the observation, on the threads of pool
+	void map(const Particles& particles, const Observation& observation, ThreadPool* pool) {
+		this->apply_state2obs(particles, observation, hyp_obs, pool);
+	}
+
+	void weigh(const Observation& observation, ThreadPool* pool) {
+		this->apply_weight(hyp_obs, observation, weight_v, pool);
+	}
+
+	// likelihoods (or log-likelihoods) of the last reading
+	const std::vector<WeightType>& weights() const {
+		return weight_v;
+	}
+
+private:
+	Observations hyp_obs;
+	std::vector<WeightType> weight_v;
+};
+
+}
+
+#endif
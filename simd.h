@@ -0,0 +1,340 @@
+#ifndef _POLPF_SIMD_H_
+#define _POLPF_SIMD_H_
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && GCC_VERSION >= 40900
+#define POLPF_SIMD_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * Vectorized kernels used by the weight policies.
+ *
+ * Each kernel has a portable implementation and, on x86 with g++ >= 4.9,
+ * explicitly vectorized SSE2, AVX2 and AVX-512 versions for float and
+ * double, chosen at runtime depending on the capabilities of the cpu.
+ *
+ * The vectorized exp differs from std::exp by at most 2 ulp, i.e. the
+ * relative error is below 5e-16 for double and 2.5e-7 for float. Arguments
+ * below -708.39 resp. -87.33 (results smaller than the smallest normal
+ * number) are flushed to zero, arguments above 709.43 resp. 88.37 return
+ * infinity, NaN is passed through. The other kernels match the portable
+ * versions up to rounding.
+ */
+
+namespace policy_pf {
+namespace simd {
+
+// acc[i] += (x[i*stride] - o)^2
+template<typename T, typename W>
+inline void accumulate_square(const T* x, size_t n, size_t stride, T o, W* acc) {
+	for(size_t i = 0; i < n; ++i) {
+		auto d = x[i*stride] - o;
+		acc[i] += d*d;
+	}
+}
+
+// acc[i] += 1/(x[i*stride] - o)^2
+template<typename T, typename W>
+inline void accumulate_inverse_square(const T* x, size_t n, size_t stride, T o, W* acc) {
+	for(size_t i = 0; i < n; ++i) {
+		auto d = x[i*stride] - o;
+		acc[i] += 1.0 / (d*d);
+	}
+}
+
+// out[i] = a * exp(b * in[i]), in and out may be the same array
+template<typename W>
+inline void scaled_exp(const W* in, size_t n, W b, W a, W* out) {
+	for(size_t i = 0; i < n; ++i)
+		out[i] = a * std::exp(b * in[i]);
+}
+
+#ifdef POLPF_SIMD_X86
+
+// constants of the exp approximation exp(x) = 2^n * p(r), x = n*ln(2) + r,
+// where p is the taylor polynomial of the given degree
+template<typename T> struct ExpConstants;
+
+template<> struct ExpConstants<double> {
+	static const int degree = 12;
+	static double lo() {return -708.39;}
+	static double hi() {return 709.43;}
+	static double ln2_hi() {return 6.93145751953125e-1;}
+	static double ln2_lo() {return 1.42860682030941723212e-6;}
+	static double coefficient(int k) {
+		static const double c[] = {1.0, 1.0, 1.0/2, 1.0/6, 1.0/24, 1.0/120, 1.0/720,
+			1.0/5040, 1.0/40320, 1.0/362880, 1.0/3628800, 1.0/39916800, 1.0/479001600};
+		return c[k];
+	}
+};
+
+template<> struct ExpConstants<float> {
+	static const int degree = 7;
+	static float lo() {return -87.33f;}
+	static float hi() {return 88.37f;}
+	static float ln2_hi() {return 0.693359375f;}
+	static float ln2_lo() {return -2.12194440e-4f;}
+	static float coefficient(int k) {
+		static const float c[] = {1.0f, 1.0f, 1.0f/2, 1.0f/6, 1.0f/24, 1.0f/120, 1.0f/720, 1.0f/5040};
+		return c[k];
+	}
+};
+
+/*
+ * The Ops structs wrap the intrinsics of one instruction set. pow2 returns
+ * 2^n for t = x*log2(e) + magic (n is stored in the low bits of t),
+ * fixup handles arguments outside of [lo, hi] and NaN, which clamp maps to lo.
+ */
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+namespace sse2 {
+
+struct DoubleOps {
+	typedef double T;
+	typedef __m128d V;
+	static const size_t width = 2;
+	static V load(const T* p, size_t s) {return s == 1 ? _mm_loadu_pd(p) : _mm_set_pd(p[s], p[0]);}
+	static void store(T* p, V v) {_mm_storeu_pd(p, v);}
+	static V set1(T v) {return _mm_set1_pd(v);}
+	static V add(V a, V b) {return _mm_add_pd(a, b);}
+	static V sub(V a, V b) {return _mm_sub_pd(a, b);}
+	static V mul(V a, V b) {return _mm_mul_pd(a, b);}
+	static V div(V a, V b) {return _mm_div_pd(a, b);}
+	static V clamp(V x, V lo, V hi) {return _mm_min_pd(_mm_max_pd(x, lo), hi);}
+	static V pow2(V t) {
+		return _mm_castsi128_pd(_mm_slli_epi64(_mm_add_epi64(_mm_castpd_si128(t),
+			_mm_set1_epi64x(1023 - 0x4338000000000000LL)), 52));
+	}
+	static V fixup(V x, V res, V lo, V hi) {
+		V big = _mm_cmpgt_pd(x, hi), nan = _mm_cmpunord_pd(x, x);
+		res = _mm_andnot_pd(_mm_cmplt_pd(x, lo), res);
+		res = _mm_or_pd(_mm_andnot_pd(big, res), _mm_and_pd(big, set1(std::numeric_limits<T>::infinity())));
+		return _mm_or_pd(_mm_andnot_pd(nan, res), _mm_and_pd(nan, x));
+	}
+	static T magic() {return 6755399441055744.0;}
+};
+
+struct FloatOps {
+	typedef float T;
+	typedef __m128 V;
+	static const size_t width = 4;
+	static V load(const T* p, size_t s) {return s == 1 ? _mm_loadu_ps(p) : _mm_set_ps(p[3*s], p[2*s], p[s], p[0]);}
+	static void store(T* p, V v) {_mm_storeu_ps(p, v);}
+	static V set1(T v) {return _mm_set1_ps(v);}
+	static V add(V a, V b) {return _mm_add_ps(a, b);}
+	static V sub(V a, V b) {return _mm_sub_ps(a, b);}
+	static V mul(V a, V b) {return _mm_mul_ps(a, b);}
+	static V div(V a, V b) {return _mm_div_ps(a, b);}
+	static V clamp(V x, V lo, V hi) {return _mm_min_ps(_mm_max_ps(x, lo), hi);}
+	static V pow2(V t) {
+		return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_castps_si128(t),
+			_mm_set1_epi32(127 - 0x4B400000)), 23));
+	}
+	static V fixup(V x, V res, V lo, V hi) {
+		V big = _mm_cmpgt_ps(x, hi), nan = _mm_cmpunord_ps(x, x);
+		res = _mm_andnot_ps(_mm_cmplt_ps(x, lo), res);
+		res = _mm_or_ps(_mm_andnot_ps(big, res), _mm_and_ps(big, set1(std::numeric_limits<T>::infinity())));
+		return _mm_or_ps(_mm_andnot_ps(nan, res), _mm_and_ps(nan, x));
+	}
+	static T magic() {return 12582912.0f;}
+};
+
+#include "simd_kernels.h"
+
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace avx2 {
+
+struct DoubleOps {
+	typedef double T;
+	typedef __m256d V;
+	static const size_t width = 4;
+	static V load(const T* p, size_t s) {
+		if(s == 1)
+			return _mm256_loadu_pd(p);
+		return _mm256_i64gather_pd(p, _mm256_set_epi64x(3*s, 2*s, s, 0), 8);
+	}
+	static void store(T* p, V v) {_mm256_storeu_pd(p, v);}
+	static V set1(T v) {return _mm256_set1_pd(v);}
+	static V add(V a, V b) {return _mm256_add_pd(a, b);}
+	static V sub(V a, V b) {return _mm256_sub_pd(a, b);}
+	static V mul(V a, V b) {return _mm256_mul_pd(a, b);}
+	static V div(V a, V b) {return _mm256_div_pd(a, b);}
+	static V clamp(V x, V lo, V hi) {return _mm256_min_pd(_mm256_max_pd(x, lo), hi);}
+	static V pow2(V t) {
+		return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_add_epi64(_mm256_castpd_si256(t),
+			_mm256_set1_epi64x(1023 - 0x4338000000000000LL)), 52));
+	}
+	static V fixup(V x, V res, V lo, V hi) {
+		res = _mm256_andnot_pd(_mm256_cmp_pd(x, lo, _CMP_LT_OQ), res);
+		res = _mm256_blendv_pd(res, set1(std::numeric_limits<T>::infinity()), _mm256_cmp_pd(x, hi, _CMP_GT_OQ));
+		return _mm256_blendv_pd(res, x, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+	}
+	static T magic() {return 6755399441055744.0;}
+};
+
+struct FloatOps {
+	typedef float T;
+	typedef __m256 V;
+	static const size_t width = 8;
+	static V load(const T* p, size_t s) {
+		if(s == 1)
+			return _mm256_loadu_ps(p);
+		return _mm256_i32gather_ps(p, _mm256_mullo_epi32(_mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0),
+			_mm256_set1_epi32(s)), 4);
+	}
+	static void store(T* p, V v) {_mm256_storeu_ps(p, v);}
+	static V set1(T v) {return _mm256_set1_ps(v);}
+	static V add(V a, V b) {return _mm256_add_ps(a, b);}
+	static V sub(V a, V b) {return _mm256_sub_ps(a, b);}
+	static V mul(V a, V b) {return _mm256_mul_ps(a, b);}
+	static V div(V a, V b) {return _mm256_div_ps(a, b);}
+	static V clamp(V x, V lo, V hi) {return _mm256_min_ps(_mm256_max_ps(x, lo), hi);}
+	static V pow2(V t) {
+		return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_castps_si256(t),
+			_mm256_set1_epi32(127 - 0x4B400000)), 23));
+	}
+	static V fixup(V x, V res, V lo, V hi) {
+		res = _mm256_andnot_ps(_mm256_cmp_ps(x, lo, _CMP_LT_OQ), res);
+		res = _mm256_blendv_ps(res, set1(std::numeric_limits<T>::infinity()), _mm256_cmp_ps(x, hi, _CMP_GT_OQ));
+		return _mm256_blendv_ps(res, x, _mm256_cmp_ps(x, x, _CMP_UNORD_Q));
+	}
+	static T magic() {return 12582912.0f;}
+};
+
+#include "simd_kernels.h"
+
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+namespace avx512 {
+
+struct DoubleOps {
+	typedef double T;
+	typedef __m512d V;
+	static const size_t width = 8;
+	static V load(const T* p, size_t s) {
+		if(s == 1)
+			return _mm512_loadu_pd(p);
+		return _mm512_i64gather_pd(_mm512_set_epi64(7*s, 6*s, 5*s, 4*s, 3*s, 2*s, s, 0), p, 8);
+	}
+	static void store(T* p, V v) {_mm512_storeu_pd(p, v);}
+	static V set1(T v) {return _mm512_set1_pd(v);}
+	static V add(V a, V b) {return _mm512_add_pd(a, b);}
+	static V sub(V a, V b) {return _mm512_sub_pd(a, b);}
+	static V mul(V a, V b) {return _mm512_mul_pd(a, b);}
+	static V div(V a, V b) {return _mm512_div_pd(a, b);}
+	static V clamp(V x, V lo, V hi) {return _mm512_min_pd(_mm512_max_pd(x, lo), hi);}
+	static V pow2(V t) {
+		return _mm512_castsi512_pd(_mm512_slli_epi64(_mm512_add_epi64(_mm512_castpd_si512(t),
+			_mm512_set1_epi64(1023 - 0x4338000000000000LL)), 52));
+	}
+	static V fixup(V x, V res, V lo, V hi) {
+		res = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, lo, _CMP_LT_OQ), res, _mm512_setzero_pd());
+		res = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, hi, _CMP_GT_OQ), res,
+			set1(std::numeric_limits<T>::infinity()));
+		return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, x, _CMP_UNORD_Q), res, x);
+	}
+	static T magic() {return 6755399441055744.0;}
+};
+
+struct FloatOps {
+	typedef float T;
+	typedef __m512 V;
+	static const size_t width = 16;
+	static V load(const T* p, size_t s) {
+		if(s == 1)
+			return _mm512_loadu_ps(p);
+		return _mm512_i32gather_ps(_mm512_mullo_epi32(_mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8,
+			7, 6, 5, 4, 3, 2, 1, 0), _mm512_set1_epi32(s)), p, 4);
+	}
+	static void store(T* p, V v) {_mm512_storeu_ps(p, v);}
+	static V set1(T v) {return _mm512_set1_ps(v);}
+	static V add(V a, V b) {return _mm512_add_ps(a, b);}
+	static V sub(V a, V b) {return _mm512_sub_ps(a, b);}
+	static V mul(V a, V b) {return _mm512_mul_ps(a, b);}
+	static V div(V a, V b) {return _mm512_div_ps(a, b);}
+	static V clamp(V x, V lo, V hi) {return _mm512_min_ps(_mm512_max_ps(x, lo), hi);}
+	static V pow2(V t) {
+		return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(_mm512_castps_si512(t),
+			_mm512_set1_epi32(127 - 0x4B400000)), 23));
+	}
+	static V fixup(V x, V res, V lo, V hi) {
+		res = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, lo, _CMP_LT_OQ), res, _mm512_setzero_ps());
+		res = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, hi, _CMP_GT_OQ), res,
+			set1(std::numeric_limits<T>::infinity()));
+		return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, x, _CMP_UNORD_Q), res, x);
+	}
+	static T magic() {return 12582912.0f;}
+};
+
+#include "simd_kernels.h"
+
+}
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+
+enum Level {PORTABLE, SSE2, AVX2, AVX512};
+
+// the best instruction set supported by the cpu, determined once
+inline Level level() {
+	static const Level l = __builtin_cpu_supports("avx512f") ? AVX512
+		: __builtin_cpu_supports("avx2") ? AVX2
+		: __builtin_cpu_supports("sse2") ? SSE2 : PORTABLE;
+	return l;
+}
+
+#define POLPF_SIMD_DISPATCH(kernel, T, ...) \
+	switch(level()) { \
+		case AVX512: avx512::kernel<avx512::T##Ops>(__VA_ARGS__); break; \
+		case AVX2: avx2::kernel<avx2::T##Ops>(__VA_ARGS__); break; \
+		case SSE2: sse2::kernel<sse2::T##Ops>(__VA_ARGS__); break; \
+		default: kernel<T##_t>(__VA_ARGS__); \
+	}
+
+typedef double Double_t;
+typedef float Float_t;
+
+inline void accumulate_square(const double* x, size_t n, size_t stride, double o, double* acc) {
+	POLPF_SIMD_DISPATCH(accumulate_square, Double, x, n, stride, o, acc)
+}
+
+inline void accumulate_square(const float* x, size_t n, size_t stride, float o, float* acc) {
+	POLPF_SIMD_DISPATCH(accumulate_square, Float, x, n, stride, o, acc)
+}
+
+inline void accumulate_inverse_square(const double* x, size_t n, size_t stride, double o, double* acc) {
+	POLPF_SIMD_DISPATCH(accumulate_inverse_square, Double, x, n, stride, o, acc)
+}
+
+inline void accumulate_inverse_square(const float* x, size_t n, size_t stride, float o, float* acc) {
+	POLPF_SIMD_DISPATCH(accumulate_inverse_square, Float, x, n, stride, o, acc)
+}
+
+inline void scaled_exp(const double* in, size_t n, double b, double a, double* out) {
+	POLPF_SIMD_DISPATCH(scaled_exp, Double, in, n, b, a, out)
+}
+
+inline void scaled_exp(const float* in, size_t n, float b, float a, float* out) {
+	POLPF_SIMD_DISPATCH(scaled_exp, Float, in, n, b, a, out)
+}
+
+#undef POLPF_SIMD_DISPATCH
+
+#endif
+
+}}
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * Kernels shared by all instruction sets, included by simd.h once per
+ * instruction set (inside its namespace and target pragma), so there is no
+ * include guard. Ops wraps the intrinsics of the instruction set.
+ */
+
+template<typename Ops>
+inline typename Ops::V exp(typename Ops::V x) {
+	typedef typename Ops::T T;
+	typedef typename Ops::V V;
+	typedef ExpConstants<T> C;
+
+	const V lo = Ops::set1(C::lo()), hi = Ops::set1(C::hi());
+	V xc = Ops::clamp(x, lo, hi);
+
+	// x = n*ln(2) + r with |r| <= ln(2)/2
+	V t = Ops::add(Ops::mul(xc, Ops::set1(1.4426950408889634)), Ops::set1(Ops::magic()));
+	V n = Ops::sub(t, Ops::set1(Ops::magic()));
+	V r = Ops::sub(Ops::sub(xc, Ops::mul(n, Ops::set1(C::ln2_hi()))), Ops::mul(n, Ops::set1(C::ln2_lo())));
+
+	V p = Ops::set1(C::coefficient(C::degree));
+	for(int k = C::degree - 1; k >= 0; --k)
+		p = Ops::add(Ops::mul(p, r), Ops::set1(C::coefficient(k)));
+
+	return Ops::fixup(x, Ops::mul(p, Ops::pow2(t)), lo, hi);
+}
+
+template<typename Ops>
+void accumulate_square(const typename Ops::T* x, size_t n, size_t stride,
+		typename Ops::T o, typename Ops::T* acc) {
+	typedef typename Ops::V V;
+	const V vo = Ops::set1(o);
+	size_t i = 0;
+	for(; i + Ops::width <= n; i += Ops::width) {
+		V d = Ops::sub(Ops::load(x + i*stride, stride), vo);
+		Ops::store(acc + i, Ops::add(Ops::load(acc + i, 1), Ops::mul(d, d)));
+	}
+	for(; i < n; ++i) {
+		typename Ops::T d = x[i*stride] - o;
+		acc[i] += d*d;
+	}
+}
+
+template<typename Ops>
+void accumulate_inverse_square(const typename Ops::T* x, size_t n, size_t stride,
+		typename Ops::T o, typename Ops::T* acc) {
+	typedef typename Ops::V V;
+	const V vo = Ops::set1(o), one = Ops::set1(1);
+	size_t i = 0;
+	for(; i + Ops::width <= n; i += Ops::width) {
+		V d = Ops::sub(Ops::load(x + i*stride, stride), vo);
+		Ops::store(acc + i, Ops::add(Ops::load(acc + i, 1), Ops::div(one, Ops::mul(d, d))));
+	}
+	for(; i < n; ++i) {
+		typename Ops::T d = x[i*stride] - o;
+		acc[i] += 1 / (d*d);
+	}
+}
+
+template<typename Ops>
+void scaled_exp(const typename Ops::T* in, size_t n, typename Ops::T b,
+		typename Ops::T a, typename Ops::T* out) {
+	typedef typename Ops::V V;
+	const V vb = Ops::set1(b), va = Ops::set1(a);
+	size_t i = 0;
+	for(; i + Ops::width <= n; i += Ops::width)
+		Ops::store(out + i, Ops::mul(va, exp<Ops>(Ops::mul(vb, Ops::load(in + i, 1)))));
+	for(; i < n; ++i)
+		out[i] = a * std::exp(b * in[i]);
+}
@@ -0,0 +1,413 @@
+#ifndef _POLPF_SNAPSHOT_H_
+#define _POLPF_SNAPSHOT_H_
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "storage.h"
+
+namespace policy_pf {
+namespace snapshot {
+
+// A snapshot is a header (magic, format version, byte order mark) followed
+// by sections. Every section starts with its id and the length of its
+// content, so readers skip the sections they do not know. Arrays start at
+// file offsets which are multiples of 64 and are copied out of the mapped
+// file with one memcpy each; the restored filter owns its particles and
+// does not refer to the file. Numbers are stored in the byte order of the
+// machine, snapshots of the other byte order are rejected. Arrays of
+// numbers and particle sets carry the kind and size of their numbers,
+// which are checked when they are read.
+
+const uint32_t Version = 2;
+const size_t Alignment = 64;
+
+enum Section {
+	FilterSection = 1, ParticlesSection, WeightsSection, CarriedWeightsSection, AncestorsSection,
+
+	// one section for every policy implementing save_state and load_state
+	PredictionSection = 16, State2ObsSection, WeightPolicySection, WinnerSection,
+	InitSection, NoiseSection, ResamplingSection, InstrumentationSection
+};
+
+static const char magic[8] = {'P', 'O', 'L', 'P', 'F', 'S', 'N', 'P'};
+static const uint32_t byte_order_mark = 0x01020304;
+
+enum NumberKind {
+	OtherNumber = 0, FloatingNumber, SignedNumber, UnsignedNumber
+};
+
+template<typename T>
+uint32_t number_kind() {
+	return std::is_floating_point<T>::value ? FloatingNumber
+		: std::is_integral<T>::value ? (std::is_signed<T>::value ? SignedNumber : UnsignedNumber)
+		: OtherNumber;
+}
+
+class Writer {
+public:
+	Writer() : section_start(0) {
+		write_bytes(magic, sizeof(magic));
+		write(Version);
+		write(byte_order_mark);
+	}
+
+	template<typename T>
+	void write(const T& x) {
+		static_assert(std::is_pod<T>::value, "only plain old data can be written");
+		write_bytes(&x, sizeof(x));
+	}
+
+	void write_bytes(const void* p, size_t n) {
+		const char* c = static_cast<const char*>(p);
+		buffer.insert(buffer.end(), c, c + n);
+	}
+
+	// writes the number of elements and aligns the start of the elements,
+	// which are written by the caller
+	void begin_array(uint64_t n) {
+		write(n);
+		buffer.resize((buffer.size() + Alignment - 1) / Alignment * Alignment, 0);
+	}
+
+	template<typename T>
+	void write_array(const T* p, size_t n) {
+		begin_array(n);
+		write_bytes(p, n * sizeof(T));
+	}
+
+	// an array preceded by the kind and size of its numbers
+	template<typename T>
+	void write_numbers(const T* p, size_t n) {
+		write(number_kind<T>());
+		write(uint32_t(sizeof(T)));
+		write_array(p, n);
+	}
+
+	void write_string(const std::string& s) {
+		write(uint64_t(s.size()));
+		write_bytes(s.data(), s.size());
+	}
+
+	void begin_section(uint32_t id) {
+		section_start = buffer.size();
+		write(id);
+		write(uint32_t(0));
+		write(uint64_t(0));
+	}
+
+	void end_section() {
+		uint64_t length = buffer.size() - section_start - 16;
+		std::memcpy(&buffer[section_start + 8], &length, sizeof(length));
+	}
+
+	const std::vector<char>& data() const {
+		return buffer;
+	}
+
+	void save(const std::string& filename) const {
+		std::ofstream file(filename.c_str(), std::ios::binary | std::ios::trunc);
+		file.write(buffer.data(), buffer.size());
+		if(!file)
+			throw std::runtime_error("snapshot: cannot write " + filename);
+	}
+
+private:
+	std::vector<char> buffer;
+	size_t section_start;
+};
+
+// Reads a snapshot from memory, arrays are returned as pointers into it.
+// All reads are checked against the end of the current section.
+class Reader {
+public:
+	Reader(const char* data, size_t size) : data(data), size(size), pos(0), end(size) {
+		char m[sizeof(magic)];
+		uint32_t version, bom;
+		read_bytes(m, sizeof(m));
+		if(std::memcmp(m, magic, sizeof(magic)) != 0)
+			throw std::runtime_error("snapshot: not a snapshot");
+		read(version);
+		read(bom);
+		if(bom != byte_order_mark)
+			throw std::runtime_error("snapshot: written on a machine with a different byte order");
+		if(version > Version)
+			throw std::runtime_error("snapshot: written by a newer version");
+		if(version < Version)
+			throw std::runtime_error("snapshot: written by an older version");
+		sections = pos;
+	}
+
+	// positions the reader at the content of the section id, returns false
+	// if the snapshot does not contain it
+	bool find_section(uint32_t id) {
+		pos = sections;
+		end = size;
+		while(pos + 16 <= size) {
+			uint32_t section, reserved;
+			uint64_t length;
+			read(section);
+			read(reserved);
+			read(length);
+			if(length > size - pos)
+				throw std::runtime_error("snapshot: truncated");
+			if(section == id) {
+				end = pos + length;
+				return true;
+			}
+			pos += length;
+		}
+		return false;
+	}
+
+	template<typename T>
+	void read(T& x) {
+		static_assert(std::is_pod<T>::value, "only plain old data can be read");
+		read_bytes(&x, sizeof(x));
+	}
+
+	void read_bytes(void* p, size_t n) {
+		std::memcpy(p, take(n), n);
+	}
+
+	// reads the number of elements n and returns a pointer to the elements,
+	// which is aligned if the snapshot is
+	const char* read_array(uint64_t& n, size_t element_size) {
+		read(n);
+		pos = (pos + Alignment - 1) / Alignment * Alignment;
+		if(pos > end || n > (end - pos) / element_size)
+			throw std::runtime_error("snapshot: truncated");
+		return take(n * element_size);
+	}
+
+	template<typename T>
+	void read_array(std::vector<T>& v) {
+		uint64_t n;
+		const char* p = read_array(n, sizeof(T));
+		v.resize(n);
+		std::memcpy(v.data(), p, n * sizeof(T));
+	}
+
+	template<typename T>
+	void read_numbers(std::vector<T>& v) {
+		uint32_t kind, size;
+		read(kind);
+		read(size);
+		if(kind != number_kind<T>() || size != sizeof(T))
+			throw std::runtime_error("snapshot: the numbers do not match their type");
+		read_array(v);
+	}
+
+	std::string read_string() {
+		uint64_t n;
+		read(n);
+		if(n > end - pos)
+			throw std::runtime_error("snapshot: truncated");
+		return std::string(take(n), n);
+	}
+
+private:
+	const char* take(size_t n) {
+		if(n > end - pos)
+			throw std::runtime_error("snapshot: truncated");
+		const char* p = data + pos;
+		pos += n;
+		return p;
+	}
+
+	const char* data;
+	size_t size, pos, end, sections;
+};
+
+// read-only memory mapping of a snapshot file
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& filename) : ptr(nullptr), sz(0) {
+		int fd = open(filename.c_str(), O_RDONLY);
+		if(fd < 0)
+			throw std::runtime_error("snapshot: cannot open " + filename);
+		struct stat st;
+		if(fstat(fd, &st) == 0 && st.st_size > 0) {
+			sz = st.st_size;
+			void* p = mmap(nullptr, sz, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(p != MAP_FAILED)
+				ptr = static_cast<const char*>(p);
+		}
+		close(fd);
+		if(!ptr)
+			throw std::runtime_error("snapshot: cannot map " + filename);
+	}
+
+	~MappedFile() {
+		munmap(const_cast<char*>(ptr), sz);
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char* data() const {
+		return ptr;
+	}
+
+	size_t size() const {
+		return sz;
+	}
+
+private:
+	const char* ptr;
+	size_t sz;
+};
+
+// Particle sets are stored with a description of their layout (kind, kind
+// of the numbers, size of an element and dimension), which is checked when
+// they are read.
+enum Layout {
+	Contiguous = 1, Containers, Columns
+};
+
+inline void write_layout(Writer& w, uint32_t kind, uint32_t number, uint32_t element_size, uint64_t dimension) {
+	w.write(kind);
+	w.write(number);
+	w.write(element_size);
+	w.write(dimension);
+}
+
+inline void check_layout(Reader& r, uint32_t kind, uint32_t number, uint32_t element_size, uint64_t& dimension) {
+	uint32_t k, m, e;
+	uint64_t d;
+	r.read(k);
+	r.read(m);
+	r.read(e);
+	r.read(d);
+	if(k != kind || m != number || e != element_size || (dimension > 0 && d != dimension))
+		throw std::runtime_error("snapshot: the particles do not match the state type");
+	dimension = d;
+}
+
+// number of particles stored as n numbers of dimension d each
+inline uint64_t particle_count(uint64_t n, uint64_t d) {
+	if(d == 0 ? n > 0 : n % d != 0)
+		throw std::invalid_argument("snapshot: the number of values does not match the dimension");
+	return d > 0 ? n / d : 0;
+}
+
+// the numbers of a state of fixed size
+template<typename State, typename Enable = void>
+struct StateNumbers {
+	typedef State type;
+	static const size_t count = 1;
+};
+
+template<typename State>
+struct StateNumbers<State, typename std::enable_if<isFixedArray<State>::value>::type> {
+	typedef typename isFixedArray<State>::element_type type;
+	static const size_t count = isFixedArray<State>::dimensions;
+};
+
+// states of fixed size (scalars, C arrays, std::array) are copied as they are
+template<typename State>
+typename std::enable_if<std::is_pod<State>::value>::type
+write_particles(Writer& w, const std::vector<State>& v) {
+	typedef StateNumbers<State> Numbers;
+	write_layout(w, Contiguous, number_kind<typename Numbers::type>(), sizeof(State), Numbers::count);
+	w.write_array(v.data(), v.size());
+}
+
+template<typename State>
+typename std::enable_if<std::is_pod<State>::value>::type
+read_particles(Reader& r, std::vector<State>& v) {
+	typedef StateNumbers<State> Numbers;
+	uint64_t n, d = Numbers::count;
+	check_layout(r, Contiguous, number_kind<typename Numbers::type>(), sizeof(State), d);
+	const char* p = r.read_array(n, sizeof(State));
+	v.resize(n);
+	std::memcpy(v.data(), p, n * sizeof(State));
+}
+
+// containers of numbers (std::vector, std::deque), all of the same size
+template<typename State>
+typename std::enable_if<!std::is_pod<State>::value>::type
+write_particles(Writer& w, const std::vector<State>& v) {
+	typedef typename State::value_type T;
+	const size_t d = v.empty() ? 0 : v[0].size();
+	write_layout(w, Containers, number_kind<T>(), sizeof(T), d);
+	w.begin_array(v.size() * d);
+	for(const auto& s : v) {
+		if(s.size() != d)
+			throw std::invalid_argument("snapshot: the particles have different dimensions");
+		for(const auto& x : s)
+			w.write(x);
+	}
+}
+
+template<typename State>
+typename std::enable_if<!std::is_pod<State>::value>::type
+read_particles(Reader& r, std::vector<State>& v) {
+	typedef typename State::value_type T;
+	uint64_t n, d = 0;
+	check_layout(r, Containers, number_kind<T>(), sizeof(T), d);
+	const char* p = r.read_array(n, sizeof(T));
+	v.resize(particle_count(n, d));
+	for(auto& s : v) {
+		s.resize(d);
+		for(auto& x : s) {
+			std::memcpy(&x, p, sizeof(T));
+			p += sizeof(T);
+		}
+	}
+}
+
+// flat particle sets are stored like containers, so the snapshots of both are
+// interchangeable
+template<typename T>
+void write_particles(Writer& w, const FlatVector<T>& v) {
+	write_layout(w, Containers, number_kind<T>(), sizeof(T), v.dimension());
+	w.write_array(v.data(), v.size() * v.dimension());
+}
+
+template<typename T>
+void read_particles(Reader& r, FlatVector<T>& v) {
+	uint64_t n, d = 0;
+	check_layout(r, Containers, number_kind<T>(), sizeof(T), d);
+	const char* p = r.read_array(n, sizeof(T));
+	v.reshape(particle_count(n, d), d);
+	std::memcpy(v.data(), p, v.size() * d * sizeof(T));
+}
+
+template<typename T, size_t N>
+void write_particles(Writer& w, const SoAVector<T, N>& v) {
+	write_layout(w, Columns, number_kind<T>(), sizeof(T), N);
+	w.write(uint64_t(v.size()));
+	for(size_t j = 0; j < N; ++j)
+		w.write_array(v.column(j), v.size());
+}
+
+template<typename T, size_t N>
+void read_particles(Reader& r, SoAVector<T, N>& v) {
+	uint64_t n, d = N;
+	check_layout(r, Columns, number_kind<T>(), sizeof(T), d);
+	r.read(n);
+	v.resize(n);
+	for(size_t j = 0; j < N; ++j) {
+		uint64_t m;
+		const char* p = r.read_array(m, sizeof(T));
+		if(m != n)
+			throw std::runtime_error("snapshot: truncated");
+		std::memcpy(v.column(j), p, n * sizeof(T));
+	}
+}
+
+}}
+
+#endif
@@ -2,15 +2,55 @@
 #define _POLPF_STATE2OBS_H_
 
 #include <vector>
+#include <algorithm>
+
+#include "storage.h"
 
 namespace policy_pf {
 namespace state2obs {
 
+// state2obs maps the particles [begin, end) to observations, the observation
+// vector already has the size of the particle set
 template <typename State, typename Observation>
 class Identity {
 protected:
-	std::vector<State> state2obs(const std::vector<Observation>& obs) {
-		return obs;
+	// maps the whole particle set
+	std::vector<Observation> state2obs(const std::vector<State>& state_v) {
+		return std::vector<Observation>(state_v.begin(), state_v.end());
+	}
+
+	void state2obs(const std::vector<State>& state_v, std::vector<Observation>& obs_v, size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i)
+			obs_v[i] = state_v[i];
+	}
+
+	template<typename T, size_t N>
+	void state2obs(const SoAVector<T, N>& state_v, SoAVector<T, N>& obs_v, size_t begin, size_t end) {
+		for(size_t j = 0; j < N; ++j)
+			std::copy(state_v.column(j) + begin, state_v.column(j) + end, obs_v.column(j) + begin);
+	}
+
+	template<typename T>
+	void state2obs(const FlatVector<T>& state_v, FlatVector<T>& obs_v, size_t begin, size_t end) {
+		std::copy(state_v.row(begin), state_v.row(end), obs_v.row(begin));
+	}
+
+	// observe maps the particles [begin, end) to obs_v[0, end-begin), it is
+	// used by the fused execution of the particle filter
+	void observe(const std::vector<State>& state_v, size_t begin, size_t end, std::vector<Observation>& obs_v) {
+		for(size_t i = begin; i < end; ++i)
+			obs_v[i - begin] = state_v[i];
+	}
+
+	template<typename T, size_t N>
+	void observe(const SoAVector<T, N>& state_v, size_t begin, size_t end, SoAVector<T, N>& obs_v) {
+		for(size_t j = 0; j < N; ++j)
+			std::copy(state_v.column(j) + begin, state_v.column(j) + end, obs_v.column(j));
+	}
+
+	template<typename T>
+	void observe(const FlatVector<T>& state_v, size_t begin, size_t end, FlatVector<T>& obs_v) {
+		std::copy(state_v.row(begin), state_v.row(end), obs_v.row(0));
 	}
 };
 
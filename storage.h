@@ -0,0 +1,461 @@
+#ifndef _POLPF_STORAGE_H_
+#define _POLPF_STORAGE_H_
+
+#include <vector>
+#include <deque>
+#include <array>
+#include <algorithm>
+#include <type_traits>
+#include <new>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstddef>
+
+namespace policy_pf {
+
+// allocator returning memory aligned to Alignment bytes (a cache line by default)
+template<typename T, size_t Alignment = 64>
+class AlignedAllocator {
+public:
+	typedef T value_type;
+
+	template<typename U>
+	struct rebind {
+		typedef AlignedAllocator<U, Alignment> other;
+	};
+
+	AlignedAllocator() {}
+
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+	T* allocate(size_t n) {
+		void *p = nullptr;
+		if(posix_memalign(&p, Alignment, n * sizeof(T)) != 0)
+			throw std::bad_alloc();
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, size_t) {
+		free(p);
+	}
+
+	template<typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>&) const {
+		return true;
+	}
+
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment>&) const {
+		return false;
+	}
+};
+
+// fixed size arrays of scalars, C arrays T[N] and std::array<T, N>, which
+// are stored contiguously in a std::vector
+template<typename T>
+struct isFixedArray {
+	static const bool value = false;
+};
+
+template<typename T, size_t N>
+struct isFixedArray<T[N]> {
+	static const bool value = true;
+	typedef T element_type;
+	static const size_t dimensions = N;
+};
+
+template<typename T, size_t N>
+struct isFixedArray<std::array<T, N> > {
+	static const bool value = true;
+	typedef T element_type;
+	static const size_t dimensions = N;
+};
+
+// standard containers of variable size, std::vector and std::deque
+template<typename T> struct isContainer {static const bool value = false;};
+template<typename T> struct isContainer<std::vector<T> > {static const bool value = true;};
+template<typename T> struct isContainer<std::deque<T> > {static const bool value = true;};
+
+// State/observation type tag selecting structure of arrays storage for
+// N-dimensional states with elements of type T. A single state is
+// represented by std::array<T, N>.
+template<typename T, size_t N>
+struct SoA {};
+
+template<typename State> struct isSoA {static const bool value = false;};
+template<typename T, size_t N> struct isSoA<SoA<T, N> > {static const bool value = true;};
+
+// Stores N contiguous, aligned columns, one per state dimension, so loops
+// over the particles of a single dimension have unit stride.
+template<typename T, size_t N>
+class SoAVector {
+public:
+	typedef T element_type;
+	typedef std::array<T, N> value_type;
+	static const size_t dimensions = N;
+
+	SoAVector() : sz(0), stride(0) {}
+	explicit SoAVector(size_t sz) : sz(0), stride(0) {
+		resize(sz);
+	}
+
+	size_t size() const {
+		return sz;
+	}
+
+	// resizes all columns, new elements are zero initialized
+	void resize(size_t new_sz) {
+		if(new_sz == sz)
+			return;
+
+		const size_t lanes = 64 / sizeof(T) > 0 ? 64 / sizeof(T) : 1;
+		size_t new_stride = (new_sz + lanes - 1) / lanes * lanes;
+		if(new_stride != stride) {
+			std::vector<T, AlignedAllocator<T> > new_data(new_stride * N, 0);
+			for(size_t j = 0; j < N; ++j)
+				std::copy(column(j), column(j) + std::min(sz, new_sz), new_data.begin() + j*new_stride);
+			data.swap(new_data);
+			stride = new_stride;
+		} else if(new_sz > sz) {
+			for(size_t j = 0; j < N; ++j)
+				std::fill(column(j) + sz, column(j) + new_sz, T(0));
+		}
+		sz = new_sz;
+	}
+
+	void swap(SoAVector& other) {
+		data.swap(other.data);
+		std::swap(sz, other.sz);
+		std::swap(stride, other.stride);
+	}
+
+	T* column(size_t j) {
+		return data.data() + j*stride;
+	}
+
+	const T* column(size_t j) const {
+		return data.data() + j*stride;
+	}
+
+	T& operator()(size_t i, size_t j) {
+		return column(j)[i];
+	}
+
+	const T& operator()(size_t i, size_t j) const {
+		return column(j)[i];
+	}
+
+	value_type get(size_t i) const {
+		value_type s;
+		for(size_t j = 0; j < N; ++j)
+			s[j] = column(j)[i];
+		return s;
+	}
+
+	void set(size_t i, const value_type& s) {
+		for(size_t j = 0; j < N; ++j)
+			column(j)[i] = s[j];
+	}
+
+private:
+	std::vector<T, AlignedAllocator<T> > data;
+	size_t sz, stride;
+};
+
+// State/observation type tag selecting flat storage for states of elements of
+// type T whose dimension is only known at runtime. A single state or
+// observation is represented by std::vector<T>.
+template<typename T>
+struct Flat {};
+
+template<typename State> struct isFlat {static const bool value = false;};
+template<typename T> struct isFlat<Flat<T> > {static const bool value = true;};
+
+// view of the elements of a single particle of a FlatVector, T is const for
+// read-only views
+template<typename T>
+class FlatView {
+public:
+	typedef typename std::remove_const<T>::type value_type;
+
+	FlatView(T* p, size_t n) : p(p), n(n) {}
+
+	size_t size() const {
+		return n;
+	}
+
+	T* data() const {
+		return p;
+	}
+
+	T& operator[](size_t j) const {
+		return p[j];
+	}
+
+	T* begin() const {
+		return p;
+	}
+
+	T* end() const {
+		return p + n;
+	}
+
+	// copies the elements of another particle or state of the same size
+	template<typename Range>
+	const FlatView& operator=(const Range& s) const {
+		std::copy(s.begin(), s.end(), p);
+		return *this;
+	}
+
+	const FlatView& operator=(const FlatView& s) const {
+		std::copy(s.begin(), s.end(), p);
+		return *this;
+	}
+
+	operator std::vector<value_type>() const {
+		return std::vector<value_type>(p, p + n);
+	}
+
+private:
+	T* p;
+	size_t n;
+};
+
+// Stores all particles in a single aligned arena, particle i occupies the
+// elements [i*dimension, (i+1)*dimension). Resizing keeps the dimension, so
+// copying and resampling particles never allocates per particle.
+template<typename T>
+class FlatVector {
+public:
+	typedef T element_type;
+	typedef std::vector<T> value_type;
+	typedef FlatView<T> reference;
+	typedef FlatView<const T> const_reference;
+
+	FlatVector() : sz(0), dim(0) {}
+	FlatVector(size_t sz, size_t dim) : data_v(sz * dim, 0), sz(sz), dim(dim) {}
+
+	size_t size() const {
+		return sz;
+	}
+
+	size_t dimension() const {
+		return dim;
+	}
+
+	bool empty() const {
+		return sz == 0;
+	}
+
+	// resizes the particle set, new particles are zero initialized
+	void resize(size_t new_sz) {
+		data_v.resize(new_sz * dim, 0);
+		sz = new_sz;
+	}
+
+	void reshape(size_t new_sz, size_t new_dim) {
+		if(new_dim != dim) {
+			data_v.assign(new_sz * new_dim, 0);
+			dim = new_dim;
+		} else {
+			data_v.resize(new_sz * dim, 0);
+		}
+		sz = new_sz;
+	}
+
+	void swap(FlatVector& other) {
+		data_v.swap(other.data_v);
+		std::swap(sz, other.sz);
+		std::swap(dim, other.dim);
+	}
+
+	T* data() {
+		return data_v.data();
+	}
+
+	const T* data() const {
+		return data_v.data();
+	}
+
+	T* row(size_t i) {
+		return data_v.data() + i*dim;
+	}
+
+	const T* row(size_t i) const {
+		return data_v.data() + i*dim;
+	}
+
+	reference operator[](size_t i) {
+		return reference(row(i), dim);
+	}
+
+	const_reference operator[](size_t i) const {
+		return const_reference(row(i), dim);
+	}
+
+	T& operator()(size_t i, size_t j) {
+		return row(i)[j];
+	}
+
+	const T& operator()(size_t i, size_t j) const {
+		return row(i)[j];
+	}
+
+private:
+	std::vector<T, AlignedAllocator<T> > data_v;
+	size_t sz, dim;
+};
+
+// ParticleStorage selects the container holding a particle set (type) and
+// the type of a single particle or observation (value_type)
+template<typename State>
+struct ParticleStorage {
+	typedef std::vector<State> type;
+	typedef State value_type;
+};
+
+template<typename T, size_t N>
+struct ParticleStorage<SoA<T, N> > {
+	typedef SoAVector<T, N> type;
+	typedef std::array<T, N> value_type;
+};
+
+template<typename T>
+struct ParticleStorage<Flat<T> > {
+	typedef FlatVector<T> type;
+	typedef std::vector<T> value_type;
+};
+
+// Accumulator selects the type of sums over the particle set (the sum of the
+// weights, their cumulative sum and weighted means). Sums of float are
+// accumulated in double, so particles and weights may be stored as float
+// without losing the precision of sums over millions of particles.
+template<typename T>
+struct Accumulator {
+	typedef T type;
+};
+
+template<>
+struct Accumulator<float> {
+	typedef double type;
+};
+
+// copies the particles selected by the index vector idx into dst
+template<typename State, typename Index>
+void gather(const std::vector<State>& src, const std::vector<Index>& idx, std::vector<State>& dst) {
+	dst.resize(idx.size());
+	for(size_t k = 0; k < idx.size(); ++k)
+		dst[k] = src[idx[k]];
+}
+
+// moves the element at index from to index to, the element at from is left in
+// a valid but unspecified state
+template<typename State>
+void relocate(std::vector<State>& v, size_t from, size_t to) {
+	if(from != to)
+		std::swap(v[to], v[from]);
+}
+
+template<typename T, size_t N>
+void relocate(SoAVector<T, N>& v, size_t from, size_t to) {
+	for(size_t j = 0; j < N; ++j)
+		v.column(j)[to] = v.column(j)[from];
+}
+
+template<typename T>
+void relocate(FlatVector<T>& v, size_t from, size_t to) {
+	if(from != to)
+		std::copy(v.row(from), v.row(from) + v.dimension(), v.row(to));
+}
+
+// gathers only the entries [begin, end) of dst, which already has the size of idx
+template<typename State, typename Index>
+void gather(const std::vector<State>& src, const std::vector<Index>& idx, std::vector<State>& dst,
+		size_t begin, size_t end) {
+	for(size_t k = begin; k < end; ++k)
+		dst[k] = src[idx[k]];
+}
+
+template<typename T, size_t N, typename Index>
+void gather(const SoAVector<T, N>& src, const std::vector<Index>& idx, SoAVector<T, N>& dst,
+		size_t begin, size_t end) {
+	for(size_t j = 0; j < N; ++j) {
+		const T* s = src.column(j);
+		T* d = dst.column(j);
+		for(size_t k = begin; k < end; ++k)
+			d[k] = s[idx[k]];
+	}
+}
+
+template<typename T, size_t N, typename Index>
+void gather(const SoAVector<T, N>& src, const std::vector<Index>& idx, SoAVector<T, N>& dst) {
+	dst.resize(idx.size());
+	for(size_t j = 0; j < N; ++j) {
+		const T* s = src.column(j);
+		T* d = dst.column(j);
+		for(size_t k = 0; k < idx.size(); ++k)
+			d[k] = s[idx[k]];
+	}
+}
+
+template<typename T, typename Index>
+void gather(const FlatVector<T>& src, const std::vector<Index>& idx, FlatVector<T>& dst,
+		size_t begin, size_t end) {
+	const size_t d = src.dimension();
+	for(size_t k = begin; k < end; ++k)
+		std::copy(src.row(idx[k]), src.row(idx[k]) + d, dst.row(k));
+}
+
+template<typename T, typename Index>
+void gather(const FlatVector<T>& src, const std::vector<Index>& idx, FlatVector<T>& dst) {
+	dst.reshape(idx.size(), src.dimension());
+	gather(src, idx, dst, 0, idx.size());
+}
+
+// copies src[k] to the element idx[k] of dst, the inverse of gather
+template<typename State, typename Index>
+void scatter(const std::vector<State>& src, const std::vector<Index>& idx, std::vector<State>& dst) {
+	for(size_t k = 0; k < idx.size(); ++k)
+		dst[idx[k]] = src[k];
+}
+
+template<typename T, size_t N, typename Index>
+void scatter(const SoAVector<T, N>& src, const std::vector<Index>& idx, SoAVector<T, N>& dst) {
+	for(size_t j = 0; j < N; ++j) {
+		const T* s = src.column(j);
+		T* d = dst.column(j);
+		for(size_t k = 0; k < idx.size(); ++k)
+			d[idx[k]] = s[k];
+	}
+}
+
+template<typename T, typename Index>
+void scatter(const FlatVector<T>& src, const std::vector<Index>& idx, FlatVector<T>& dst) {
+	if(src.dimension() != dst.dimension() && !idx.empty())
+		throw std::invalid_argument("scatter: the particles have different dimensions");
+	for(size_t k = 0; k < idx.size(); ++k)
+		std::copy(src.row(k), src.row(k) + src.dimension(), dst.row(idx[k]));
+}
+
+// Resizes dst to n elements. Flat storage also takes the dimension of like,
+// which is a particle set of the same type or a single state or observation,
+// as the containers the particle filter resizes may not have a dimension yet.
+template<typename Container, typename Like>
+void resize_like(Container& dst, size_t n, const Like&) {
+	dst.resize(n);
+}
+
+template<typename T>
+void resize_like(FlatVector<T>& dst, size_t n, const FlatVector<T>& like) {
+	dst.reshape(n, like.dimension());
+}
+
+template<typename T, typename Like>
+void resize_like(FlatVector<T>& dst, size_t n, const Like& like) {
+	dst.reshape(n, like.size());
+}
+
+}
+
+#endif
@@ -0,0 +1,91 @@
+#include <vector>
+#include <array>
+#include <string>
+#include <iostream>
+#include <cmath>
+#include "ParticleFilter.h"
+
+// Compares a float filter, which accumulates its winner in double, with the
+// same filter in double. The particles lie around 1e4 with a spread of 1, so
+// float sums over 100000 particles would be off by far more than the
+// tolerance of a single rounding to float.
+
+using namespace policy_pf;
+
+static int failures = 0;
+
+// deterministic particles, exactly representable as float
+template<typename State>
+class Ramp {
+protected:
+	std::vector<State> init(unsigned int sz) {
+		std::vector<State> res(sz);
+		for(size_t i = 0; i < sz; ++i)
+			res[i] = State(10000 + (i % 128) / 128.0);
+		return res;
+	}
+};
+
+template<typename State>
+class NoNoise {
+protected:
+	template<typename Particles>
+	void noise(Particles&, size_t, size_t, unsigned int) {}
+};
+
+template<class S> using None = prediction_policies::None<S>;
+template<class S, class O> using Identity = state2obs::Identity<S, O>;
+template<class W, class O> using NormPdf = weight_policies::NormPdf<W, O>;
+template<class S, class W> using Mean = winner_policies::WeightedArithmeticMean<S, W>;
+template<class S, class W> using Moments = winner_policies::PosteriorMoments<S, W>;
+template<class S, class W> using Resampling = resampling_policies::SystematicResampling<S, W>;
+
+template<typename T, template<class, class> class Winner>
+struct Filter {
+	typedef ParticleFilter<T, T, T, None, Identity, NormPdf, Winner, Ramp, NoNoise, Resampling> type;
+};
+
+// runs one step without resampling, so the winner is evaluated on the
+// weighted initial particles
+template<typename PF>
+typename PF::Winner step(unsigned int threads, bool fused) {
+	PF pf(100000);
+	pf.setThreads(threads);
+	pf.setFusedExecution(fused);
+	pf.setResamplingThreshold(1e-9);
+	pf.setNormPdfSigma(0.25);
+	return pf.run(typename PF::Observation(10000.25));
+}
+
+void expect(const std::string& name, double value, double expected, double tolerance) {
+	if(!(std::fabs(value - expected) <= tolerance)) {
+		std::cout << "FAIL " << name << ": " << value << " expected " << expected << std::endl;
+		++failures;
+	}
+}
+
+int main() {
+	// half an ulp of a float around 1e4, plus the error of the float weights
+	const double ulp = 1.0 / 1024;
+
+	for(unsigned int threads : {1u, 4u}) {
+		for(bool fused : {false, true}) {
+			const std::string mode = std::to_string(threads) + " threads" + (fused ? ", fused" : "");
+
+			const float mf = step<typename Filter<float, Mean>::type>(threads, fused);
+			const double md = step<typename Filter<double, Mean>::type>(threads, fused);
+			expect("mean, " + mode, mf, md, ulp);
+
+			const auto pf = step<typename Filter<float, Moments>::type>(threads, fused);
+			const auto pd = step<typename Filter<double, Moments>::type>(threads, fused);
+			expect("moments mean, " + mode, pf.mean, pd.mean, ulp);
+			expect("moments covariance, " + mode, pf.covariance, pd.covariance, 1e-5 * pd.covariance);
+			expect("moments effective sample size, " + mode, pf.effective_sample_size,
+				pd.effective_sample_size, 1e-4 * pd.effective_sample_size);
+		}
+	}
+
+	if(failures == 0)
+		std::cout << "test_accumulation: OK" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
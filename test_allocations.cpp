@@ -0,0 +1,86 @@
+#include <vector>
+#include <array>
+#include <string>
+#include <atomic>
+#include <iostream>
+#include <cstdlib>
+#include <new>
+#include "ParticleFilter.h"
+
+// Checks that run() makes no heap allocation after the first step, as the
+// particle filter reuses its workspaces. Flat states return their winner as
+// a std::vector, which is the only allocation allowed for them; with threads
+// the partial sums of every range are vectors as well, so Flat states are
+// checked on one thread only.
+
+using namespace policy_pf;
+
+static std::atomic<size_t> allocations(0);
+
+__attribute__((noinline)) void* operator new(size_t n) {
+	++allocations;
+	void *p = std::malloc(n > 0 ? n : 1);
+	if(!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+static int failures = 0;
+
+template<typename PF>
+auto call_setInitDimension(PF& pf, int) -> decltype(pf.setInitDimension(4)) {
+	pf.setInitDimension(4);
+}
+
+template<typename PF>
+void call_setInitDimension(PF&, long) {}
+
+// runs 50 steps and compares the allocations of steps 2 to 50 with the
+// allowed number per step
+template<typename PF>
+void check(const std::string& name, const typename PF::Observation& obs, unsigned int threads,
+		size_t allowed_per_step = 0) {
+	PF pf(1000);
+	pf.setThreads(threads);
+	call_setInitDimension(pf, 0);
+	pf.run(obs);
+
+	const size_t before = allocations;
+	for(int k = 1; k < 50; ++k)
+		pf.run(obs);
+	const size_t count = allocations - before;
+
+	if(count > 49 * allowed_per_step) {
+		std::cout << "FAIL " << name << " with " << threads << " threads: " << count
+			<< " allocations after the first step" << std::endl;
+		++failures;
+	}
+}
+
+template<class S, class O> using LogPdf = weight_policies::LogNormPdf<S, O>;
+template<class S> using None = prediction_policies::None<S>;
+template<class S, class O> using Identity = state2obs::Identity<S, O>;
+
+int main() {
+	typedef std::array<double, 4> Array;
+	const Array a = {{0.5, 0.5, 0.5, 0.5}};
+	const std::vector<double> v(4, 0.5);
+
+	for(unsigned int threads : {1u, 4u}) {
+		check<ParticleFilter<double, double> >("double", 0.5, threads);
+		check<ParticleFilter<float, float, float> >("float", 0.5f, threads);
+		check<ParticleFilter<Array, Array> >("array<double,4>", a, threads);
+		check<ParticleFilter<Array, Array, double, None, Identity, LogPdf> >("array<double,4> log", a, threads);
+		check<ParticleFilter<SoA<double, 4>, SoA<double, 4> > >("SoA<double,4>", a, threads);
+		check<ParticleFilter<SoA<float, 4>, SoA<float, 4>, float> >("SoA<float,4>", {{0.5f, 0.5f, 0.5f, 0.5f}}, threads);
+	}
+	check<ParticleFilter<Flat<double>, Flat<double> > >("Flat<double>", v, 1, 1);
+
+	if(failures == 0)
+		std::cout << "test_allocations: OK" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
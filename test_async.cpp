@@ -0,0 +1,120 @@
+#include <vector>
+#include <array>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include "ParticleFilter.h"
+#include "async_filter.h"
+
+// Publishes values while other threads read them and checks that no reader
+// sees a partly written value or an older value than before, for plain old
+// data and for std::vector values. Then runs an AsyncFilter with sensor and
+// reader threads.
+
+using namespace policy_pf;
+
+static int failures = 0;
+
+void expect(const std::string& name, bool ok) {
+	if(!ok) {
+		std::cout << "FAIL " << name << std::endl;
+		++failures;
+	}
+}
+
+// all elements of the k-th value are k
+void fill(std::array<uint64_t, 12>& x, uint64_t k) { x.fill(k); }
+void fill(std::vector<uint64_t>& x, uint64_t k) { x.assign(4 + k % 8, k); }
+
+template<typename T>
+void check_published(const std::string& name, uint64_t values) {
+	Published<T> published;
+	std::atomic<bool> done(false);
+	std::atomic<uint64_t> torn(0), backwards(0);
+	std::vector<std::thread> readers;
+	for(int i = 0; i < 3; ++i) {
+		readers.push_back(std::thread([&]() {
+			T x;
+			uint64_t last = 0;
+			while(!done) {
+				const uint64_t n = published.load(x);
+				if(n == 0)
+					continue;
+				for(auto v : x)
+					if(v != n)
+						++torn;
+				if(n < last)
+					++backwards;
+				last = n;
+			}
+		}));
+	}
+	T x;
+	for(uint64_t k = 1; k <= values; ++k) {
+		fill(x, k);
+		published.publish(x);
+	}
+	done = true;
+	for(auto& t : readers)
+		t.join();
+
+	expect(name + ": torn values", torn == 0);
+	expect(name + ": older values", backwards == 0);
+	expect(name + ": last value", published.load(x) == values && x[0] == values);
+}
+
+template<class S> using None = prediction_policies::None<S>;
+typedef ParticleFilter<std::vector<double>, std::vector<double>, double, None> Filter;
+
+void check_filter() {
+	AsyncFilter<Filter> af(64, 1000);
+	af.filter().setInitDimension(2);
+	af.setCoalescing(true);
+
+	const AsyncFilter<Filter>::Estimate none = af.estimate();
+	expect("no estimate", none.steps == 0 && none.observations == 0 && none.winner.empty()
+		&& none.time == AsyncFilter<Filter>::Clock::time_point());
+
+	af.start();
+	std::atomic<bool> done(false);
+	std::atomic<uint64_t> backwards(0);
+	std::thread reader([&]() {
+		uint64_t last = 0;
+		while(!done) {
+			const AsyncFilter<Filter>::Estimate e = af.estimate();
+			if(e.steps < last || (e.steps > 0 && e.winner.size() != 2))
+				++backwards;
+			last = e.steps;
+		}
+	});
+	const std::vector<double> obs(2, 0.5);
+	uint64_t pushed = 0;
+	for(int k = 0; k < 500; ++k) {
+		if(af.push(obs))
+			++pushed;
+		std::this_thread::sleep_for(std::chrono::microseconds(20));
+	}
+	while(af.pending() > 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	af.stop();
+	done = true;
+	reader.join();
+
+	const AsyncFilter<Filter>::Estimate e = af.estimate();
+	expect("filter: estimates", backwards == 0);
+	expect("filter: observations", e.observations == pushed && pushed + af.dropped() == 500);
+	expect("filter: steps", e.steps + af.skipped() == e.observations);
+}
+
+int main() {
+	check_published<std::array<uint64_t, 12> >("plain old data", 1000000);
+	check_published<std::vector<uint64_t> >("std::vector", 200000);
+	check_filter();
+
+	if(failures == 0)
+		std::cout << "test_async: OK" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
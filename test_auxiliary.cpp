@@ -0,0 +1,55 @@
+#include <vector>
+#include <map>
+#include <string>
+#include <iostream>
+#include <cmath>
+#include "ParticleFilter.h"
+
+// Switches to the auxiliary mode while the unique ancestors of ancestor
+// resampling are pending and checks that they are copied by their
+// multiplicity, so the particle set keeps its size and its distribution.
+
+using namespace policy_pf;
+
+static int failures = 0;
+
+void expect(const std::string& name, bool ok) {
+	if(!ok) {
+		std::cout << "FAIL " << name << std::endl;
+		++failures;
+	}
+}
+
+typedef ParticleFilter<double, double> Filter;
+
+int main() {
+	Filter pf(1000);
+	pf.setAncestorResampling(true);
+	pf.run(0.5);
+
+	// the unique ancestors, weighted by their multiplicity
+	std::map<double, double> ancestors;
+	for(size_t i = 0; i < pf.getParticles().size(); ++i)
+		ancestors[pf.getParticles()[i]] += pf.getWeights()[i];
+	expect("ancestors are pending", pf.getParticles().size() < 1000 && pf.particleCount() == 1000);
+
+	pf.setAuxiliary(true);
+	expect("particle count", pf.particleCount() == 1000);
+	expect("particles", pf.getParticles().size() == 1000);
+	expect("weights", pf.getWeights().size() == 1000 && pf.getWeights()[0] == 1.0 / 1000);
+
+	std::map<double, double> copies;
+	for(size_t i = 0; i < pf.getParticles().size(); ++i)
+		copies[pf.getParticles()[i]] += 1.0 / 1000;
+	bool same = copies.size() == ancestors.size();
+	for(const auto& a : ancestors)
+		same = same && copies.count(a.first) && std::fabs(copies[a.first] - a.second) < 1e-12;
+	expect("multiplicities", same);
+
+	pf.run(0.5);
+	expect("particle count after an auxiliary step", pf.particleCount() == 1000);
+
+	if(failures == 0)
+		std::cout << "test_auxiliary: OK" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+#include <vector>
+#include <deque>
+#include <array>
+#include <string>
+#include <iostream>
+#include <cmath>
+#include <type_traits>
+#include "ParticleFilter.h"
+
+// Checks the default policies on std::array and std::vector states and
+// observations: the initial states are value-initialized and have the
+// dimension set with setInitDimension, noise is applied to every element,
+// the weight policies agree with those of fixed size arrays, and
+// WeightedArithmeticMean returns a std::array for C array states.
+
+using namespace policy_pf;
+
+static int failures = 0;
+
+void expect(const std::string& name, bool ok) {
+	if(!ok) {
+		std::cout << "FAIL " << name << std::endl;
+		++failures;
+	}
+}
+
+// leaves the states as they are constructed
+template<typename State>
+class Untouched {
+protected:
+	void apply_init(State&) {}
+};
+
+template<typename State, template<class> class ApplicationPolicy = init_policies::AutoDetectT>
+struct Init : init_policies::Gaussian_<State, ApplicationPolicy> {
+	using init_policies::Gaussian_<State, ApplicationPolicy>::init;
+};
+
+template<typename State>
+struct Noise : noise_policies::GaussianNoise<State> {
+	using noise_policies::GaussianNoise<State>::noise;
+};
+
+template<typename Observation>
+struct NormPdf : weight_policies::NormPdf<double, Observation> {
+	using weight_policies::NormPdf<double, Observation>::weight;
+};
+
+template<typename Observation>
+struct SquareError : weight_policies::SquareError<double, Observation> {
+	using weight_policies::SquareError<double, Observation>::weight;
+};
+
+template<typename State>
+struct Mean : winner_policies::WeightedArithmeticMean<State, double> {
+	using winner_policies::WeightedArithmeticMean<State, double>::winner;
+};
+
+void check_init() {
+	typedef std::array<double, 3> Array;
+	Init<Array, Untouched> untouched;
+	bool zero = true;
+	for(const auto& s : untouched.init(10))
+		zero = zero && s == Array();
+	expect("init: value-initialized std::array", zero);
+
+	Init<std::vector<double> > vectors;
+	vectors.setInitDimension(3);
+	bool sized = true;
+	for(const auto& s : vectors.init(10))
+		sized = sized && s.size() == 3;
+	expect("init: std::vector of the set dimension", sized);
+
+	Init<Array> arrays;
+	bool drawn = true;
+	for(const auto& s : arrays.init(10))
+		drawn = drawn && s[0] != 0 && s[1] != 0 && s[2] != 0;
+	expect("init: std::array elements drawn", drawn);
+}
+
+void check_noise() {
+	typedef std::array<double, 3> Array;
+	Noise<Array> arrays;
+	std::vector<Array> v(10, Array());
+	arrays.noise(v, 0, v.size(), 0);
+	bool changed = true;
+	for(const auto& s : v)
+		changed = changed && s[0] != 0 && s[1] != 0 && s[2] != 0;
+	expect("noise: every element of std::array", changed);
+
+	Noise<std::vector<double> > vectors;
+	std::vector<std::vector<double> > w(10, std::vector<double>(3, 0.0));
+	vectors.noise(w, 0, w.size(), 0);
+	changed = true;
+	for(const auto& s : w)
+		changed = changed && s[0] != 0 && s[1] != 0 && s[2] != 0;
+	expect("noise: every element of std::vector", changed);
+}
+
+// the same observations as std::array, std::vector and std::deque
+template<template<class> class Policy>
+void check_weights(const std::string& name) {
+	const size_t n = 50;
+	std::vector<std::array<double, 3> > arrays(n);
+	std::vector<std::vector<double> > vectors(n, std::vector<double>(3));
+	std::vector<std::deque<double> > deques(n, std::deque<double>(3));
+	for(size_t i = 0; i < n; ++i)
+		for(size_t j = 0; j < 3; ++j)
+			arrays[i][j] = vectors[i][j] = deques[i][j] = 0.1 * i - 0.7 * j;
+	const std::array<double, 3> obs = {{1.0, -0.5, 0.25}};
+
+	std::vector<double> a(n), v(n), d(n);
+	Policy<std::array<double, 3> > array_policy;
+	Policy<std::vector<double> > vector_policy;
+	Policy<std::deque<double> > deque_policy;
+	array_policy.weight(arrays, obs, a, 0, n);
+	vector_policy.weight(vectors, std::vector<double>(obs.begin(), obs.end()), v, 0, n);
+	deque_policy.weight(deques, std::deque<double>(obs.begin(), obs.end()), d, 0, n);
+
+	// particle 10 has the first coordinate of the observation, its SquareError is infinite
+	auto close = [](double x, double y) { return x == y || std::fabs(x - y) <= 1e-12 * y; };
+	bool same = true;
+	for(size_t i = 0; i < n; ++i)
+		same = same && close(v[i], a[i]) && close(d[i], a[i]);
+	expect(name + ": std::vector and std::deque like std::array", same);
+}
+
+void check_winner() {
+	typedef double Array[3];
+	static_assert(std::is_same<decltype(std::declval<Mean<Array>&>().winner(
+		std::declval<const std::vector<Array>&>(), std::declval<const std::vector<double>&>())),
+		std::array<double, 3> >::value, "the winner of C array states is a std::array");
+
+	std::vector<Array> v(4);
+	const std::vector<double> w = {0.125, 0.25, 0.5, 0.125};
+	for(size_t i = 0; i < v.size(); ++i)
+		for(size_t j = 0; j < 3; ++j)
+			v[i][j] = double(i + j);
+	Mean<Array> mean;
+	const std::array<double, 3> win = mean.winner(v, w);
+	// sum_i w_i * i = 1.625
+	expect("winner of C array states", win[0] == 1.625 && win[1] == 2.625 && win[2] == 3.625);
+}
+
+template<class S> using None = prediction_policies::None<S>;
+
+int main() {
+	check_init();
+	check_noise();
+	check_weights<NormPdf>("NormPdf");
+	check_weights<SquareError>("SquareError");
+	check_winner();
+
+	// filters with the default policies
+	ParticleFilter<std::array<double, 3>, std::array<double, 3> > arrays(1000);
+	const std::array<double, 3> win = arrays.run(std::array<double, 3>{{0.5, 0.5, 0.5}});
+	expect("filter of std::array states", std::isfinite(win[0]) && std::isfinite(win[2]));
+
+	ParticleFilter<std::vector<double>, std::vector<double>, double, None> vectors(1000);
+	vectors.setInitDimension(3);
+	const std::vector<double> v = vectors.run(std::vector<double>(3, 0.5));
+	expect("filter of std::vector states", v.size() == 3 && std::isfinite(v[0]) && std::isfinite(v[2]));
+
+	if(failures == 0)
+		std::cout << "test_containers: OK" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cmath>
+#include <cstdint>
+#include <unistd.h>
+#include "ParticleFilter.h"
+#include "island.h"
+
+// Forks 2 to 4 islands with the ring and the all-to-all topology. Every
+// island reports its results of every step through a pipe; the calling
+// process checks that all islands return the same winner and effective
+// sample size, that the effective sample size is aggregated from the island
+// weights, and that the migrants arrive unchanged at their neighbours.
+
+using namespace policy_pf;
+
+static int failures = 0;
+
+void expect(const std::string& name, bool ok) {
+	if(!ok) {
+		std::cout << "FAIL " << name << std::endl;
+		++failures;
+	}
+}
+
+// the particles of an island lie on the grid k + origin, k < 100, where
+// the origins of the islands are multiples of 1/8; so the islands overlap
+// and the island of a particle can be told from its value
+template<typename State>
+class Grid {
+public:
+	void setOrigin(double origin) {
+		this->origin = origin;
+	}
+
+protected:
+	std::vector<State> init(unsigned int sz) {
+		std::vector<State> res(sz);
+		for(size_t i = 0; i < sz; ++i)
+			res[i] = (i % 100) + origin;
+		return res;
+	}
+
+	double origin;
+};
+
+template<typename State>
+class NoNoise {
+protected:
+	template<typename Particles>
+	void noise(Particles&, size_t, size_t, unsigned int) {}
+};
+
+typedef ParticleFilter<double, double, double, prediction_policies::None, state2obs::Identity,
+	weight_policies::NormPdf, winner_policies::WeightedArithmeticMean, Grid, NoNoise> Filter;
+
+typedef island::IslandFilter<Filter> Island;
+
+const size_t Particles = 200, Migrants = 12, Steps = 6;
+
+// results of one island after a step
+struct Record {
+	uint32_t rank, step;
+	double winner, ess, local_ess, log_weight;
+	uint64_t particles;
+	uint32_t origins[4]; // number of particles from every island
+	uint32_t off_grid;   // particles which are no grid point of any island
+};
+
+Record run_island(Island& node, size_t step) {
+	Record rec = Record();
+	rec.rank = node.rank();
+	rec.step = step;
+	rec.winner = node.run(50.0 + step);
+	rec.ess = node.effectiveSampleSize();
+	rec.local_ess = node.filter().effectiveSampleSize();
+	rec.log_weight = node.logIslandWeight();
+	rec.particles = node.particleCount();
+	for(double x : node.filter().getParticles()) {
+		const double k = std::floor(x), o = (x - k) * 8;
+		if(k < 0 || k >= 100 || o != std::floor(o) || o >= node.islands())
+			++rec.off_grid;
+		else
+			++rec.origins[size_t(o)];
+	}
+	return rec;
+}
+
+// number of migrants island r receives from island s
+size_t received(island::Topology topology, unsigned int n, unsigned int r, unsigned int s) {
+	if(topology == island::Ring)
+		return s == (r + n - 1) % n ? Migrants : 0;
+	// the migrants are dealt to the other islands in the order of their ranks
+	auto dealt = [n](unsigned int i) { return (Migrants + (n - 1) - 1 - i) / (n - 1); };
+	auto index = [](unsigned int of, unsigned int in) { return of < in ? of : of - 1; };
+	return std::min(dealt(index(r, s)), dealt(index(s, r)));
+}
+
+void check(unsigned int n, island::Topology topology) {
+	const std::string name = std::to_string(n) + " islands, " + (topology == island::Ring ? "ring" : "all-to-all");
+	int results[2];
+	if(::pipe(results) != 0) {
+		expect(name + ": pipe", false);
+		return;
+	}
+
+	std::vector<Record> records;
+	bool forked = false;
+	{
+		Island node(island::UnixSocketTransport::fork(n), Particles);
+		node.setTopology(topology);
+		node.setMigrants(Migrants);
+		node.setExchangeInterval(2);
+		node.filter().setOrigin(node.rank() / 8.0);
+		node.filter().setNormPdfSigma(20 + 5 * node.rank());
+
+		if(node.rank() > 0) {
+			forked = true;
+			::close(results[0]);
+			for(size_t k = 0; k < Steps; ++k) {
+				const Record rec = run_island(node, k);
+				if(::write(results[1], &rec, sizeof(rec)) != sizeof(rec))
+					break;
+			}
+			::close(results[1]);
+		} else {
+			::close(results[1]);
+			for(size_t k = 0; k < Steps; ++k)
+				records.push_back(run_island(node, k));
+			Record rec;
+			while(::read(results[0], &rec, sizeof(rec)) == sizeof(rec))
+				records.push_back(rec);
+			::close(results[0]);
+		}
+	}
+	// the forked islands end once their transport has written its messages
+	if(forked)
+		::_exit(0);
+
+	expect(name + ": records", records.size() == n * Steps);
+	if(records.size() != n * Steps)
+		return;
+
+	// by step and rank
+	std::vector<std::vector<Record> > steps(Steps, std::vector<Record>(n));
+	for(const auto& rec : records)
+		steps[rec.step][rec.rank] = rec;
+
+	for(size_t k = 0; k < Steps; ++k) {
+		const std::vector<Record>& s = steps[k];
+		const std::string step = name + ", step " + std::to_string(k);
+		for(unsigned int r = 0; r < n; ++r) {
+			expect(step + ": same winner", s[r].winner == s[0].winner);
+			expect(step + ": same effective sample size", s[r].ess == s[0].ess);
+			expect(step + ": particle count", s[r].particles == n * Particles);
+			expect(step + ": migrants unchanged", s[r].off_grid == 0);
+		}
+
+		// the island weights of a step without exchange are those the
+		// effective sample size was aggregated with
+		if((k + 1) % 2 != 0) {
+			double total = 0, sq = 0;
+			for(unsigned int r = 0; r < n; ++r)
+				total += std::exp(s[r].log_weight);
+			for(unsigned int r = 0; r < n; ++r) {
+				const double a = std::exp(s[r].log_weight) / total;
+				sq += a * a / s[r].local_ess;
+			}
+			expect(step + ": aggregated effective sample size", std::fabs(s[0].ess - 1 / sq) <= 1e-9 * s[0].ess);
+			expect(step + ": effective sample size of all islands", s[0].ess > s[0].local_ess);
+		}
+	}
+
+	// the first exchange, after the second step
+	const std::vector<Record>& s = steps[1];
+	for(unsigned int r = 0; r < n; ++r) {
+		size_t foreign = 0;
+		for(unsigned int o = 0; o < n; ++o)
+			if(o != r) {
+				expect(name + ": migrants of island " + std::to_string(o) + " at island " + std::to_string(r),
+					s[r].origins[o] == received(topology, n, r, o));
+				foreign += s[r].origins[o];
+			}
+		expect(name + ": own particles of island " + std::to_string(r), s[r].origins[r] == Particles - foreign);
+	}
+}
+
+int main() {
+	for(unsigned int n = 2; n <= 4; ++n) {
+		check(n, island::Ring);
+		check(n, island::AllToAll);
+	}
+
+	if(failures == 0)
+		std::cout << "test_island: OK" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cmath>
+#include "ParticleFilter.h"
+
+// Checks that GaussianNoise calls application policies which only implement
+// apply_noise(State&) on the whole particle set, that policies taking a
+// stream are called per state for a range, and that filters using them run
+// on several threads.
+
+using namespace policy_pf;
+
+static int failures = 0;
+
+void expect(const std::string& name, bool ok) {
+	if(!ok) {
+		std::cout << "FAIL " << name << std::endl;
+		++failures;
+	}
+}
+
+// the interface of the application policies before the range form
+template<typename State>
+class AddOne : public noise_policies::GaussianNoiseBase<State> {
+protected:
+	void apply_noise(State& s) {
+		s += 1;
+	}
+};
+
+// adds the number of the stream
+template<typename State>
+class AddStream : public noise_policies::GaussianNoiseBase<State> {
+protected:
+	void apply_noise(State& s, unsigned int stream) {
+		s += stream;
+	}
+};
+
+template<template<class> class ApplicationPolicy>
+struct Noise : noise_policies::GaussianNoise_<double, ApplicationPolicy> {
+	using noise_policies::GaussianNoise_<double, ApplicationPolicy>::noise;
+};
+
+template<typename N>
+auto has_range(N& n, int) -> decltype(n.noise(std::declval<std::vector<double>&>(), size_t(), size_t(), 0u), bool()) {
+	return true;
+}
+
+template<typename N>
+bool has_range(N&, long) {
+	return false;
+}
+
+template<class S> using AddOneNoise = noise_policies::GaussianNoise_<S, AddOne>;
+template<class S> using AddStreamNoise = noise_policies::GaussianNoise_<S, AddStream>;
+
+template<template<class> class NoisePolicy>
+void check_filter(const std::string& name) {
+	typedef ParticleFilter<double, double, double, prediction_policies::None, state2obs::Identity,
+		weight_policies::NormPdf, winner_policies::WeightedArithmeticMean, init_policies::Gaussian,
+		NoisePolicy> PF;
+	for(unsigned int threads : {1u, 4u}) {
+		PF pf(1000);
+		pf.setThreads(threads);
+		double winner = 0;
+		for(int k = 0; k < 5; ++k)
+			winner = pf.run(0.5);
+		expect(name + " with " + std::to_string(threads) + " threads",
+			std::isfinite(winner) && pf.particleCount() == 1000);
+	}
+}
+
+int main() {
+	Noise<AddOne> add_one;
+	std::vector<double> v(10, 0.0);
+	add_one.noise(v);
+	expect("apply_noise(State&): whole particle set", v == std::vector<double>(10, 1.0));
+	expect("apply_noise(State&): no range form", !has_range(add_one, 0));
+
+	Noise<AddStream> add_stream;
+	v.assign(10, 0.0);
+	add_stream.noise(v, 2, 5, 3);
+	std::vector<double> expected(10, 0.0);
+	for(size_t i = 2; i < 5; ++i)
+		expected[i] = 3;
+	expect("apply_noise(State&, stream): range", v == expected);
+
+	Noise<noise_policies::AutoDetectT> gaussian;
+	expect("AutoDetect: range form", has_range(gaussian, 0));
+
+	check_filter<AddOneNoise>("apply_noise(State&)");
+	check_filter<AddStreamNoise>("apply_noise(State&, stream)");
+
+	if(failures == 0)
+		std::cout << "test_noise: OK" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cmath>
+#include "ParticleFilter.h"
+#include "sensor.h"
+
+// Implements the state2obs and the weight policy in each of their forms: the
+// range form, the form filling a given container and the form returning a
+// new one. Sensors and particle filters must compute the same likelihoods
+// with every combination, with and without threads.
+
+using namespace policy_pf;
+
+static int failures = 0;
+
+void expect(const std::string& name, bool ok) {
+	if(!ok) {
+		std::cout << "FAIL " << name << std::endl;
+		++failures;
+	}
+}
+
+inline double observe(double x) { return 2 * x; }
+inline double likelihood(double o, double obs) { return std::exp(-(o - obs) * (o - obs) / 50); }
+
+template<typename State, typename Obs>
+class RangeState2Obs {
+protected:
+	void state2obs(const std::vector<State>& state_v, std::vector<Obs>& obs_v, size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i)
+			obs_v[i] = observe(state_v[i]);
+	}
+};
+
+template<typename State, typename Obs>
+class FillState2Obs {
+protected:
+	void state2obs(const std::vector<State>& state_v, std::vector<Obs>& obs_v) {
+		obs_v.resize(state_v.size());
+		for(size_t i = 0; i < state_v.size(); ++i)
+			obs_v[i] = observe(state_v[i]);
+	}
+};
+
+template<typename State, typename Obs>
+class ReturnState2Obs {
+protected:
+	std::vector<Obs> state2obs(const std::vector<State>& state_v) {
+		std::vector<Obs> obs_v(state_v.size());
+		for(size_t i = 0; i < state_v.size(); ++i)
+			obs_v[i] = observe(state_v[i]);
+		return obs_v;
+	}
+};
+
+template<typename Weight, typename Obs>
+class RangeWeight {
+protected:
+	void weight(const std::vector<Obs>& obs_v, const Obs& obs, std::vector<Weight>& weight_v, size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i)
+			weight_v[i] = likelihood(obs_v[i], obs);
+	}
+};
+
+template<typename Weight, typename Obs>
+class FillWeight {
+protected:
+	void weight(const std::vector<Obs>& obs_v, const Obs& obs, std::vector<Weight>& weight_v) {
+		weight_v.resize(obs_v.size());
+		for(size_t i = 0; i < obs_v.size(); ++i)
+			weight_v[i] = likelihood(obs_v[i], obs);
+	}
+};
+
+template<typename Weight, typename Obs>
+class ReturnWeight {
+protected:
+	std::vector<Weight> weight(const std::vector<Obs>& obs_v, const Obs& obs) {
+		std::vector<Weight> weight_v(obs_v.size());
+		for(size_t i = 0; i < obs_v.size(); ++i)
+			weight_v[i] = likelihood(obs_v[i], obs);
+		return weight_v;
+	}
+};
+
+// the particles 0, 0.1, ..., 99.9
+template<typename State>
+class Grid {
+protected:
+	std::vector<State> init(unsigned int sz) {
+		std::vector<State> res(sz);
+		for(size_t i = 0; i < sz; ++i)
+			res[i] = 0.1 * i;
+		return res;
+	}
+};
+
+template<typename State>
+class NoNoise {
+protected:
+	template<typename Particles>
+	void noise(Particles&, size_t, size_t, unsigned int) {}
+};
+
+const size_t N = 1000;
+const double Obs = 60;
+
+template<template<class, class> class State2Obs, template<class, class> class WeightPolicy>
+void check(const std::string& name) {
+	std::vector<double> particles(N);
+	for(size_t i = 0; i < N; ++i)
+		particles[i] = 0.1 * i;
+
+	for(unsigned int threads = 1; threads <= 4; threads += 3) {
+		const std::string run = name + ", " + std::to_string(threads) + " threads";
+		ThreadPool pool(threads);
+		Sensor<double, double, double, State2Obs, WeightPolicy> sensor;
+		sensor.map(particles, Obs, &pool);
+		sensor.weigh(Obs, &pool);
+		bool same = sensor.weights().size() == N;
+		for(size_t i = 0; same && i < N; ++i)
+			same = sensor.weights()[i] == likelihood(observe(particles[i]), Obs);
+		expect(run + ": sensor", same);
+
+		// without resampling the weights of the filter are the normalized likelihoods
+		ParticleFilter<double, double, double, prediction_policies::None, State2Obs, WeightPolicy,
+			winner_policies::WeightedArithmeticMean, Grid, NoNoise> pf(N);
+		pf.setThreads(threads);
+		pf.setResamplingThreshold(0);
+		pf.run(Obs);
+		double sum = 0;
+		for(double l : sensor.weights())
+			sum += l;
+		same = pf.getWeights().size() == N;
+		for(size_t i = 0; same && i < N; ++i)
+			same = std::fabs(pf.getWeights()[i] - sensor.weights()[i] / sum) <= 1e-12 * sensor.weights()[i] / sum;
+		expect(run + ": filter", same);
+
+		// the same with the reading of the sensor
+		ParticleFilter<double, double, double, prediction_policies::None, state2obs::Identity,
+			weight_policies::NormPdf, winner_policies::WeightedArithmeticMean, Grid, NoNoise> updated(N);
+		updated.setThreads(threads);
+		updated.setResamplingThreshold(0);
+		updated.update(sensor.reading(Obs));
+		expect(run + ": update", updated.getWeights() == pf.getWeights());
+	}
+}
+
+int main() {
+	check<RangeState2Obs, RangeWeight>("range state2obs, range weight");
+	check<RangeState2Obs, FillWeight>("range state2obs, filling weight");
+	check<FillState2Obs, ReturnWeight>("filling state2obs, returned weight");
+	check<ReturnState2Obs, RangeWeight>("returned state2obs, range weight");
+
+	if(failures == 0)
+		std::cout << "test_sensor: OK" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+#include <vector>
+#include <array>
+#include <string>
+#include <random>
+#include <limits>
+#include <iostream>
+#include <cmath>
+#include "ParticleFilter.h"
+
+// Compares the SSE2, AVX2 and AVX-512 kernels supported by the cpu with the
+// portable ones, for lengths which are no multiple of the vector width, and
+// checks the documented accuracy and special values of the vectorized exp.
+// Then compares the NormPdf and SquareError policies with the scalar code
+// they replaced.
+
+using namespace policy_pf;
+
+static int failures = 0;
+
+template<typename T>
+void expect(const std::string& name, size_t n, size_t i, T value, T expected, double tolerance) {
+	const bool same = (std::isnan(value) && std::isnan(expected)) || value == expected
+		|| std::fabs(double(value) - expected) <= tolerance * std::fabs(double(expected));
+	if(!same) {
+		std::cout << "FAIL " << name << ", n = " << n << ", element " << i << ": " << value
+			<< " expected " << expected << std::endl;
+		++failures;
+	}
+}
+
+template<typename T> struct Limits;
+
+// relative errors documented in simd.h, arguments of exp for which the
+// result is normal
+template<> struct Limits<double> {
+	static double rounding() { return 2 * std::numeric_limits<double>::epsilon(); }
+	static double exp() { return 5e-16; }
+	static double lo() { return -708; }
+	static double hi() { return 709; }
+};
+
+template<> struct Limits<float> {
+	static double rounding() { return 2 * std::numeric_limits<float>::epsilon(); }
+	static double exp() { return 2.5e-7; }
+	static double lo() { return -87; }
+	static double hi() { return 88; }
+};
+
+template<typename Ops>
+void check(const std::string& name) {
+	typedef typename Ops::T T;
+	typedef Limits<T> L;
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<T> x_dist(-10, 10), exp_dist(L::lo(), L::hi());
+
+	// all tails up to twice the vector width, and a long array
+	std::vector<size_t> lengths;
+	for(size_t n = 0; n <= 2 * Ops::width + 1; ++n)
+		lengths.push_back(n);
+	lengths.push_back(1000 + Ops::width / 2 + 1);
+
+	for(size_t n : lengths) {
+		for(size_t stride : {1, 3}) {
+			std::vector<T> x(n * stride), acc(n), expected(n);
+			for(T& v : x)
+				v = x_dist(gen);
+			for(size_t i = 0; i < n; ++i)
+				acc[i] = expected[i] = x_dist(gen) + 10;
+
+			const T o = T(0.25);
+			simd::accumulate_square<T, T>(x.data(), n, stride, o, expected.data());
+			Ops::accumulate_square(x.data(), n, stride, o, acc.data());
+			for(size_t i = 0; i < n; ++i)
+				expect(name + " accumulate_square", n, i, acc[i], expected[i], L::rounding());
+
+			simd::accumulate_inverse_square<T, T>(x.data(), n, stride, o, expected.data());
+			Ops::accumulate_inverse_square(x.data(), n, stride, o, acc.data());
+			for(size_t i = 0; i < n; ++i)
+				expect(name + " accumulate_inverse_square", n, i, acc[i], expected[i], L::rounding());
+		}
+
+		// a = 0.5 scales exactly, so only the error of exp remains
+		std::vector<T> in(n), out(n), expected(n);
+		for(T& v : in)
+			v = exp_dist(gen);
+		simd::scaled_exp<T>(in.data(), n, T(1), T(0.5), expected.data());
+		Ops::scaled_exp(in.data(), n, T(1), T(0.5), out.data());
+		for(size_t i = 0; i < n; ++i)
+			expect(name + " scaled_exp", n, i, out[i], expected[i], L::exp());
+
+		// in place
+		Ops::scaled_exp(in.data(), n, T(1), T(0.5), in.data());
+		for(size_t i = 0; i < n; ++i)
+			expect(name + " scaled_exp in place", n, i, in[i], out[i], 0);
+	}
+
+	// results which are no normal numbers and NaN, in every lane
+	const T inf = std::numeric_limits<T>::infinity(), nan = std::numeric_limits<T>::quiet_NaN();
+	const T special[] = {T(-1000), T(1000), -inf, inf, nan, T(0)};
+	const T results[] = {T(0), inf, T(0), inf, nan, T(1)};
+	for(size_t k = 0; k < sizeof(special) / sizeof(special[0]); ++k) {
+		for(size_t lane = 0; lane < Ops::width; ++lane) {
+			std::vector<T> in(Ops::width, T(1)), out(Ops::width);
+			in[lane] = special[k];
+			Ops::scaled_exp(in.data(), in.size(), T(1), T(1), out.data());
+			expect(name + " scaled_exp special value", in.size(), lane, out[lane], results[k], 0);
+			for(size_t i = 0; i < in.size(); ++i)
+				if(i != lane)
+					expect(name + " scaled_exp next to special value", in.size(), i, out[i], T(std::exp(T(1))),
+						L::exp());
+		}
+	}
+}
+
+// calls the kernels of one instruction set
+#define POLPF_TEST_OPS(isa, Type) \
+struct isa##_##Type { \
+	typedef simd::isa::Type##Ops::T T; \
+	static const size_t width = simd::isa::Type##Ops::width; \
+	static void accumulate_square(const T* x, size_t n, size_t s, T o, T* acc) { \
+		simd::isa::accumulate_square<simd::isa::Type##Ops>(x, n, s, o, acc); \
+	} \
+	static void accumulate_inverse_square(const T* x, size_t n, size_t s, T o, T* acc) { \
+		simd::isa::accumulate_inverse_square<simd::isa::Type##Ops>(x, n, s, o, acc); \
+	} \
+	static void scaled_exp(const T* in, size_t n, T b, T a, T* out) { \
+		simd::isa::scaled_exp<simd::isa::Type##Ops>(in, n, b, a, out); \
+	} \
+};
+
+#ifdef POLPF_SIMD_X86
+POLPF_TEST_OPS(sse2, Double)
+POLPF_TEST_OPS(sse2, Float)
+POLPF_TEST_OPS(avx2, Double)
+POLPF_TEST_OPS(avx2, Float)
+POLPF_TEST_OPS(avx512, Double)
+POLPF_TEST_OPS(avx512, Float)
+#endif
+
+template<typename W, typename O>
+struct NormPdf : weight_policies::NormPdf<W, O> {
+	using weight_policies::NormPdf<W, O>::weight;
+};
+
+template<typename W, typename O>
+struct SquareError : weight_policies::SquareError<W, O> {
+	using weight_policies::SquareError<W, O>::weight;
+};
+
+// the scalar code the policies used before the vectorized kernels, for one
+// dimension; x is the difference of the state and the observation
+double baseline_norm_pdf(double x, double sigma, double mu) {
+	return 1.0/(sigma * sqrt(2*M_PI)) * pow(M_E, -((x-mu)*(x-mu))/(2.0*sigma*sigma));
+}
+
+template<typename T>
+double baseline_square_error(T x) {
+	return 1.0 / (x * x);
+}
+
+// the observations of one dimension
+template<typename T> T& coordinate(T& x, size_t) { return x; }
+template<typename T, size_t N> T& coordinate(std::array<T, N>& x, size_t j) { return x[j]; }
+
+template<typename T> size_t dimensions(const T&) { return 1; }
+template<typename T, size_t N> size_t dimensions(const std::array<T, N>&) { return N; }
+
+// Compares the policies with the scalar code, evaluated in double. Arrays
+// multiply the densities of their dimensions (see weight.h), so their
+// reference is the product of the baseline densities. The tolerance of
+// NormPdf is the relative error of the exp, plus the rounding of the
+// squared distance in the precision of W, which is amplified by the
+// exponent a: 4 * (1 + |a|) * epsilon of W. Results below the smallest
+// normal number of W are compared absolutely, as the vectorized exp flushes
+// them to zero below a = -708.39 (double) resp. -87.33 (float). The
+// tolerance of SquareError is the rounding of its terms, (4 + dimensions)
+// * epsilon of W.
+template<typename W, typename O>
+void check_policies(const std::string& name, double range) {
+	typedef decltype(coordinate(std::declval<O&>(), 0)) Reference;
+	typedef typename std::remove_reference<Reference>::type T;
+	const double sigma = 0.5, mu = 0.125;
+	const double eps = std::numeric_limits<W>::epsilon(), min = std::numeric_limits<W>::min();
+	const size_t n = 1003;
+
+	std::mt19937 gen(3);
+	std::uniform_real_distribution<double> dist(-range, range);
+	O obs = O();
+	const size_t dim = dimensions(obs);
+	for(size_t j = 0; j < dim; ++j)
+		coordinate(obs, j) = T(dist(gen));
+	std::vector<O> state_v(n);
+	for(auto& x : state_v)
+		for(size_t j = 0; j < dim; ++j)
+			coordinate(x, j) = T(coordinate(obs, j) + dist(gen));
+
+	NormPdf<W, O> norm_pdf;
+	norm_pdf.setNormPdfSigma(sigma);
+	norm_pdf.setNormPdfMu(mu);
+	SquareError<W, O> square_error;
+	std::vector<W> pdf(n), error(n);
+	norm_pdf.weight(state_v, obs, pdf, 0, n);
+	square_error.weight(state_v, obs, error, 0, n);
+
+	size_t flushed = 0;
+	for(size_t i = 0; i < n; ++i) {
+		double expected_pdf = 1, expected_error = 0, a = 0;
+		for(size_t j = 0; j < dim; ++j) {
+			const T x = coordinate(state_v[i], j) - coordinate(obs, j);
+			expected_pdf *= baseline_norm_pdf(x, sigma, mu);
+			expected_error += baseline_square_error(x);
+			a -= (x - mu) * (x - mu) / (2 * sigma * sigma);
+		}
+
+		if(expected_pdf < min) {
+			if(std::fabs(pdf[i] - expected_pdf) > min) {
+				std::cout << "FAIL " << name << " NormPdf, particle " << i << ": " << pdf[i] << " expected "
+					<< expected_pdf << std::endl;
+				++failures;
+			}
+			flushed += pdf[i] == 0;
+		} else {
+			expect(name + " NormPdf", n, i, double(pdf[i]), expected_pdf, 4 * (1 + std::fabs(a)) * eps);
+		}
+		expect(name + " SquareError", n, i, double(error[i]), double(W(expected_error)), (4 + dim) * eps);
+	}
+	if(flushed == 0) {
+		std::cout << "FAIL " << name << " NormPdf: no result flushed to zero" << std::endl;
+		++failures;
+	}
+}
+
+int main() {
+#ifdef POLPF_SIMD_X86
+	if(__builtin_cpu_supports("sse2")) {
+		check<sse2_Double>("sse2 double");
+		check<sse2_Float>("sse2 float");
+	}
+	if(__builtin_cpu_supports("avx2")) {
+		check<avx2_Double>("avx2 double");
+		check<avx2_Float>("avx2 float");
+	}
+	if(__builtin_cpu_supports("avx512f")) {
+		check<avx512_Double>("avx512 double");
+		check<avx512_Float>("avx512 float");
+	}
+#else
+	std::cout << "no vectorized kernels on this platform" << std::endl;
+#endif
+
+	// the ranges of the distances reach beyond the exponents which are flushed to zero
+	check_policies<double, double>("double", 25);
+	check_policies<float, float>("float", 9);
+	check_policies<double, std::array<double, 3> >("array<double,3>", 16);
+	check_policies<float, std::array<float, 3> >("array<float,3>", 6);
+
+	if(failures == 0)
+		std::cout << "test_simd: OK" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
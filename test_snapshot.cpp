@@ -0,0 +1,146 @@
+#include <vector>
+#include <array>
+#include <string>
+#include <iostream>
+#include <stdexcept>
+#include "ParticleFilter.h"
+
+// Restores filters from in-memory snapshots and checks that they continue
+// exactly like the original, including their settings, and that snapshots
+// of other types or with inconsistent arrays are rejected.
+
+using namespace policy_pf;
+
+static int failures = 0;
+
+void expect(const std::string& name, bool ok) {
+	if(!ok) {
+		std::cout << "FAIL " << name << std::endl;
+		++failures;
+	}
+}
+
+template<typename PF>
+void restore(PF& pf, const snapshot::Writer& w) {
+	snapshot::Reader r(w.data().data(), w.data().size());
+	pf.readSnapshot(r);
+}
+
+template<typename PF>
+bool rejects(const snapshot::Writer& w) {
+	PF pf(10);
+	try {
+		restore(pf, w);
+	} catch(const std::runtime_error&) {
+		return true;
+	}
+	return false;
+}
+
+// saves after 5 steps and compares the next 5 steps of the original and the
+// restored filter, which is created with the default settings
+template<typename PF, typename Setup>
+void check(const std::string& name, const typename PF::Observation& obs, Setup setup) {
+	PF a(1000);
+	setup(a);
+	for(int k = 0; k < 5; ++k)
+		a.run(obs);
+	snapshot::Writer w;
+	a.writeSnapshot(w);
+
+	PF b(10);
+	restore(b, w);
+	expect(name + ": log-likelihood", b.logLikelihood() == a.logLikelihood());
+	expect(name + ": particle count", b.particleCount() == a.particleCount());
+	for(int k = 0; k < 5; ++k)
+		expect(name + ": step " + std::to_string(k), b.run(obs) == a.run(obs));
+	expect(name + ": smoothed", b.smoothed(1) == a.smoothed(1));
+}
+
+// n numbers stored as container particles of dimension d
+template<typename Particles>
+bool rejects_particles(uint64_t n, uint64_t d) {
+	snapshot::Writer w;
+	const std::vector<double> numbers(n, 0.5);
+	snapshot::write_layout(w, snapshot::Containers, snapshot::number_kind<double>(), sizeof(double), d);
+	w.write_array(numbers.data(), numbers.size());
+	snapshot::Reader r(w.data().data(), w.data().size());
+	Particles v;
+	try {
+		snapshot::read_particles(r, v);
+	} catch(const std::invalid_argument&) {
+		return true;
+	}
+	return false;
+}
+
+typedef std::array<double, 2> Array;
+template<class W, class O> using LogPdf = weight_policies::LogNormPdf<W, O>;
+template<class S> using None = prediction_policies::None<S>;
+template<class S, class O> using Identity = state2obs::Identity<S, O>;
+typedef ParticleFilter<double, double> Scalar;
+typedef ParticleFilter<Array, Array, double, None, Identity, LogPdf> Log;
+
+int main() {
+	check<Scalar>("fused, fixed lag", 0.5, [](Scalar& pf) {
+		pf.setFusedExecution(true);
+		pf.setFixedLag(2);
+		pf.setResamplingThreshold(0.5);
+	});
+	check<Scalar>("auxiliary", 0.5, [](Scalar& pf) {
+		pf.setAuxiliary(true);
+		pf.setLookaheadExponent(0.5);
+		pf.setFixedLag(1);
+	});
+	check<Log>("ancestor resampling", Array{{0.5, 0.5}}, [](Log& pf) {
+		pf.setAncestorResampling(true);
+		pf.setFixedLag(3);
+	});
+
+	Scalar pf(100);
+	pf.run(0.5);
+	snapshot::Writer w;
+	pf.writeSnapshot(w);
+
+	// states of the same size, but of other numbers
+	expect("float[2] states", rejects<ParticleFilter<std::array<float, 2>, std::array<float, 2> > >(w));
+
+	// numbers of the same size, but of another kind
+	snapshot::Writer numbers;
+	const std::vector<double> weights(99, 0.01);
+	numbers.write_numbers(weights.data(), weights.size());
+	snapshot::Reader r(numbers.data().data(), numbers.data().size());
+	std::vector<int64_t> integers;
+	bool rejected = false;
+	try {
+		r.read_numbers(integers);
+	} catch(const std::runtime_error&) {
+		rejected = true;
+	}
+	expect("int64_t weights", rejected);
+
+	// a shorter weight array in front of the sections of the snapshot, padded
+	// so the arrays of the snapshot keep their alignment
+	const size_t header = 16;
+	snapshot::Writer bad;
+	bad.begin_section(snapshot::WeightsSection);
+	bad.write_numbers(weights.data(), weights.size());
+	while(bad.data().size() % snapshot::Alignment != header)
+		bad.write(char(0));
+	bad.end_section();
+	bad.write_bytes(w.data().data() + header, w.data().size() - header);
+	expect("weights of another length", rejects<Scalar>(bad));
+
+	// numbers which are no whole particles
+	typedef std::vector<std::vector<double> > Vectors;
+	expect("vector particles of dimension 3", !rejects_particles<Vectors>(12, 3));
+	expect("10 numbers of dimension 3", rejects_particles<Vectors>(10, 3));
+	expect("numbers of dimension 0", rejects_particles<Vectors>(4, 0));
+	expect("flat particles of dimension 3", !rejects_particles<FlatVector<double> >(12, 3));
+	expect("10 flat numbers of dimension 3", rejects_particles<FlatVector<double> >(10, 3));
+	expect("flat numbers of dimension 0", rejects_particles<FlatVector<double> >(4, 0));
+
+	if(failures == 0)
+		std::cout << "test_snapshot: OK" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,58 @@
+#include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <iostream>
+#include "thread_pool.h"
+
+// Throws from the work of the calling thread and of the workers and checks
+// that run rethrows the first exception only after all threads have
+// finished, and that the pool can be used again afterwards.
+
+using namespace policy_pf;
+
+static int failures = 0;
+
+void expect(const std::string& name, bool ok) {
+	if(!ok) {
+		std::cout << "FAIL " << name << std::endl;
+		++failures;
+	}
+}
+
+// runs work on a pool of 4 threads, thread thrower throws at once, the
+// others finish after a while; returns the message of the exception
+std::string check(ThreadPool& pool, unsigned int thrower, std::atomic<unsigned int>& finished) {
+	finished = 0;
+	try {
+		pool.run([thrower, &finished](unsigned int t) {
+			if(t == thrower)
+				throw std::runtime_error("thread " + std::to_string(t));
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			++finished;
+		});
+	} catch(const std::runtime_error& e) {
+		return e.what();
+	}
+	return "";
+}
+
+int main() {
+	ThreadPool pool(4);
+	std::atomic<unsigned int> finished(0);
+
+	expect("calling thread: exception", check(pool, 0, finished) == "thread 0");
+	expect("calling thread: workers finished", finished == 3);
+
+	expect("worker: exception", check(pool, 2, finished) == "thread 2");
+	expect("worker: other threads finished", finished == 3);
+
+	finished = 0;
+	pool.run([&finished](unsigned int) { ++finished; });
+	expect("work after exceptions", finished == 4);
+
+	if(failures == 0)
+		std::cout << "test_thread_pool: OK" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
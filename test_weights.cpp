@@ -0,0 +1,85 @@
+#include <vector>
+#include <array>
+#include <string>
+#include <random>
+#include <limits>
+#include <iostream>
+#include <cmath>
+#include "ParticleFilter.h"
+
+// Checks that LogSquareError is the logarithm of SquareError for every kind
+// of observation, and that it stays finite where SquareError overflows.
+
+using namespace policy_pf;
+
+static int failures = 0;
+
+void expect(const std::string& name, size_t i, double value, double expected, double tolerance) {
+	const bool same = value == expected || std::fabs(value - expected) <= tolerance * std::fabs(expected);
+	if(!same) {
+		std::cout << "FAIL " << name << ", particle " << i << ": " << value << " expected " << expected << std::endl;
+		++failures;
+	}
+}
+
+template<typename O>
+struct SquareError : weight_policies::SquareError<double, O> {
+	using weight_policies::SquareError<double, O>::weight;
+};
+
+template<typename O>
+struct LogSquareError : weight_policies::LogSquareError<double, O> {
+	using weight_policies::LogSquareError<double, O>::weight;
+};
+
+// sets coordinate j of particle i of the different particle containers
+void set(std::vector<double>& v, size_t i, size_t, double x) { v[i] = x; }
+template<typename P> void set(std::vector<P>& v, size_t i, size_t j, double x) { v[i][j] = x; }
+template<typename T, size_t N> void set(SoAVector<T, N>& v, size_t i, size_t j, double x) { v(i, j) = x; }
+template<typename T> void set(FlatVector<T>& v, size_t i, size_t j, double x) { v(i, j) = x; }
+
+void set(double& obs, size_t, double x) { obs = x; }
+template<typename O> void set(O& obs, size_t j, double x) { obs[j] = x; }
+
+// the first coordinates of the first particles have errors which overflow
+// SquareError, resp. are zero
+template<typename O, typename Particles, typename Observation>
+void check(const std::string& name, Particles particles, Observation obs, size_t dim) {
+	std::mt19937 gen(7);
+	std::uniform_real_distribution<double> dist(-3, 3);
+	const size_t n = particles.size();
+	for(size_t j = 0; j < dim; ++j) {
+		set(obs, j, dist(gen));
+		for(size_t i = 0; i < n; ++i)
+			set(particles, i, j, dist(gen));
+	}
+	set(obs, 0, 0);
+	set(particles, 0, 0, 1e-200);
+	set(particles, 1, 0, 0);
+
+	std::vector<double> w(n), log_w(n);
+	SquareError<O> square_error;
+	LogSquareError<O> log_square_error;
+	square_error.weight(particles, obs, w, 0, n);
+	log_square_error.weight(particles, obs, log_w, 0, n);
+
+	for(size_t i = 2; i < n; ++i)
+		expect(name, i, log_w[i], std::log(w[i]), 1e-12);
+	expect(name + " error 1e-200", 0, log_w[0], -2 * std::log(1e-200), 1e-12);
+	expect(name + " zero error", 1, log_w[1], std::numeric_limits<double>::infinity(), 0);
+}
+
+int main() {
+	const size_t n = 100;
+	check<double>("double", std::vector<double>(n), 0.0, 1);
+	check<std::array<double, 3> >("array<double,3>", std::vector<std::array<double, 3> >(n),
+		std::array<double, 3>(), 3);
+	check<std::vector<double> >("vector<double>", std::vector<std::vector<double> >(n, std::vector<double>(3)),
+		std::vector<double>(3), 3);
+	check<SoA<double, 3> >("SoA<double,3>", SoAVector<double, 3>(n), std::array<double, 3>(), 3);
+	check<Flat<double> >("Flat<double>", FlatVector<double>(n, 3), std::vector<double>(3), 3);
+
+	if(failures == 0)
+		std::cout << "test_weights: OK" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+#ifndef _POLPF_THREAD_POOL_H_
+#define _POLPF_THREAD_POOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <exception>
+#include <utility>
+#include <cstddef>
+
+namespace policy_pf {
+
+// Fixed size pool of worker threads. The calling thread takes part in the
+// work as thread 0, so a pool of size 1 does not start any thread.
+// Dispatching work does not allocate memory. An exception thrown by the work
+// of any thread is rethrown by run once all threads have finished.
+class ThreadPool {
+public:
+	explicit ThreadPool(unsigned int num_threads)
+			: num_threads(num_threads > 0 ? num_threads : 1), ranges(this->num_threads),
+			generation(0), pending(0), stop(false), task(nullptr), context(nullptr) {
+		for(unsigned int t = 1; t < this->num_threads; ++t)
+			workers.push_back(std::thread(&ThreadPool::work, this, t));
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		start.notify_all();
+		for(auto& w : workers)
+			w.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned int size() const {
+		return num_threads;
+	}
+
+	// calls f(t) once for every thread t in [0, size()) and waits until all
+	// calls have returned; rethrows the first exception thrown by a call
+	template<typename F>
+	void run(const F& f) {
+		if(num_threads == 1) {
+			f(0);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			task = &invoke<F>;
+			context = &f;
+			pending = num_threads - 1;
+			++generation;
+		}
+		start.notify_all();
+
+		try {
+			f(0);
+		} catch(...) {
+			fail();
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		while(pending > 0)
+			done.wait(lock);
+		std::exception_ptr e;
+		std::swap(e, error);
+		lock.unlock();
+		if(e)
+			std::rethrow_exception(e);
+	}
+
+	// splits [0, n) into size() contiguous chunks and calls f(begin, end, chunk)
+	// for each of them; chunk t is always processed by thread t
+	template<typename F>
+	void parallel_for(size_t n, const F& f) {
+		const unsigned int T = num_threads;
+		run([&](unsigned int t) {
+			f(n*t/T, n*(t+1)/T, t);
+		});
+	}
+
+	// Like parallel_for, but a thread which has finished its own chunk steals
+	// grain indices at a time from the chunks of the other threads. Use this
+	// if the cost per index varies; which thread processes an index is not
+	// deterministic.
+	template<typename F>
+	void stealing_for(size_t n, size_t grain, const F& f) {
+		const unsigned int T = num_threads;
+		for(unsigned int t = 0; t < T; ++t) {
+			ranges[t].next = n*t/T;
+			ranges[t].end = n*(t+1)/T;
+		}
+		run([&](unsigned int t) {
+			for(unsigned int k = 0; k < T; ++k) {
+				Range& r = ranges[(t + k) % T];
+				for(size_t begin = r.next.fetch_add(grain); begin < r.end; begin = r.next.fetch_add(grain))
+					f(begin, std::min(begin + grain, r.end), t);
+			}
+		});
+	}
+
+private:
+	template<typename F>
+	static void invoke(const void* f, unsigned int t) {
+		(*static_cast<const F*>(f))(t);
+	}
+
+	// keeps the current exception if it is the first one of the work
+	void fail() {
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!error)
+			error = std::current_exception();
+	}
+
+	void work(unsigned int t) {
+		unsigned long seen = 0;
+		for(;;) {
+			void (*fn)(const void*, unsigned int);
+			const void* ctx;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while(!stop && generation == seen)
+					start.wait(lock);
+				if(stop)
+					return;
+				seen = generation;
+				fn = task;
+				ctx = context;
+			}
+
+			try {
+				fn(ctx, t);
+			} catch(...) {
+				fail();
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if(--pending == 0)
+				done.notify_one();
+		}
+	}
+
+	unsigned int num_threads;
+	std::vector<std::thread> workers;
+
+	// chunks of stealing_for, padded to separate cache lines
+	struct Range {
+		std::atomic<size_t> next;
+		size_t end;
+		char padding[64];
+	};
+	std::vector<Range> ranges;
+
+	std::mutex mutex;
+	std::condition_variable start, done;
+	unsigned long generation;
+	unsigned int pending;
+	bool stop;
+
+	void (*task)(const void*, unsigned int);
+	const void* context;
+	std::exception_ptr error;
+};
+
+// calls f(begin, end, chunk) for the chunks of [0, n) on the pool, or once for
+// the whole range if there is no pool
+template<typename F>
+void parallel_for(ThreadPool* pool, size_t n, const F& f) {
+	if(pool)
+		pool->parallel_for(n, f);
+	else
+		f(0, n, 0);
+}
+
+// number of chunks parallel_for splits a range into
+inline unsigned int num_chunks(const ThreadPool* pool) {
+	return pool ? pool->size() : 1;
+}
+
+}
+
+#endif
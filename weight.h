@@ -4,30 +4,199 @@
 #include <vector>
 #include <type_traits>
 #include <cmath>
+#include <algorithm>
+#include <deque>
+#include <limits>
+
+#include "storage.h"
+#include "simd.h"
 
 namespace policy_pf {
 namespace weight_policies {
 
+// The weight policies compute the weights of the particles [begin, end), the
+// weight vector already has the size of the particle set.
+
+// Weight policies deriving from LogLikelihood return log-weights instead of
+// probabilities. The particle filter normalizes them using the log-sum-exp
+// trick, so peaked likelihoods do not underflow to zero.
+struct LogLikelihood {};
+
+template<typename WeightPolicy>
+struct isLogLikelihood : std::is_base_of<LogLikelihood, WeightPolicy> {};
+
+// squared euclidean distance between x and obs + mu, x may be a view of a
+// particle of a FlatVector
+template<typename X, typename Observation>
+double squared_distance(const X& x, const Observation& obs, double mu = 0) {
+	double d = 0;
+	for(size_t j = 0; j < obs.size(); ++j)
+		d += (x[j]-obs[j]-mu) * (x[j]-obs[j]-mu);
+	return d;
+}
+
 template<typename Weight, typename Observation, typename Enable = void>
 class SquareError_ {
 protected:
-	std::vector<Weight> weight(const std::vector<Observation>& state_v, const Observation& obs) {
-		std::vector<Weight> weight_v(state_v.size(), 0);
-		for(size_t i = 0; i < state_v.size(); ++i)
-			weight_v[i] = 1.0 / ((state_v[i]-obs) * (state_v[i]-obs));
-		return weight_v;
+	void weight(const std::vector<Observation>& state_v, const Observation& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		std::fill(weight_v.begin() + begin, weight_v.begin() + end, 0);
+		simd::accumulate_inverse_square(state_v.data() + begin, end - begin, 1, obs, weight_v.data() + begin);
+	}
+};
+
+template<typename Weight, typename Observation>
+class SquareError_<Weight, Observation, typename std::enable_if<isFixedArray<Observation>::value >::type> {
+protected:
+	void weight(const std::vector<Observation>& state_v, const Observation& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		typedef typename isFixedArray<Observation>::element_type T;
+		const size_t dim = isFixedArray<Observation>::dimensions;
+		std::fill(weight_v.begin() + begin, weight_v.begin() + end, 0);
+		for(size_t j = 0; j < dim; ++j)
+			simd::accumulate_inverse_square(reinterpret_cast<const T*>(state_v.data() + begin) + j,
+				end - begin, dim, obs[j], weight_v.data() + begin);
 	}
 };
 
+// structure of arrays specialization, each dimension is streamed separately
 template<typename Weight, typename Observation>
-class SquareError_<Weight, Observation, typename std::enable_if<std::is_array<Observation>::value >::type> {
+class SquareError_<Weight, Observation, typename std::enable_if<isSoA<Observation>::value >::type> {
 protected:
-	std::vector<Weight> weight(const std::vector<Observation>& state_v, const Observation& obs) {
-		std::vector<Weight> weight_v(state_v.size(), 0);
-		for(size_t i = 0; i < state_v.size(); ++i)
-			for(size_t j = 0; j < std::extent<Observation>::value; ++j)
-				weight_v[i] += 1.0 / ((state_v[i][j]-obs[j]) * (state_v[i][j]-obs[j]));
-		return weight_v;
+	typedef typename ParticleStorage<Observation>::type Particles;
+	typedef typename ParticleStorage<Observation>::value_type Value;
+
+	void weight(const Particles& state_v, const Value& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		std::fill(weight_v.begin() + begin, weight_v.begin() + end, 0);
+		for(size_t j = 0; j < Particles::dimensions; ++j)
+			simd::accumulate_inverse_square(state_v.column(j) + begin, end - begin, 1, obs[j], weight_v.data() + begin);
+	}
+};
+
+// flat specialization, the elements of a dimension have the stride of the dimension
+template<typename Weight, typename Observation>
+class SquareError_<Weight, Observation, typename std::enable_if<isFlat<Observation>::value >::type> {
+protected:
+	typedef typename ParticleStorage<Observation>::type Particles;
+	typedef typename ParticleStorage<Observation>::value_type Value;
+
+	void weight(const Particles& state_v, const Value& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		const size_t dim = state_v.dimension();
+		std::fill(weight_v.begin() + begin, weight_v.begin() + end, 0);
+		for(size_t j = 0; j < dim; ++j)
+			simd::accumulate_inverse_square(state_v.row(begin) + j, end - begin, dim, obs[j], weight_v.data() + begin);
+	}
+};
+
+template<typename Weight, typename Observation>
+class SquareError_<Weight, Observation, typename std::enable_if<isContainer<Observation>::value >::type> {
+protected:
+	void weight(const std::vector<Observation>& state_v, const Observation& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i) {
+			Weight w = 0;
+			for(size_t j = 0; j < obs.size(); ++j)
+				w += 1.0 / ((state_v[i][j]-obs[j]) * (state_v[i][j]-obs[j]));
+			weight_v[i] = w;
+		}
+	}
+};
+
+// log(exp(a) + exp(b)), without overflow for large a or b
+template<typename T>
+T log_add(T a, T b) {
+	const T m = std::max(a, b);
+	if(std::isinf(m))
+		return m;
+	return m + std::log1p(std::exp(std::min(a, b) - m));
+}
+
+// log(1/e^2)
+template<typename T>
+T log_inverse_square(T e) {
+	return -2 * std::log(std::fabs(e));
+}
+
+// log(sum_j 1/e_j^2), the logarithm of the weight of SquareError, where e_j
+// is the error of the dimension j of an observation. The terms are added
+// with log_add, so errors close to zero do not overflow.
+template<typename Weight, typename Observation, typename Enable = void>
+class LogSquareError_ : public LogLikelihood {
+protected:
+	void weight(const std::vector<Observation>& state_v, const Observation& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i)
+			weight_v[i] = log_inverse_square(Weight(state_v[i]-obs));
+	}
+};
+
+template<typename Weight, typename Observation>
+class LogSquareError_<Weight, Observation, typename std::enable_if<isFixedArray<Observation>::value >::type>
+	: public LogLikelihood {
+protected:
+	void weight(const std::vector<Observation>& state_v, const Observation& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i) {
+			Weight w = -std::numeric_limits<Weight>::infinity();
+			for(size_t j = 0; j < isFixedArray<Observation>::dimensions; ++j)
+				w = log_add(w, log_inverse_square(Weight(state_v[i][j]-obs[j])));
+			weight_v[i] = w;
+		}
+	}
+};
+
+template<typename Weight, typename Observation>
+class LogSquareError_<Weight, Observation, typename std::enable_if<isSoA<Observation>::value >::type>
+	: public LogLikelihood {
+protected:
+	typedef typename ParticleStorage<Observation>::type Particles;
+	typedef typename ParticleStorage<Observation>::value_type Value;
+
+	void weight(const Particles& state_v, const Value& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		std::fill(weight_v.begin() + begin, weight_v.begin() + end, -std::numeric_limits<Weight>::infinity());
+		for(size_t j = 0; j < Particles::dimensions; ++j) {
+			auto c = state_v.column(j);
+			for(size_t i = begin; i < end; ++i)
+				weight_v[i] = log_add(weight_v[i], log_inverse_square(Weight(c[i]-obs[j])));
+		}
+	}
+};
+
+template<typename Weight, typename Observation>
+class LogSquareError_<Weight, Observation, typename std::enable_if<isFlat<Observation>::value >::type>
+	: public LogLikelihood {
+protected:
+	typedef typename ParticleStorage<Observation>::type Particles;
+	typedef typename ParticleStorage<Observation>::value_type Value;
+
+	void weight(const Particles& state_v, const Value& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		const size_t dim = state_v.dimension();
+		for(size_t i = begin; i < end; ++i) {
+			const auto x = state_v.row(i);
+			Weight w = -std::numeric_limits<Weight>::infinity();
+			for(size_t j = 0; j < dim; ++j)
+				w = log_add(w, log_inverse_square(Weight(x[j]-obs[j])));
+			weight_v[i] = w;
+		}
+	}
+};
+
+template<typename Weight, typename Observation>
+class LogSquareError_<Weight, Observation, typename std::enable_if<isContainer<Observation>::value >::type>
+	: public LogLikelihood {
+protected:
+	void weight(const std::vector<Observation>& state_v, const Observation& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i) {
+			Weight w = -std::numeric_limits<Weight>::infinity();
+			for(size_t j = 0; j < obs.size(); ++j)
+				w = log_add(w, log_inverse_square(Weight(state_v[i][j]-obs[j])));
+			weight_v[i] = w;
+		}
 	}
 };
 
@@ -43,37 +212,196 @@ public:
 		this->mu = mu;
 	}
 
+	template<typename Writer>
+	void save_state(Writer& w) const {
+		w.write(sigma);
+		w.write(mu);
+	}
+
+	template<typename Reader>
+	void load_state(Reader& r) {
+		r.read(sigma);
+		r.read(mu);
+	}
+
 protected:
+	// normalization factor 1/(sigma*sqrt(2*pi)) of the density
+	double norm() const {
+		return 1.0 / (sigma * std::sqrt(2*M_PI));
+	}
+
+	// factor of the squared distance in the exponent
+	double exponent() const {
+		return -1.0 / (2.0*sigma*sigma);
+	}
+
 	double sigma, mu;
 };
 
 template<typename Weight, typename Observation, typename Enable = void>
 class NormPdf_ : public NormPdfBase {
 protected:
-	std::vector<Weight> weight(const std::vector<Observation>& state_v, const Observation& obs) {
-		std::vector<Weight> weight_v(state_v.size(), 0);
-		for(size_t i = 0; i < state_v.size(); ++i) {
-			auto x = (state_v[i]-obs);
-			weight_v[i] = 1.0/(sigma * sqrt(2*M_PI))
-				* pow(M_E, -((x-mu)*(x-mu))/(2.0*sigma*sigma));
-		}
-		return weight_v;
+	void weight(const std::vector<Observation>& state_v, const Observation& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		std::fill(weight_v.begin() + begin, weight_v.begin() + end, 0);
+		simd::accumulate_square(state_v.data() + begin, end - begin, 1, Observation(obs + mu), weight_v.data() + begin);
+		simd::scaled_exp(weight_v.data() + begin, end - begin, Weight(exponent()), Weight(norm()), weight_v.data() + begin);
 	}
 };
 
+// the dimensions are treated as independent, so the densities are multiplied
 template<typename Weight, typename Observation>
-class NormPdf_<Weight, Observation, typename std::enable_if<std::is_array<Observation>::value >::type>
+class NormPdf_<Weight, Observation, typename std::enable_if<isFixedArray<Observation>::value >::type>
 	: public NormPdfBase{
 protected:
-	std::vector<Weight> weight(const std::vector<Observation>& state_v, const Observation& obs) {
-		std::vector<Weight> weight_v(state_v.size(), 0);
-		for(size_t i = 0; i < state_v.size(); ++i)
-			for(size_t j = 0; j < std::extent<Observation>::value; ++j) {
-				auto x = (state_v[i][j]-obs[j]);
-				weight_v[i] += 1.0/(sigma * sqrt(2*M_PI))
-					* pow(M_E, -((x-mu)*(x-mu))/(2.0*sigma*sigma));
-			}
-		return weight_v;
+	void weight(const std::vector<Observation>& state_v, const Observation& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		typedef typename isFixedArray<Observation>::element_type T;
+		const size_t dim = isFixedArray<Observation>::dimensions;
+		std::fill(weight_v.begin() + begin, weight_v.begin() + end, 0);
+		for(size_t j = 0; j < dim; ++j)
+			simd::accumulate_square(reinterpret_cast<const T*>(state_v.data() + begin) + j,
+				end - begin, dim, T(obs[j] + mu), weight_v.data() + begin);
+		simd::scaled_exp(weight_v.data() + begin, end - begin, Weight(exponent()),
+			Weight(std::pow(norm(), (double) dim)), weight_v.data() + begin);
+	}
+};
+
+template<typename Weight, typename Observation>
+class NormPdf_<Weight, Observation, typename std::enable_if<isSoA<Observation>::value >::type>
+	: public NormPdfBase {
+protected:
+	typedef typename ParticleStorage<Observation>::type Particles;
+	typedef typename ParticleStorage<Observation>::value_type Value;
+
+	void weight(const Particles& state_v, const Value& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		squared_distances(state_v, obs, weight_v, begin, end);
+		simd::scaled_exp(weight_v.data() + begin, end - begin, Weight(exponent()),
+			Weight(std::pow(norm(), (double) Particles::dimensions)), weight_v.data() + begin);
+	}
+
+	// sum of the squared distances (x-obs-mu)^2 over all dimensions
+	void squared_distances(const Particles& state_v, const Value& obs, std::vector<Weight>& d,
+			size_t begin, size_t end) {
+		typedef typename Particles::element_type T;
+		std::fill(d.begin() + begin, d.begin() + end, 0);
+		for(size_t j = 0; j < Particles::dimensions; ++j)
+			simd::accumulate_square(state_v.column(j) + begin, end - begin, 1, T(obs[j] + mu), d.data() + begin);
+	}
+};
+
+template<typename Weight, typename Observation>
+class NormPdf_<Weight, Observation, typename std::enable_if<isFlat<Observation>::value >::type>
+	: public NormPdfBase {
+protected:
+	typedef typename ParticleStorage<Observation>::type Particles;
+	typedef typename ParticleStorage<Observation>::value_type Value;
+
+	void weight(const Particles& state_v, const Value& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		squared_distances(state_v, obs, weight_v, begin, end);
+		simd::scaled_exp(weight_v.data() + begin, end - begin, Weight(exponent()),
+			Weight(std::pow(norm(), (double) state_v.dimension())), weight_v.data() + begin);
+	}
+
+	// sum of the squared distances (x-obs-mu)^2 over all dimensions
+	void squared_distances(const Particles& state_v, const Value& obs, std::vector<Weight>& d,
+			size_t begin, size_t end) {
+		typedef typename Particles::element_type T;
+		const size_t dim = state_v.dimension();
+		std::fill(d.begin() + begin, d.begin() + end, 0);
+		for(size_t j = 0; j < dim; ++j)
+			simd::accumulate_square(state_v.row(begin) + j, end - begin, dim, T(obs[j] + mu), d.data() + begin);
+	}
+};
+
+template<typename Weight, typename Observation>
+class NormPdf_<Weight, Observation, typename std::enable_if<isContainer<Observation>::value >::type>
+	: public NormPdfBase {
+protected:
+	void weight(const std::vector<Observation>& state_v, const Observation& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i)
+			weight_v[i] = squared_distance(state_v[i], obs, mu);
+		simd::scaled_exp(weight_v.data() + begin, end - begin, Weight(exponent()),
+			Weight(std::pow(norm(), (double) obs.size())), weight_v.data() + begin);
+	}
+};
+
+// logarithm of NormPdf, does not need any transcendental function per particle
+template<typename Weight, typename Observation, typename Enable = void>
+class LogNormPdf_ : public NormPdfBase, public LogLikelihood {
+protected:
+	void weight(const std::vector<Observation>& state_v, const Observation& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		const Weight n = std::log(norm()), e = exponent();
+		std::fill(weight_v.begin() + begin, weight_v.begin() + end, 0);
+		simd::accumulate_square(state_v.data() + begin, end - begin, 1, Observation(obs + mu), weight_v.data() + begin);
+		for(size_t i = begin; i < end; ++i)
+			weight_v[i] = n + e * weight_v[i];
+	}
+};
+
+template<typename Weight, typename Observation>
+class LogNormPdf_<Weight, Observation, typename std::enable_if<isFixedArray<Observation>::value >::type>
+	: public NormPdfBase, public LogLikelihood {
+protected:
+	void weight(const std::vector<Observation>& state_v, const Observation& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		typedef typename isFixedArray<Observation>::element_type T;
+		const size_t dim = isFixedArray<Observation>::dimensions;
+		const Weight n = dim * std::log(norm()), e = exponent();
+		std::fill(weight_v.begin() + begin, weight_v.begin() + end, 0);
+		for(size_t j = 0; j < dim; ++j)
+			simd::accumulate_square(reinterpret_cast<const T*>(state_v.data() + begin) + j,
+				end - begin, dim, T(obs[j] + mu), weight_v.data() + begin);
+		for(size_t i = begin; i < end; ++i)
+			weight_v[i] = n + e * weight_v[i];
+	}
+};
+
+template<typename Weight, typename Observation>
+class LogNormPdf_<Weight, Observation, typename std::enable_if<isSoA<Observation>::value >::type>
+	: public NormPdf_<Weight, Observation>, public LogLikelihood {
+protected:
+	typedef typename ParticleStorage<Observation>::type Particles;
+	typedef typename ParticleStorage<Observation>::value_type Value;
+
+	void weight(const Particles& state_v, const Value& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		const Weight n = Particles::dimensions * std::log(this->norm()), e = this->exponent();
+		this->squared_distances(state_v, obs, weight_v, begin, end);
+		for(size_t i = begin; i < end; ++i)
+			weight_v[i] = n + e * weight_v[i];
+	}
+};
+
+template<typename Weight, typename Observation>
+class LogNormPdf_<Weight, Observation, typename std::enable_if<isFlat<Observation>::value >::type>
+	: public NormPdf_<Weight, Observation>, public LogLikelihood {
+protected:
+	typedef typename ParticleStorage<Observation>::type Particles;
+	typedef typename ParticleStorage<Observation>::value_type Value;
+
+	void weight(const Particles& state_v, const Value& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		const Weight n = state_v.dimension() * std::log(this->norm()), e = this->exponent();
+		this->squared_distances(state_v, obs, weight_v, begin, end);
+		for(size_t i = begin; i < end; ++i)
+			weight_v[i] = n + e * weight_v[i];
+	}
+};
+
+template<typename Weight, typename Observation>
+class LogNormPdf_<Weight, Observation, typename std::enable_if<isContainer<Observation>::value >::type>
+	: public NormPdfBase, public LogLikelihood {
+protected:
+	void weight(const std::vector<Observation>& state_v, const Observation& obs, std::vector<Weight>& weight_v,
+			size_t begin, size_t end) {
+		const Weight n = obs.size() * std::log(norm()), e = exponent();
+		for(size_t i = begin; i < end; ++i)
+			weight_v[i] = n + e * squared_distance(state_v[i], obs, mu);
 	}
 };
 
@@ -82,15 +410,27 @@ protected:
 template<typename Weight, typename Observation>
 using SquareError = SquareError_<Weight, Observation>;
 
+template<typename Weight, typename Observation>
+using LogSquareError = LogSquareError_<Weight, Observation>;
+
 template<typename Weight, typename Observation>
 using NormPdf = NormPdf_<Weight, Observation>;
+
+template<typename Weight, typename Observation>
+using LogNormPdf = LogNormPdf_<Weight, Observation>;
 #else
 // Workaround for g++ 4.6
 template<typename Weight, typename Observation>
 class SquareError : public SquareError_<Weight, Observation> {};
 
+template<typename Weight, typename Observation>
+class LogSquareError : public LogSquareError_<Weight, Observation> {};
+
 template<typename Weight, typename Observation>
 class NormPdf : public NormPdf_<Weight, Observation> {};
+
+template<typename Weight, typename Observation>
+class LogNormPdf : public LogNormPdf_<Weight, Observation> {};
 #endif
 
 }}
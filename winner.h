@@ -4,51 +4,402 @@
 #include <vector>
 #include <deque>
 #include <type_traits>
+#include <array>
+#include <utility>
+
+#include "storage.h"
 
 namespace policy_pf {
 namespace winner_policies {
 
+// The weighted sums are accumulated in the type selected by Accumulator
+// (double for float states). The range form of winner returns the partial
+// sums of a range of particles in that type, combine_winners adds them up
+// and finish_winner rounds the total to the state type once.
 template<typename State, typename Weight, typename Enable = void>
 class WeightedArithmeticMean_ {
 protected:
+	typedef typename Accumulator<State>::type Sum;
+
 	State winner(const std::vector<State>& state_v, const std::vector<Weight>& weight_v) {
-		State win = {0};
-		for(size_t i = 0; i < state_v.size(); ++i)
-			win = win + (state_v[i]*weight_v[i]);
+		return finish_winner(winner(state_v, weight_v, 0, state_v.size()), state_v);
+	}
+
+	// partial sums for the particles [begin, end)
+	Sum winner(const std::vector<State>& state_v, const std::vector<Weight>& weight_v, size_t begin, size_t end) {
+		Sum win = {0};
+		for(size_t i = begin; i < end; ++i)
+			win = win + (Sum(state_v[i])*weight_v[i]);
 		return win;
 	}
+
+	void combine_winners(Sum& win, const Sum& partial) {
+		win = win + partial;
+	}
+
+	State finish_winner(const Sum& win, const std::vector<State>&) {
+		return State(win);
+	}
 };
 
-// Specialization for array type States. As c++ methods cannot return arrays
-// winner returns a pointer to a State array.
+// Specialization for fixed size array States (T[N] and std::array<T, N>).
+// As c++ methods cannot return C arrays winner returns a std::array.
 template<typename State, typename Weight>
-class WeightedArithmeticMean_<State, Weight, typename std::enable_if<std::is_array<State>::value >::type> {
+class WeightedArithmeticMean_<State, Weight, typename std::enable_if<isFixedArray<State>::value >::type> {
 protected:
-	State* winner(const std::vector<State>& state_v, const std::vector<Weight>& weight_v) {
-		State* win = (State*) new State;
-		for(size_t j = 0; j < std::extent<State>::value; ++j) {
-			(*win)[j] = 0;
-			for(size_t i = 0; i < state_v.size(); ++i)
-				(*win)[j] = (*win)[j] + (state_v[i][j] * weight_v[i]);
-		}
+	typedef typename isFixedArray<State>::element_type T;
+	typedef typename Accumulator<T>::type Sum;
+	typedef std::array<T, isFixedArray<State>::dimensions> Value;
+	typedef std::array<Sum, isFixedArray<State>::dimensions> Partial;
+
+	Value winner(const std::vector<State>& state_v, const std::vector<Weight>& weight_v) {
+		return finish_winner(winner(state_v, weight_v, 0, state_v.size()), state_v);
+	}
+
+	Partial winner(const std::vector<State>& state_v, const std::vector<Weight>& weight_v, size_t begin, size_t end) {
+		Partial sum = {};
+		for(size_t i = begin; i < end; ++i)
+			for(size_t j = 0; j < sum.size(); ++j)
+				sum[j] += Sum(state_v[i][j]) * weight_v[i];
+		return sum;
+	}
+
+	void combine_winners(Partial& win, const Partial& partial) {
+		for(size_t j = 0; j < win.size(); ++j)
+			win[j] += partial[j];
+	}
+
+	Value finish_winner(const Partial& sum, const std::vector<State>&) {
+		Value win;
+		for(size_t j = 0; j < win.size(); ++j)
+			win[j] = sum[j];
 		return win;
 	}
 };
 
-template <typename T> struct isContainer {static const bool value = false;};
-template <typename T> struct isContainer<std::vector<T> > {static const bool value = true;};
-template <typename T> struct isContainer<std::deque<T> > {static const bool value = true;};
+// rounds the sums of variable size states to the value type, the vector of
+// sums is moved into the result if no rounding is needed
+template<typename Value, typename Sum>
+Value round_sums(std::vector<Sum>&& sum, std::true_type) {
+	return std::move(sum);
+}
+
+template<typename Value, typename Sum>
+Value round_sums(std::vector<Sum>&& sum, std::false_type) {
+	return Value(sum.begin(), sum.end());
+}
 
 template<typename State, typename Weight>
 class WeightedArithmeticMean_<State, Weight, typename std::enable_if<isContainer<State>::value >::type> {
 protected:
+	typedef typename Accumulator<typename State::value_type>::type Sum;
+	typedef std::vector<Sum> Partial;
+
 	State winner(const std::vector<State>& state_v, const std::vector<Weight>& weight_v) {
+		return round_sums<State>(winner(state_v, weight_v, 0, state_v.size()), std::is_same<State, Partial>());
+	}
+
+	Partial winner(const std::vector<State>& state_v, const std::vector<Weight>& weight_v, size_t begin, size_t end) {
 		size_t sz = (state_v.size() > 0 ? state_v[0].size() : 0);
-	
-		State win(sz, 0);
-		for(size_t i = 0; i < sz; ++i)
-			for(size_t j = 0; j < state_v.size(); ++j)
-				win[i] = win[i] + (state_v[j][i]*weight_v[j]);
+		Partial sum(sz, 0);
+
+		// particle by particle, so every state is read once in memory order
+		for(size_t j = begin; j < end; ++j)
+			for(size_t i = 0; i < sz; ++i)
+				sum[i] = sum[i] + (Sum(state_v[j][i])*weight_v[j]);
+		return sum;
+	}
+
+	void combine_winners(Partial& win, const Partial& partial) {
+		for(size_t i = 0; i < win.size(); ++i)
+			win[i] = win[i] + partial[i];
+	}
+
+	State finish_winner(const Partial& sum, const std::vector<State>&) {
+		return State(sum.begin(), sum.end());
+	}
+};
+
+// Specialization for structure of arrays states, returns a std::array
+template<typename State, typename Weight>
+class WeightedArithmeticMean_<State, Weight, typename std::enable_if<isSoA<State>::value >::type> {
+protected:
+	typedef typename ParticleStorage<State>::type Particles;
+	typedef typename ParticleStorage<State>::value_type Value;
+	typedef typename Accumulator<typename Value::value_type>::type Sum;
+	typedef std::array<Sum, Particles::dimensions> Partial;
+
+	Value winner(const Particles& state_v, const std::vector<Weight>& weight_v) {
+		return finish_winner(winner(state_v, weight_v, 0, state_v.size()), state_v);
+	}
+
+	Partial winner(const Particles& state_v, const std::vector<Weight>& weight_v, size_t begin, size_t end) {
+		Partial win;
+		for(size_t j = 0; j < Particles::dimensions; ++j) {
+			auto c = state_v.column(j);
+			Sum sum = 0;
+			for(size_t i = begin; i < end; ++i)
+				sum += c[i] * weight_v[i];
+			win[j] = sum;
+		}
+		return win;
+	}
+
+	void combine_winners(Partial& win, const Partial& partial) {
+		for(size_t j = 0; j < Particles::dimensions; ++j)
+			win[j] += partial[j];
+	}
+
+	Value finish_winner(const Partial& sum, const Particles&) {
+		Value win;
+		for(size_t j = 0; j < Particles::dimensions; ++j)
+			win[j] = sum[j];
+		return win;
+	}
+};
+
+// Specialization for flat states, returns a std::vector
+template<typename State, typename Weight>
+class WeightedArithmeticMean_<State, Weight, typename std::enable_if<isFlat<State>::value >::type> {
+protected:
+	typedef typename ParticleStorage<State>::type Particles;
+	typedef typename ParticleStorage<State>::value_type Value;
+	typedef typename Accumulator<typename Particles::element_type>::type Sum;
+	typedef std::vector<Sum> Partial;
+
+	Value winner(const Particles& state_v, const std::vector<Weight>& weight_v) {
+		return round_sums<Value>(winner(state_v, weight_v, 0, state_v.size()), std::is_same<Value, Partial>());
+	}
+
+	// particle by particle, so the arena is read once in memory order
+	Partial winner(const Particles& state_v, const std::vector<Weight>& weight_v, size_t begin, size_t end) {
+		const size_t dim = state_v.dimension();
+		Partial sum(dim, 0);
+		for(size_t i = begin; i < end; ++i) {
+			const auto x = state_v.row(i);
+			for(size_t j = 0; j < dim; ++j)
+				sum[j] += Sum(x[j]) * weight_v[i];
+		}
+		return sum;
+	}
+
+	void combine_winners(Partial& win, const Partial& partial) {
+		for(size_t j = 0; j < win.size(); ++j)
+			win[j] += partial[j];
+	}
+
+	Value finish_winner(const Partial& sum, const Particles&) {
+		return Value(sum.begin(), sum.end());
+	}
+};
+
+// Winner policies deriving from BeforeResampling are evaluated on the
+// weighted particle set while the particle filter normalizes the weights,
+// block by block in the same pass, instead of on the resampled particle set.
+// They implement the range form of winner, combine_winners and
+// finish_winner, which is called once after all ranges have been combined.
+struct BeforeResampling {};
+
+template<typename WinnerPolicy>
+struct isBeforeResampling : std::is_base_of<BeforeResampling, WinnerPolicy> {};
+
+// types of the mean (Value) and the covariance matrix (Covariance) of a
+// particle set and of their partial sums (SumValue, SumCovariance) in the
+// accumulator type; fixed size and SoA states use std::array, so no memory
+// is allocated
+template<typename State, typename Enable = void>
+struct MomentTypes {
+	typedef State Scalar;
+	typedef State Value;
+	typedef State Covariance;
+	typedef typename Accumulator<Scalar>::type SumScalar;
+	typedef SumScalar SumValue;
+	typedef SumScalar SumCovariance;
+	static Value value(size_t) { return 0; }
+	static Covariance covariance(size_t) { return 0; }
+	static SumValue sum_value(size_t) { return 0; }
+	static SumCovariance sum_covariance(size_t) { return 0; }
+	static size_t dimensions(const std::vector<State>&) { return 1; }
+	static Scalar coordinate(const std::vector<State>& state_v, size_t i, size_t) { return state_v[i]; }
+	template<typename V> static V& element(V& v, size_t) { return v; }
+	static size_t size(const SumValue&) { return 1; }
+};
+
+template<typename State>
+struct MomentTypes<State, typename std::enable_if<isFixedArray<State>::value >::type> {
+	typedef typename isFixedArray<State>::element_type Scalar;
+	static const size_t N = isFixedArray<State>::dimensions;
+	typedef std::array<Scalar, N> Value;
+	typedef std::array<Scalar, N*N> Covariance;
+	typedef typename Accumulator<Scalar>::type SumScalar;
+	typedef std::array<SumScalar, N> SumValue;
+	typedef std::array<SumScalar, N*N> SumCovariance;
+	static Value value(size_t) { return Value(); }
+	static Covariance covariance(size_t) { return Covariance(); }
+	static SumValue sum_value(size_t) { return SumValue(); }
+	static SumCovariance sum_covariance(size_t) { return SumCovariance(); }
+	static size_t dimensions(const std::vector<State>&) { return N; }
+	static Scalar coordinate(const std::vector<State>& state_v, size_t i, size_t j) { return state_v[i][j]; }
+	template<typename A> static auto element(A& v, size_t j) -> decltype(v[j]) { return v[j]; }
+	static size_t size(const SumValue&) { return N; }
+};
+
+template<typename State>
+struct MomentTypes<State, typename std::enable_if<isContainer<State>::value >::type> {
+	typedef typename State::value_type Scalar;
+	typedef State Value;
+	typedef std::vector<Scalar> Covariance;
+	typedef typename Accumulator<Scalar>::type SumScalar;
+	typedef std::vector<SumScalar> SumValue;
+	typedef std::vector<SumScalar> SumCovariance;
+	static Value value(size_t n) { return Value(n, 0); }
+	static Covariance covariance(size_t n) { return Covariance(n*n, 0); }
+	static SumValue sum_value(size_t n) { return SumValue(n, 0); }
+	static SumCovariance sum_covariance(size_t n) { return SumCovariance(n*n, 0); }
+	static size_t dimensions(const std::vector<State>& state_v) { return state_v.empty() ? 0 : state_v[0].size(); }
+	static Scalar coordinate(const std::vector<State>& state_v, size_t i, size_t j) { return state_v[i][j]; }
+	template<typename C> static auto element(C& v, size_t j) -> decltype(v[j]) { return v[j]; }
+	static size_t size(const SumValue& v) { return v.size(); }
+};
+
+template<typename State>
+struct MomentTypes<State, typename std::enable_if<isSoA<State>::value >::type> {
+	typedef typename ParticleStorage<State>::type Particles;
+	typedef typename Particles::element_type Scalar;
+	static const size_t N = Particles::dimensions;
+	typedef std::array<Scalar, N> Value;
+	typedef std::array<Scalar, N*N> Covariance;
+	typedef typename Accumulator<Scalar>::type SumScalar;
+	typedef std::array<SumScalar, N> SumValue;
+	typedef std::array<SumScalar, N*N> SumCovariance;
+	static Value value(size_t) { return Value(); }
+	static Covariance covariance(size_t) { return Covariance(); }
+	static SumValue sum_value(size_t) { return SumValue(); }
+	static SumCovariance sum_covariance(size_t) { return SumCovariance(); }
+	static size_t dimensions(const Particles&) { return N; }
+	static Scalar coordinate(const Particles& state_v, size_t i, size_t j) { return state_v(i, j); }
+	template<typename A> static auto element(A& v, size_t j) -> decltype(v[j]) { return v[j]; }
+	static size_t size(const SumValue&) { return N; }
+};
+
+template<typename State>
+struct MomentTypes<State, typename std::enable_if<isFlat<State>::value >::type> {
+	typedef typename ParticleStorage<State>::type Particles;
+	typedef typename Particles::element_type Scalar;
+	typedef std::vector<Scalar> Value;
+	typedef std::vector<Scalar> Covariance;
+	typedef typename Accumulator<Scalar>::type SumScalar;
+	typedef std::vector<SumScalar> SumValue;
+	typedef std::vector<SumScalar> SumCovariance;
+	static Value value(size_t n) { return Value(n, 0); }
+	static Covariance covariance(size_t n) { return Covariance(n*n, 0); }
+	static SumValue sum_value(size_t n) { return SumValue(n, 0); }
+	static SumCovariance sum_covariance(size_t n) { return SumCovariance(n*n, 0); }
+	static size_t dimensions(const Particles& state_v) { return state_v.dimension(); }
+	static Scalar coordinate(const Particles& state_v, size_t i, size_t j) { return state_v(i, j); }
+	template<typename C> static auto element(C& v, size_t j) -> decltype(v[j]) { return v[j]; }
+	static size_t size(const SumValue& v) { return v.size(); }
+};
+
+// weighted mean, covariance matrix (row major), maximum a posteriori
+// particle and effective sample size of a particle set
+template<typename Value, typename Covariance, typename Weight>
+struct Moments {
+	Value mean;
+	Covariance covariance;
+	Value map;
+	Weight map_weight;
+	double effective_sample_size;
+
+	// sums of the weights and of their squares, index of the map particle
+	Weight weight_sum, square_sum;
+	size_t map_index;
+};
+
+// Computes all moments in a single pass over the particles. The deviations
+// from the first particle are accumulated, so the covariance does not lose
+// precision if the mean is large compared to the spread of the particles.
+// The partial sums are kept in the accumulator type and rounded to the
+// state type once by finish_winner.
+template<typename State, typename Weight>
+class PosteriorMoments_ : public BeforeResampling {
+protected:
+	typedef MomentTypes<State> Types;
+	typedef typename ParticleStorage<State>::type Particles;
+	typedef typename Types::Scalar Scalar;
+	typedef typename Types::SumScalar SumScalar;
+	typedef typename Accumulator<Weight>::type Sum;
+	typedef Moments<typename Types::Value, typename Types::Covariance, Sum> Result;
+	typedef Moments<typename Types::SumValue, typename Types::SumCovariance, Sum> Partial;
+
+	Result winner(const Particles& state_v, const std::vector<Weight>& weight_v) {
+		return finish_winner(winner(state_v, weight_v, 0, state_v.size()), state_v);
+	}
+
+	Partial winner(const Particles& state_v, const std::vector<Weight>& weight_v, size_t begin, size_t end) {
+		const size_t dim = Types::dimensions(state_v);
+		Partial win = {Types::sum_value(dim), Types::sum_covariance(dim), Types::sum_value(0), -1, 0, 0, 0, 0};
+		typename Types::SumValue d = Types::sum_value(dim), shift = Types::sum_value(dim);
+		for(size_t j = 0; j < dim && begin < end; ++j)
+			Types::element(shift, j) = Types::coordinate(state_v, 0, j);
+
+		for(size_t i = begin; i < end; ++i) {
+			const Weight w = weight_v[i];
+			win.weight_sum += w;
+			win.square_sum += Sum(w)*w;
+			if(w > win.map_weight) {
+				win.map_weight = w;
+				win.map_index = i;
+			}
+
+			for(size_t j = 0; j < dim; ++j) {
+				SumScalar& dj = Types::element(d, j);
+				dj = Types::coordinate(state_v, i, j) - Types::element(shift, j);
+				Types::element(win.mean, j) += w * dj;
+				for(size_t k = 0; k <= j; ++k)
+					Types::element(win.covariance, j*dim + k) += w * dj * Types::element(d, k);
+			}
+		}
+		return win;
+	}
+
+	void combine_winners(Partial& win, const Partial& partial) {
+		const size_t n = Types::size(partial.mean);
+		win.weight_sum += partial.weight_sum;
+		win.square_sum += partial.square_sum;
+		if(partial.map_weight > win.map_weight) {
+			win.map_weight = partial.map_weight;
+			win.map_index = partial.map_index;
+		}
+		for(size_t j = 0; j < n*n; ++j)
+			Types::element(win.covariance, j) += Types::element(partial.covariance, j);
+		for(size_t j = 0; j < n; ++j)
+			Types::element(win.mean, j) += Types::element(partial.mean, j);
+	}
+
+	Result finish_winner(const Partial& sums, const Particles& state_v) {
+		const size_t dim = Types::dimensions(state_v);
+		const Sum sw = sums.weight_sum;
+		Result win = {Types::value(dim), Types::covariance(dim), Types::value(0), sums.map_weight,
+			sw > 0 ? double(sw) * sw / sums.square_sum : 0, sw, sums.square_sum, sums.map_index};
+		if(state_v.size() == 0 || sw <= 0)
+			return win;
+
+		win.map = Types::value(dim);
+		for(size_t j = 0; j < dim; ++j) {
+			const SumScalar m = Types::element(sums.mean, j) / sw;
+			Types::element(win.mean, j) = m + SumScalar(Types::coordinate(state_v, 0, j));
+			Types::element(win.map, j) = Types::coordinate(state_v, sums.map_index, j);
+		}
+		for(size_t j = 0; j < dim; ++j) {
+			const SumScalar mj = Types::element(sums.mean, j) / sw;
+			for(size_t k = 0; k <= j; ++k) {
+				const SumScalar mk = Types::element(sums.mean, k) / sw;
+				const SumScalar c = Types::element(sums.covariance, j*dim + k) / sw - mj * mk;
+				Types::element(win.covariance, j*dim + k) = c;
+				Types::element(win.covariance, k*dim + j) = c;
+			}
+		}
 		return win;
 	}
 };
@@ -57,10 +408,16 @@ protected:
 // Workaround for g++ 4.7
 template<typename State, typename Weight>
 using WeightedArithmeticMean = WeightedArithmeticMean_<State, Weight>;
+
+template<typename State, typename Weight>
+using PosteriorMoments = PosteriorMoments_<State, Weight>;
 #else
 // Workaround for g++ 4.6
 template<typename State, typename Weight>
 class WeightedArithmeticMean : public WeightedArithmeticMean_<State, Weight> {};
+
+template<typename State, typename Weight>
+class PosteriorMoments : public PosteriorMoments_<State, Weight> {};
 #endif
 
 }}